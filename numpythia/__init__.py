@@ -1,5 +1,9 @@
 from ._libnumpythia import _Pythia as Pythia, ReaderAscii, WriterAscii
+from ._libnumpythia import ParallelReaderAscii, compression_supported
+from ._libnumpythia import ReaderBinary, WriterBinary, WriterHDF5, hdf5_supported
 from ._libnumpythia import FILTERS
+from .parallel import ParallelPythia, SharedRingBuffer
+from .arrow import ArrowWriter, arrow_write
 import logging
 
 locals().update(FILTERS)
@@ -7,7 +11,18 @@ locals().update(FILTERS)
 log = logging.getLogger(__name__)
 
 __all__ = [
+    'ArrowWriter',
     'Pythia',
+    'ParallelPythia',
+    'ParallelReaderAscii',
+    'ReaderBinary',
+    'SharedRingBuffer',
+    'WriterBinary',
+    'WriterHDF5',
+    'arrow_write',
+    'compression_supported',
+    'hdf5_supported',
+    'hdf5_write',
     'hepmc_read',
     'hepmc_write',
 ]
@@ -16,13 +31,29 @@ PYTHIA_VERSION = '8.244'
 HEPMC_VERSION = '3.0.0'
 
 
-def hepmc_read(filename):
-    reader = ReaderAscii(filename)
+def hepmc_read(filename, mmap=False, n_threads=1, index=True):
+    if n_threads == 1:
+        reader = ReaderAscii(filename, mmap=mmap, index=index)
+    else:
+        reader = ParallelReaderAscii(filename, n_threads=n_threads, index=index)
     for event in reader:
         yield event
 
-def hepmc_write(filename, source):
-    writer = WriterAscii(filename)
+def hepmc_write(filename, source, precision=None, queue_size=0,
+                compression=None, compression_level=None, compression_threads=1):
+    writer = WriterAscii(filename, precision=precision, queue_size=queue_size,
+                         compression=compression, compression_level=compression_level,
+                         compression_threads=compression_threads)
     for event in source:
         writer.write(event)
         yield event
+    writer.close()
+
+def hdf5_write(filename, source, selection=None, chunk_size=8192, compression_level=1,
+               cache_size=1 << 24):
+    writer = WriterHDF5(filename, selection=selection, chunk_size=chunk_size,
+                        compression_level=compression_level, cache_size=cache_size)
+    for event in source:
+        writer.write(event)
+        yield event
+    writer.close()
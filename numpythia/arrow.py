@@ -0,0 +1,183 @@
+"""
+Export of events to Apache Arrow. Each event is one row with a ``particles``
+column of type list<struct> holding its ``DTYPE_PARTICLE`` rows and a
+``weights`` column of type list<double>. Rows are collected into record
+batches that are streamed to an Arrow IPC stream or a Parquet file as they
+fill up. pyarrow is only imported when a writer is created, and
+pyarrow.parquet only when that writer writes Parquet.
+"""
+import numpy as np
+
+from ._libnumpythia import DTYPE_PARTICLE, PythiaEvent
+
+__all__ = [
+    'ArrowWriter',
+    'arrow_write',
+]
+
+FORMATS = ('ipc', 'parquet')
+PARQUET_EXTENSIONS = ('.parquet', '.pq')
+MAX_LIST_OFFSET = np.iinfo(np.int32).max
+
+
+def import_pyarrow(parquet=False):
+    try:
+        import pyarrow
+        if parquet:
+            import pyarrow.parquet
+    except ImportError:
+        raise ImportError("the {0} export requires pyarrow".format(
+            'Parquet' if parquet else 'Arrow'))
+    return pyarrow
+
+
+def event_schema(pa):
+    """
+    Schema of the record batches: one list<struct> of particles and one
+    list<double> of weights per event
+    """
+    particle = pa.struct([(name, pa.from_numpy_dtype(DTYPE_PARTICLE.fields[name][0]))
+                          for name in DTYPE_PARTICLE.names])
+    return pa.schema([('particles', pa.list_(particle)),
+                      ('weights', pa.list_(pa.float64()))])
+
+
+def list_array(pa, offsets, values):
+    if offsets[-1] > MAX_LIST_OFFSET:
+        raise ValueError("too many values in one batch, use a smaller batch_size")
+    return pa.ListArray.from_arrays(pa.array(offsets.astype(np.int32)), values)
+
+
+def record_batch(pa, schema, particles, offsets, weights=None):
+    """
+    Record batch of the events ``particles[offsets[i]:offsets[i + 1]]`` as
+    returned by ``Pythia.generate_batch``, with ``weights[i]`` the weights
+    of event i or no weights if ``weights`` is None
+    """
+    offsets = np.asarray(offsets, dtype=np.int64)
+    nevents = len(offsets) - 1
+    particles = particles[offsets[0]:offsets[-1]]
+    offsets = offsets - offsets[0]
+    if weights is None:
+        weights = [()] * nevents
+    elif len(weights) != nevents:
+        raise ValueError("expected weights of {0} events, got {1}".format(nevents, len(weights)))
+    weight_offsets = np.zeros(nevents + 1, dtype=np.int64)
+    weight_offsets[1:] = np.cumsum([len(event_weights) for event_weights in weights])
+    if weight_offsets[-1] > 0:
+        weight_values = np.concatenate([np.asarray(event_weights, dtype=np.float64)
+                                        for event_weights in weights])
+    else:
+        weight_values = np.empty(0, dtype=np.float64)
+    particle_type = schema.field('particles').type.value_type
+    columns = pa.StructArray.from_arrays(
+        [pa.array(np.ascontiguousarray(particles[name])) for name in DTYPE_PARTICLE.names],
+        fields=list(particle_type))
+    return pa.RecordBatch.from_arrays(
+        [list_array(pa, offsets, columns), list_array(pa, weight_offsets, pa.array(weight_values))],
+        schema=schema)
+
+
+class ArrowWriter(object):
+    """
+    Stream events to ``filename`` in Arrow IPC stream format or as Parquet.
+    The format is taken from the extension (``.parquet`` or ``.pq`` for
+    Parquet, IPC otherwise) unless ``format`` is given, and ``compression``
+    is passed on to the Parquet writer.
+
+    ``write`` takes one ``GenEvent`` or ``PythiaEvent`` at a time and
+    writes a record batch every ``batch_size`` events, with the particles
+    passing ``selection``. ``write_batch`` writes the arrays of
+    ``Pythia.generate_batch`` or ``ParallelPythia.batches`` as one record
+    batch.
+    """
+    def __init__(self, filename, format=None, selection=None, batch_size=1000,
+                 compression=None):
+        if format is None:
+            format = 'parquet' if filename.lower().endswith(PARQUET_EXTENSIONS) else 'ipc'
+        if format not in FORMATS:
+            raise ValueError("format must be one of {0}".format(', '.join(FORMATS)))
+        if batch_size < 1:
+            raise ValueError("batch_size must be at least 1")
+        if compression is not None and format != 'parquet':
+            raise ValueError("compression is only supported for Parquet")
+        pa = import_pyarrow(parquet=format == 'parquet')
+        self._pa = pa
+        self.schema = event_schema(pa)
+        self.format = format
+        self.selection = selection
+        self.batch_size = batch_size
+        if format == 'parquet':
+            self._writer = pa.parquet.ParquetWriter(
+                filename, self.schema, compression=compression or 'snappy')
+        else:
+            self._sink = pa.OSFile(filename, 'wb')
+            self._writer = pa.ipc.new_stream(self._sink, self.schema)
+        self._particles = []
+        self._weights = []
+
+    def write(self, event):
+        if self._writer is None:
+            raise ValueError("writer is closed")
+        if isinstance(event, PythiaEvent):
+            particles = event.array(self.selection)
+        else:
+            particles = event.all(self.selection)
+        self._particles.append(particles)
+        self._weights.append(event.weights)
+        if len(self._particles) >= self.batch_size:
+            self.flush()
+
+    def write_batch(self, particles, offsets, weights=None):
+        if self._writer is None:
+            raise ValueError("writer is closed")
+        self.flush()
+        self._write(record_batch(self._pa, self.schema, particles, offsets, weights))
+
+    def flush(self):
+        """
+        Write the events passed to ``write`` since the last batch
+        """
+        if not self._particles:
+            return
+        offsets = np.zeros(len(self._particles) + 1, dtype=np.int64)
+        offsets[1:] = np.cumsum([len(particles) for particles in self._particles])
+        particles = np.concatenate(self._particles)
+        batch = record_batch(self._pa, self.schema, particles, offsets, self._weights)
+        self._particles = []
+        self._weights = []
+        self._write(batch)
+
+    def _write(self, batch):
+        if self.format == 'parquet':
+            self._writer.write_table(self._pa.Table.from_batches([batch], schema=self.schema))
+        else:
+            self._writer.write_batch(batch)
+
+    def close(self):
+        if self._writer is None:
+            return
+        self.flush()
+        self._writer.close()
+        self._writer = None
+        if self.format == 'ipc':
+            self._sink.close()
+
+    def __enter__(self):
+        return self
+
+    def __exit__(self, *args):
+        self.close()
+
+
+def arrow_write(filename, source, selection=None, format=None, batch_size=1000,
+                compression=None):
+    """
+    Write the events of ``source`` to ``filename`` with ``ArrowWriter``
+    while yielding them, like ``hepmc_write``
+    """
+    with ArrowWriter(filename, format=format, selection=selection,
+                     batch_size=batch_size, compression=compression) as writer:
+        for event in source:
+            writer.write(event)
+            yield event
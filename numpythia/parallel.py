@@ -0,0 +1,196 @@
+"""
+Event generation with a pool of worker processes, each running its own
+PYTHIA instance seeded deterministically from a single ``random_state``.
+"""
+import multiprocessing
+import numpy as np
+
+from ._libnumpythia import _Pythia as Pythia, SharedRingBuffer
+
+__all__ = [
+    'ParallelPythia',
+    'SharedRingBuffer',
+]
+
+# Random:seed accepts values in [0, 900000000] where 0 means a time based seed
+MAX_SEED = 900000000
+
+
+def worker_seeds(random_state, n_workers):
+    """
+    Distinct PYTHIA seeds of the workers. The seed of a worker only depends on
+    ``random_state`` and its index, so it does not change with ``n_workers``.
+    """
+    base = np.random.RandomState(random_state).randint(MAX_SEED)
+    return [(base + iworker) % MAX_SEED + 1 for iworker in range(n_workers)]
+
+
+def batch_sizes(events, batch_size, iworker, n_workers):
+    """
+    Sizes of the batches generated by one worker. Batches are assigned to the
+    workers round-robin, so batch k of the whole run is made by worker
+    k % n_workers. With ``events < 0`` batches are generated forever.
+    """
+    ibatch = iworker
+    while events < 0 or ibatch * batch_size < events:
+        if events < 0:
+            yield batch_size
+        else:
+            yield min(batch_size, events - ibatch * batch_size)
+        ibatch += n_workers
+
+
+def worker_main(config, seed, selection, verbosity, params, kwargs,
+                iworker, n_workers, commands, ring_name, stop):
+    ring = SharedRingBuffer(ring_name, create=False)
+    try:
+        pythia = Pythia(config, random_state=seed, verbosity=verbosity,
+                        params=params, **kwargs)
+        init_error = None
+    except Exception as error:
+        init_error = error
+    while True:
+        command = commands.get()
+        if command is None:
+            break
+        events, batch_size = command
+        try:
+            if init_error is not None:
+                raise init_error
+            for size in batch_sizes(events, batch_size, iworker, n_workers):
+                if stop.is_set():
+                    break
+                particles, offsets = pythia.generate_batch(size, selection)
+                ring.put_batch(particles, offsets)
+        except Exception as error:
+            ring.put_message(SharedRingBuffer.ERROR, repr(error).encode())
+        # marks the end of this command's output
+        ring.put_message(SharedRingBuffer.DONE)
+
+
+class ParallelPythia(object):
+    """
+    Generate events in ``n_workers`` processes with one PYTHIA instance each.
+
+    Worker i is seeded with ``seeds[i]``, derived from ``random_state``, and
+    the batches of all workers are returned in round-robin order, so the
+    output is reproducible for a fixed ``random_state`` and ``n_workers``.
+    The remaining arguments are passed on to ``Pythia`` in each worker.
+
+    Batches are transferred through one ``SharedRingBuffer`` of
+    ``buffer_size`` bytes per worker, which must hold at least one batch.
+    With ``copy=False`` the yielded arrays are views into the shared memory
+    that are only valid until the next batch is requested.
+    """
+    def __init__(self, config='', n_workers=None, random_state=None,
+                 batch_size=100, selection=None, verbosity=0,
+                 params=None, context=None, buffer_size=1 << 26, copy=True,
+                 **kwargs):
+        if n_workers is None:
+            n_workers = multiprocessing.cpu_count()
+        if n_workers < 1:
+            raise ValueError("n_workers must be at least 1")
+        if batch_size < 1:
+            raise ValueError("batch_size must be at least 1")
+        if context is None:
+            context = multiprocessing
+        elif not hasattr(context, 'Process'):
+            context = multiprocessing.get_context(context)
+        self.n_workers = n_workers
+        self.batch_size = batch_size
+        self.copy = copy
+        self.seeds = worker_seeds(random_state, n_workers)
+        self._stop = context.Event()
+        self._commands = []
+        self._rings = []
+        self._workers = []
+        for iworker, seed in enumerate(self.seeds):
+            commands = context.Queue()
+            # the ring also bounds how far a worker can run ahead
+            ring = SharedRingBuffer(capacity=buffer_size)
+            worker = context.Process(
+                target=worker_main,
+                args=(config, seed, selection, verbosity, params, kwargs,
+                      iworker, n_workers, commands, ring.name, self._stop))
+            worker.daemon = True
+            worker.start()
+            self._commands.append(commands)
+            self._rings.append(ring)
+            self._workers.append(worker)
+
+    def _get(self, iworker):
+        ring = self._rings[iworker]
+        while True:
+            message = ring.get(timeout=0.1)
+            if message is not None:
+                break
+            if not self._workers[iworker].is_alive():
+                raise RuntimeError("worker {0} died".format(iworker))
+        kind, particles, offsets = message
+        if kind == SharedRingBuffer.ERROR:
+            raise RuntimeError("worker {0} failed: {1}".format(
+                iworker, particles.decode('utf-8', 'replace')))
+        return kind, particles, offsets
+
+    def batches(self, events=-1):
+        """
+        Generate ``events`` events (forever if negative) and yield them in
+        batches as ``(particles, offsets)`` like ``Pythia.generate_batch``.
+        """
+        if not self._workers:
+            raise RuntimeError("ParallelPythia is closed")
+        for commands in self._commands:
+            commands.put((events, self.batch_size))
+        active = [True] * self.n_workers
+        try:
+            iworker = 0
+            while any(active):
+                if active[iworker]:
+                    kind, particles, offsets = self._get(iworker)
+                    if kind == SharedRingBuffer.DONE:
+                        active[iworker] = False
+                    elif self.copy:
+                        particles, offsets = particles.copy(), offsets.copy()
+                        self._rings[iworker].release()
+                        yield particles, offsets
+                    else:
+                        yield particles, offsets
+                        self._rings[iworker].release()
+                iworker = (iworker + 1) % self.n_workers
+        finally:
+            if any(active):
+                # stopped early: let the workers finish and drop their output
+                self._stop.set()
+                for iworker in range(self.n_workers):
+                    while active[iworker]:
+                        message = self._rings[iworker].get(timeout=0.1)
+                        if message is not None and message[0] == SharedRingBuffer.DONE:
+                            active[iworker] = False
+                        elif message is None and not self._workers[iworker].is_alive():
+                            active[iworker] = False
+                    self._rings[iworker].release()
+                self._stop.clear()
+
+    def __call__(self, events=-1):
+        """
+        Generate ``events`` events (forever if negative) and yield the
+        particle array of each event.
+        """
+        for particles, offsets in self.batches(events):
+            for ievent in range(len(offsets) - 1):
+                yield particles[offsets[ievent]:offsets[ievent + 1]]
+
+    def close(self):
+        for commands in self._commands:
+            commands.put(None)
+        for worker in self._workers:
+            worker.join()
+        self._commands = []
+        self._rings = []
+        self._workers = []
+
+    def __enter__(self):
+        return self
+
+    def __exit__(self, *args):
+        self.close()
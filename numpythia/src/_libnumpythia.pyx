@@ -15,19 +15,25 @@ cimport cython
 from cython.operator cimport dereference as deref
 
 from libc.stdlib cimport malloc, free
+from libc.string cimport memcpy
+from posix.unistd cimport usleep
+from posix.time cimport clock_gettime, timespec, CLOCK_MONOTONIC
 
 from libcpp cimport bool
 from libcpp.vector cimport vector
 from libcpp.string cimport string, const_char
 from libcpp.cast cimport static_cast
 
-from cpython cimport PyObject
+from cpython cimport PyObject, Py_INCREF
+from cpython.bytes cimport PyBytes_FromStringAndSize
 from cpython.cobject cimport (PyCObject_AsVoidPtr,
                               PyCObject_Check,
                               PyCObject_FromVoidPtr)
 
 from libcpp.memory cimport shared_ptr
 import os
+import uuid
+import multiprocessing
 
 cimport pythia as Pythia
 cimport hepmc as HepMC
@@ -62,6 +68,9 @@ PARENTS = HepMC.PARENTS
 CHILDREN = HepMC.CHILDREN
 SIBLINGS = HepMC.PRODUCTION_SIBLINGS
 
+# Number of dropped GenEvents kept for reuse with recycle=True
+cdef size_t EVENT_POOL_SIZE = 16
+
 cdef class Sphericity:
     cdef Pythia.Sphericity* c_this
     cdef bool own
@@ -126,90 +135,127 @@ cdef class Sphericity:
             del self.c_this
 
 
-cdef class FilterList:
-    cdef HepMC.FilterList _filterlist
-
-    def __and__(FilterList self, other):
-        filterlist = FilterList()
-        filterlist._filterlist.extend(self._filterlist)
-        if isinstance(other, BooleanFilter):
-            filterlist._filterlist.append(deref(static_cast["const HepMC.Filter*"]((<BooleanFilter> other)._filter)))
-        elif isinstance(other, FilterList):
-            filterlist._filterlist.extend((<FilterList> other)._filterlist)
-        else:
-            raise TypeError("can only combine boolean filters")
-        return filterlist
-
 cdef class Filter:
-    cdef bool own
-    cdef const HepMC.FilterBase* _filter
+    """
+    Base of the particle filters. Boolean filters and their combinations
+    with ``&``, ``|`` and ``~`` are compiled once into a postfix program that
+    is evaluated over columns of particle properties.
+    """
+    # postfix program as a list of (op, column, compare, value)
+    cdef list program
+    cdef numpythia.SelectionProgram* compiled
 
-    cdef init(self, const HepMC.FilterBase& _filter, bool own):
-        self._filter = &_filter
-        self.own = own
+    def __cinit__(self):
+        self.program = []
+        self.compiled = NULL
 
     def __dealloc__(self):
-        if self.own:
-            del self._filter
-
-    def __and__(Filter self, other):
-        filterlist = FilterList()
-        if isinstance(other, BooleanFilter):
-            filterlist._filterlist = HepMC.FilterList(
-                deref(static_cast["const HepMC.Filter*"](self._filter)),
-                deref(static_cast["const HepMC.Filter*"]((<Filter> other)._filter)))
-        elif isinstance(other, FilterList):
-            filterlist._filterlist = HepMC.FilterList(deref(static_cast["const HepMC.Filter*"](self._filter)))
-            filterlist._filterlist.extend((<FilterList> other)._filterlist)
-        else:
-            raise TypeError("can only combine boolean filters")
-        return filterlist
+        del self.compiled
+
+    cdef const numpythia.SelectionProgram* get_program(self) except NULL:
+        if isinstance(self, IntegerFilter):
+            raise TypeError("find must be a boolean expression of Filters")
+        if self.compiled == NULL:
+            self.compiled = new numpythia.SelectionProgram()
+            for op, column, compare, value in self.program:
+                self.compiled.push(op, column, compare, value)
+        return self.compiled
+
+    def __and__(self, other):
+        return combine_filters(self, other, numpythia.SEL_AND)
+
+    def __rand__(self, other):
+        return combine_filters(other, self, numpythia.SEL_AND)
+
+    def __or__(self, other):
+        return combine_filters(self, other, numpythia.SEL_OR)
+
+    def __ror__(self, other):
+        return combine_filters(other, self, numpythia.SEL_OR)
+
+    def __invert__(self):
+        if isinstance(self, IntegerFilter):
+            raise TypeError("can only negate boolean filters")
+        result = FilterList()
+        result.program = self.program + [(numpythia.SEL_NOT, 0, 0, 0)]
+        return result
+
+    def __reduce__(self):
+        # pickled as the program, e.g. to pass a selection to a worker process
+        return (filter_from_program, (type(self), self.program))
+
+
+def filter_from_program(object cls, list program):
+    cdef Filter result = cls()
+    result.program = list(program)
+    return result
+
+
+cdef class FilterList(Filter):
+    """
+    A combination of boolean filters
+    """
+    pass
+
+
+cdef object combine_filters(object left, object right, int op):
+    if (not isinstance(left, (BooleanFilter, FilterList)) or
+        not isinstance(right, (BooleanFilter, FilterList))):
+        raise TypeError("can only combine boolean filters")
+    result = FilterList()
+    result.program = (<Filter> left).program + (<Filter> right).program + [(op, 0, 0, 0)]
+    return result
+
 
 cdef class IntegerFilter(Filter):
+    cdef int column
+    cdef bool absolute
+
+    cdef init(self, int column, bool absolute):
+        self.column = column
+        self.absolute = absolute
+
+    def __reduce__(self):
+        return (integer_filter, (self.column, self.absolute))
+
     def __richcmp__(IntegerFilter self, int value, int op):
+        # op follows Py_LT, Py_LE, Py_EQ, Py_NE, Py_GT, Py_GE as SelectionCompare
         result = BooleanFilter()
-        if op == 0:
-            result._filter = new HepMC.Filter(deref(self._filter) < value)
-        elif op == 2:
-            result._filter = new HepMC.Filter(deref(self._filter) == value)
-        elif op == 4:
-            result._filter = new HepMC.Filter(deref(self._filter) > value)
-        elif op == 1:
-            result._filter = new HepMC.Filter(deref(self._filter) <= value)
-        elif op == 3:
-            result._filter = new HepMC.Filter(deref(self._filter) != value)
-        elif op == 5:
-            result._filter = new HepMC.Filter(deref(self._filter) >= value)
-        result.own = True
+        result.program = [(numpythia.SEL_COMPARE_ABS if self.absolute else numpythia.SEL_COMPARE,
+                           self.column, op, value)]
         return result
 
+
+def integer_filter(int column, bool absolute):
+    cdef IntegerFilter result = IntegerFilter()
+    result.init(column, absolute)
+    return result
+
+
 cdef class BooleanFilter(Filter):
-    def __invert__(self):
-        result = BooleanFilter()
-        # Ouch
-        result._filter = new HepMC.Filter(not deref(static_cast["const HepMC.Filter*"](self._filter)))
-        result.own = True
-        return result
+    cdef init(self, list program):
+        self.program = program
+
 
 # filters with integer parameter
 cpdef IntegerFilter STATUS = IntegerFilter()
-STATUS.init(HepMC.STATUS, False)
+STATUS.init(numpythia.SEL_STATUS, False)
 cpdef IntegerFilter PDG_ID = IntegerFilter()
-PDG_ID.init(HepMC.PDG_ID, False)
+PDG_ID.init(numpythia.SEL_PDG_ID, False)
 cpdef IntegerFilter ABS_PDG_ID = IntegerFilter()
-ABS_PDG_ID.init(HepMC.ABS_PDG_ID, False)
+ABS_PDG_ID.init(numpythia.SEL_PDG_ID, True)
 
 # filters with boolean parameter
 cpdef BooleanFilter HAS_END_VERTEX = BooleanFilter()
-HAS_END_VERTEX.init(HepMC.HAS_END_VERTEX, False)
+HAS_END_VERTEX.init([(numpythia.SEL_TEST, numpythia.SEL_HAS_END_VERTEX, 0, 0)])
 cpdef BooleanFilter HAS_PRODUCTION_VERTEX = BooleanFilter()
-HAS_PRODUCTION_VERTEX.init(HepMC.HAS_PRODUCTION_VERTEX, False)
+HAS_PRODUCTION_VERTEX.init([(numpythia.SEL_TEST, numpythia.SEL_HAS_PRODUCTION_VERTEX, 0, 0)])
 cpdef BooleanFilter HAS_SAME_PDG_ID_DAUGHTER = BooleanFilter()
-HAS_SAME_PDG_ID_DAUGHTER.init(HepMC.HAS_SAME_PDG_ID_DAUGHTER, False)
+HAS_SAME_PDG_ID_DAUGHTER.init([(numpythia.SEL_TEST, numpythia.SEL_HAS_SAME_PDG_ID_DAUGHTER, 0, 0)])
 cpdef BooleanFilter IS_STABLE = BooleanFilter()
-IS_STABLE.init(HepMC.IS_STABLE, False)
+IS_STABLE.init([(numpythia.SEL_COMPARE, numpythia.SEL_STATUS, numpythia.SEL_EQUAL, 1)])
 cpdef BooleanFilter IS_BEAM = BooleanFilter()
-IS_BEAM.init(HepMC.IS_BEAM, False)
+IS_BEAM.init([(numpythia.SEL_COMPARE, numpythia.SEL_STATUS, numpythia.SEL_EQUAL, 4)])
 
 FILTERS = {
     'STATUS': STATUS,
@@ -222,33 +268,144 @@ FILTERS = {
     'IS_BEAM': IS_BEAM,
 }
 
+# selects all particles
+cdef FilterList ALL_PARTICLES = FilterList()
+
+
+cdef inline const numpythia.SelectionProgram* to_selection(object selection) except NULL:
+    if selection is None:
+        return ALL_PARTICLES.get_program()
+    if not isinstance(selection, Filter):
+        raise TypeError("find must be a boolean expression of Filters")
+    return (<Filter> selection).get_program()
+
 
-cdef inline np.ndarray particles_to_array(vector[HepMC.SmartPointer[HepMC.GenParticle]] particles):
-    cdef np.ndarray particle_array = np.empty((particles.size(),), dtype=DTYPE_PARTICLE)
-    numpythia.hepmc_to_array(particles, <char*> particle_array.data, <unsigned int> particle_array.itemsize)
+# column index of each field as in numpythia::ParticleField
+FIELD_INDEX = dict((name, index) for index, name in enumerate(DTYPE_PARTICLE.names))
+
+
+cdef inline object fields_dtype(object fields, vector[int]& offsets):
+    """
+    Reduced dtype with the requested columns of DTYPE_PARTICLE in the given
+    order and the byte offset of each column (or -1) in ``offsets``.
+    """
+    if isinstance(fields, string_types):
+        fields = [fields]
+    for name in fields:
+        if name not in FIELD_INDEX:
+            raise ValueError("unknown particle field: {0}".format(name))
+    dtype = np.dtype([(name, DTYPE_PARTICLE.fields[name][0]) for name in fields])
+    offsets.assign(numpythia.NUM_FIELDS, -1)
+    for name in fields:
+        offsets[FIELD_INDEX[name]] = dtype.fields[name][1]
+    return dtype
+
+
+cdef inline dict new_columns(object fields, size_t size, vector[char*]& columns):
+    """
+    Structure-of-arrays layout: a dict of one contiguous array per field,
+    with the data of each array in ``columns``.
+    """
+    cdef np.ndarray column
+    if fields is None:
+        fields = DTYPE_PARTICLE.names
+    elif isinstance(fields, string_types):
+        fields = [fields]
+    columns.assign(numpythia.NUM_FIELDS, NULL)
+    result = {}
+    for name in fields:
+        if name not in FIELD_INDEX:
+            raise ValueError("unknown particle field: {0}".format(name))
+        column = np.empty((size,), dtype=DTYPE_PARTICLE.fields[name][0])
+        columns[FIELD_INDEX[name]] = <char*> column.data
+        result[name] = column
+    return result
+
+
+cdef inline dict particles_to_columns(vector[HepMC.SmartPointer[HepMC.GenParticle]]& particles,
+                                     object fields, bool vertices=True):
+    cdef vector[char*] columns
+    result = new_columns(fields, particles.size(), columns)
+    numpythia.hepmc_to_columns(particles, columns, vertices)
+    return result
+
+
+cdef inline object particles_to_array(vector[HepMC.SmartPointer[HepMC.GenParticle]] particles,
+                                      object fields=None, object layout='aos',
+                                      bool vertices=True):
+    cdef np.ndarray particle_array
+    cdef vector[int] offsets
+    if layout == 'soa':
+        return particles_to_columns(particles, fields, vertices)
+    elif layout != 'aos':
+        raise ValueError("layout must be 'aos' or 'soa'")
+    if fields is None:
+        particle_array = np.empty((particles.size(),), dtype=DTYPE_PARTICLE)
+        numpythia.hepmc_to_array(particles, <char*> particle_array.data,
+                                 <unsigned int> particle_array.itemsize, vertices)
+        return particle_array
+    dtype = fields_dtype(fields, offsets)
+    particle_array = np.empty((particles.size(),), dtype=dtype)
+    numpythia.hepmc_to_array_fields(particles, <char*> particle_array.data,
+                                    <unsigned int> particle_array.itemsize, offsets, vertices)
+    return particle_array
+
+
+cdef inline object record_to_array(numpythia.PythiaRecord* record, vector[int]& indices,
+                                   object fields=None, object layout='aos', bool vertices=True):
+    """
+    The particles of a PYTHIA record at ``indices`` like ``particles_to_array``
+    """
+    cdef np.ndarray particle_array
+    cdef vector[int] offsets
+    cdef vector[char*] columns
+    if layout == 'soa':
+        result = new_columns(fields, indices.size(), columns)
+        record.to_columns(indices, columns, vertices)
+        return result
+    elif layout != 'aos':
+        raise ValueError("layout must be 'aos' or 'soa'")
+    if fields is None:
+        particle_array = np.empty((indices.size(),), dtype=DTYPE_PARTICLE)
+        record.to_array(indices, <char*> particle_array.data,
+                        <unsigned int> particle_array.itemsize, vertices)
+        return particle_array
+    dtype = fields_dtype(fields, offsets)
+    particle_array = np.empty((indices.size(),), dtype=dtype)
+    record.to_array_fields(indices, <char*> particle_array.data,
+                           <unsigned int> particle_array.itemsize, offsets, vertices)
     return particle_array
 
 
+cdef inline void check_hepmc_options(bool return_hepmc, object fields, object layout,
+                                     bool vertices=True) except *:
+    # the array options would otherwise be silently ignored
+    if return_hepmc and (fields is not None or layout != 'aos' or not vertices):
+        raise ValueError("fields, layout and vertices only apply to arrays, "
+                         "pass return_hepmc=False")
+
+
 cdef inline object particle_find(HepMC.SmartPointer[HepMC.GenParticle]& particle, object selection,
-                                 HepMC.Relationship mode, bool return_hepmc):
-    cdef HepMC.FindParticles* search
+                                 HepMC.Relationship mode, bool return_hepmc, object fields=None,
+                                 object layout='aos'):
+    check_hepmc_options(return_hepmc, fields, layout)
+    cdef const numpythia.SelectionProgram* program = to_selection(selection)
+    cdef HepMC.FindParticles* search = new HepMC.FindParticles(particle, mode)
+    cdef vector[HepMC.SmartPointer[HepMC.GenParticle]] particles
     if selection is None:
-        search = new HepMC.FindParticles(particle, mode)
+        particles = search.results()
     else:
-        if isinstance(selection, BooleanFilter):
-            selection = FilterList(selection)
-        elif not isinstance(selection, FilterList):
-            raise TypeError("find must be a boolean expression of Filters")
-        search = new HepMC.FindParticles(particle, mode, (<FilterList> selection)._filterlist)
-    cdef vector[HepMC.SmartPointer[HepMC.GenParticle]] particles = search.results()
+        program.select(search.results(), ALL, particles)
     del search
     if return_hepmc:
         return vector_to_list(particles)
-    return particles_to_array(particles)
+    return particles_to_array(particles, fields, layout)
 
 
 cdef inline object event_find(shared_ptr[HepMC.GenEvent]& event, object selection,
-                              HepMC.FilterType mode, bool return_hepmc):
+                              HepMC.FilterType mode, bool return_hepmc, object fields=None,
+                              object layout='aos', bool vertices=True):
+    check_hepmc_options(return_hepmc, fields, layout, vertices)
     cdef list py_particles
     if selection is None:
         if return_hepmc:
@@ -256,20 +413,72 @@ cdef inline object event_find(shared_ptr[HepMC.GenEvent]& event, object selectio
             if mode == FIRST or mode == LAST:
                 return py_particles[0] if py_particles else None
             return py_particles
-        return particles_to_array(deref(event).particles())
-    if isinstance(selection, BooleanFilter):
-        selection = FilterList(selection)
-    elif not isinstance(selection, FilterList):
-        raise TypeError("find must be a boolean expression of Filters")
-    cdef HepMC.FindParticles* search = new HepMC.FindParticles(deref(event), mode, (<FilterList> selection)._filterlist)
-    cdef vector[HepMC.SmartPointer[HepMC.GenParticle]] particles = search.results()
-    del search
+        return particles_to_array(deref(event).particles(), fields, layout, vertices)
+    cdef vector[HepMC.SmartPointer[HepMC.GenParticle]] particles
+    to_selection(selection).select(deref(event).particles(), mode, particles)
     if return_hepmc:
         py_particles = vector_to_list(particles)
         if mode == FIRST or mode == LAST:
             return py_particles[0] if py_particles else None
         return py_particles
-    return particles_to_array(particles)
+    return particles_to_array(particles, fields, layout, vertices)
+
+
+cdef inline object snapshot_find(numpythia.PythiaSnapshot* snapshot, object selection,
+                                 HepMC.FilterType mode, object fields=None, object layout='aos',
+                                 bool vertices=True):
+    cdef const numpythia.SelectionProgram* program = to_selection(selection)
+    cdef numpythia.PythiaRecord* record
+    cdef vector[int] indices
+    if selection is None:
+        # all particles as from event_find
+        mode = ALL
+    with nogil:
+        record = snapshot.record()
+        record.select(deref(program), indices, mode)
+    return record_to_array(record, indices, fields, layout, vertices)
+
+
+cdef inline object event_relatives(shared_ptr[HepMC.GenEvent]& event, object particles,
+                                   bool ancestors, object selection, bool return_hepmc,
+                                   object fields=None, object layout='aos'):
+    """
+    Ancestors or descendants of many particles of an event in one pass.
+    ``particles`` is a sequence of GenParticle of this event or of indices
+    into ``GenEvent.all()``.
+    """
+    check_hepmc_options(return_hepmc, fields, layout)
+    cdef const numpythia.SelectionProgram* program = to_selection(selection)
+    cdef vector[HepMC.SmartPointer[HepMC.GenParticle]]* event_particles = &deref(event).particles()
+    cdef vector[int] indices
+    cdef vector[int] results
+    cdef vector[long long] offsets
+    cdef long long index
+    cdef GenParticle particle
+    for item in particles:
+        if isinstance(item, GenParticle):
+            particle = <GenParticle> item
+            if deref(particle.particle).parent_event() != event.get():
+                raise ValueError("particle does not belong to this event")
+            index = deref(particle.particle).id() - 1
+        else:
+            index = item
+            if index < 0 or index >= <long long> event_particles.size():
+                raise IndexError("particle index out of range: {0}".format(item))
+        indices.push_back(index)
+    with nogil:
+        numpythia.hepmc_find_relatives(deref(event), indices, ancestors, deref(program),
+                                       results, offsets)
+    cdef vector[HepMC.SmartPointer[HepMC.GenParticle]] relatives
+    relatives.reserve(results.size())
+    for index in results:
+        relatives.push_back(deref(event_particles)[index])
+    if return_hepmc:
+        py_relatives = vector_to_list(relatives)
+        return [py_relatives[offsets[i]:offsets[i + 1]] for i in range(indices.size())]
+    cdef np.ndarray offsets_array = np.empty((offsets.size(),), dtype=np.int64)
+    memcpy(offsets_array.data, offsets.data(), offsets.size() * sizeof(long long))
+    return particles_to_array(relatives, fields, layout), offsets_array
 
 
 cdef class GenParticle:
@@ -281,20 +490,30 @@ cdef class GenParticle:
         wrapped_particle.particle = particle
         return wrapped_particle
 
-    def parents(self, object selection=None, bool return_hepmc=False):
-        return particle_find(self.particle, selection, mode=PARENTS, return_hepmc=return_hepmc)
+    def parents(self, object selection=None, bool return_hepmc=False, object fields=None,
+            object layout='aos'):
+        return particle_find(self.particle, selection, mode=PARENTS, return_hepmc=return_hepmc,
+                             fields=fields, layout=layout)
 
-    def children(self, object selection=None, bool return_hepmc=False):
-        return particle_find(self.particle, selection, mode=CHILDREN, return_hepmc=return_hepmc)
+    def children(self, object selection=None, bool return_hepmc=False, object fields=None,
+            object layout='aos'):
+        return particle_find(self.particle, selection, mode=CHILDREN, return_hepmc=return_hepmc,
+                             fields=fields, layout=layout)
 
-    def ancestors(self, object selection=None, bool return_hepmc=False):
-        return particle_find(self.particle, selection, mode=ANCESTORS, return_hepmc=return_hepmc)
+    def ancestors(self, object selection=None, bool return_hepmc=False, object fields=None,
+            object layout='aos'):
+        return particle_find(self.particle, selection, mode=ANCESTORS, return_hepmc=return_hepmc,
+                             fields=fields, layout=layout)
 
-    def descendants(self, object selection=None, bool return_hepmc=False):
-        return particle_find(self.particle, selection, mode=DESCENDANTS, return_hepmc=return_hepmc)
+    def descendants(self, object selection=None, bool return_hepmc=False, object fields=None,
+            object layout='aos'):
+        return particle_find(self.particle, selection, mode=DESCENDANTS, return_hepmc=return_hepmc,
+                             fields=fields, layout=layout)
 
-    def siblings(self, object selection=None, bool return_hepmc=False):
-        return particle_find(self.particle, selection, mode=SIBLINGS, return_hepmc=return_hepmc)
+    def siblings(self, object selection=None, bool return_hepmc=False, object fields=None,
+            object layout='aos'):
+        return particle_find(self.particle, selection, mode=SIBLINGS, return_hepmc=return_hepmc,
+                             fields=fields, layout=layout)
 
     @property
     def pid(self):
@@ -356,10 +575,35 @@ cdef inline list vector_to_list(vector[HepMC.SmartPointer[HepMC.GenParticle]]& p
     return py_particles
 
 
+cdef inline void check_next_status(int status) except *:
+    if status == numpythia.NEXT_ABORTED:
+        raise RuntimeError("PYTHIA event generation aborted prematurely")
+    elif status == numpythia.NEXT_CONVERSION_FAILED:
+        raise RuntimeError("unable to convert PYTHIA event to HepMC")
+
+
+cdef inline shared_ptr[HepMC.GenEvent] new_event(numpythia.GenEventPool* pool):
+    # an empty event, recycled from the pool if there is one
+    if pool != NULL:
+        return pool.acquire()
+    return shared_ptr[HepMC.GenEvent](new HepMC.GenEvent(HepMC.GEV, HepMC.MM))
+
+
 cdef class GenEvent:
     cdef shared_ptr[HepMC.GenEvent] event
+    # Copy of the PYTHIA event that the HepMC event is built from on first
+    # use of the graph, or NULL if the event was built right away
+    cdef numpythia.PythiaSnapshot* snapshot
+    # The generator whose particle data the snapshot refers to and whose
+    # arenas and free list of GenEvents are used to build the HepMC event
+    cdef object generator
+    cdef HepMC.EventArenaPool* arenas
+    cdef numpythia.GenEventPool* pool
     cdef public np.ndarray weights
 
+    def __dealloc__(self):
+        del self.snapshot
+
     @staticmethod
     cdef inline GenEvent wrap(shared_ptr[HepMC.GenEvent]& event):
         cdef GenEvent wrapped_event = GenEvent()
@@ -372,34 +616,148 @@ cdef class GenEvent:
         return wrapped_event
 
     @staticmethod
-    cdef inline GenEvent wrap_pythia(Pythia.Pythia& pythia):
-        cdef HepMC.Pythia8ToHepMC3 py2hepmc
-        # Suppress warnings
-        py2hepmc.set_print_inconsistency(False)
-        cdef shared_ptr[HepMC.GenEvent] event = shared_ptr[HepMC.GenEvent](new HepMC.GenEvent(HepMC.GEV, HepMC.MM))
-        if not py2hepmc.fill_next_event(pythia, &deref(event)):
-            raise RuntimeError("unable to convert PYTHIA event to HepMC")
+    cdef inline GenEvent wrap_pythia(Pythia.Pythia& pythia, HepMC.EventArenaPool* arenas,
+                                     numpythia.GenEventPool* pool):
+        cdef shared_ptr[HepMC.GenEvent] event = new_event(pool)
+        cdef int status
+        with nogil:
+            status = numpythia.pythia_to_hepmc(pythia, event.get(), arenas)
+        check_next_status(status)
         return GenEvent.wrap(event)
 
-    def all(self, object selection=None, bool return_hepmc=False):
-        return event_find(self.event, selection, ALL, return_hepmc)
+    @staticmethod
+    cdef inline GenEvent wrap_snapshot(Pythia.Pythia& pythia, object generator,
+                                       HepMC.EventArenaPool* arenas,
+                                       numpythia.GenEventPool* pool):
+        cdef GenEvent wrapped_event = GenEvent()
+        with nogil:
+            wrapped_event.snapshot = new numpythia.PythiaSnapshot(pythia)
+        cdef vector[double]* weights = &wrapped_event.snapshot.weights
+        cdef np.ndarray weights_array = np.empty(weights.size(), dtype=np.float64)
+        for iweight in range(weights.size()):
+            weights_array[iweight] = deref(weights)[iweight]
+        wrapped_event.generator = generator
+        wrapped_event.arenas = arenas
+        wrapped_event.pool = pool
+        wrapped_event.weights = weights_array
+        return wrapped_event
 
-    def first(self, object selection=None, bool return_hepmc=True):
-        return event_find(self.event, selection, FIRST, return_hepmc)
+    cdef shared_ptr[HepMC.GenEvent] get_event(self) except *:
+        # the HepMC event, built from the snapshot if not done yet
+        cdef shared_ptr[HepMC.GenEvent] event
+        cdef int status
+        if self.snapshot != NULL and self.event.get() == NULL:
+            event = new_event(self.pool)
+            with nogil:
+                status = self.snapshot.to_hepmc(event.get(), self.arenas)
+            check_next_status(status)
+            self.event = event
+        return self.event
+
+    def all(self, object selection=None, bool return_hepmc=False, object fields=None,
+            object layout='aos', bool vertices=True):
+        if self.snapshot != NULL and not return_hepmc:
+            return snapshot_find(self.snapshot, selection, ALL, fields, layout, vertices)
+        return event_find(self.get_event(), selection, ALL, return_hepmc, fields, layout, vertices)
+
+    def first(self, object selection=None, bool return_hepmc=True, object fields=None,
+            object layout='aos', bool vertices=True):
+        if self.snapshot != NULL and not return_hepmc:
+            return snapshot_find(self.snapshot, selection, FIRST, fields, layout, vertices)
+        return event_find(self.get_event(), selection, FIRST, return_hepmc, fields, layout, vertices)
+
+    def last(self, object selection=None, bool return_hepmc=True, object fields=None,
+            object layout='aos', bool vertices=True):
+        if self.snapshot != NULL and not return_hepmc:
+            return snapshot_find(self.snapshot, selection, LAST, fields, layout, vertices)
+        return event_find(self.get_event(), selection, LAST, return_hepmc, fields, layout, vertices)
+
+    def ancestors(self, object particles, object selection=None, bool return_hepmc=False,
+                  object fields=None, object layout='aos'):
+        """
+        Ancestors of each of ``particles`` (GenParticle of this event or
+        indices into ``all()``) as ``(array, offsets)``, where the ancestors
+        of ``particles[i]`` are ``array[offsets[i]:offsets[i + 1]]`` in the
+        order of ``GenParticle.ancestors``. With ``return_hepmc`` a list of
+        lists of GenParticle is returned instead.
+        """
+        return event_relatives(self.get_event(), particles, True, selection, return_hepmc,
+                               fields, layout)
 
-    def last(self, object selection=None, bool return_hepmc=True):
-        return event_find(self.event, selection, LAST, return_hepmc)
+    def descendants(self, object particles, object selection=None, bool return_hepmc=False,
+                    object fields=None, object layout='aos'):
+        """
+        Descendants of each of ``particles`` like ``ancestors``
+        """
+        return event_relatives(self.get_event(), particles, False, selection, return_hepmc,
+                               fields, layout)
+
+
+cdef class PythiaEvent:
+    """
+    A copy of the PYTHIA event record. Particle arrays are filled directly
+    from the record without building the HepMC graph. Rows are in the order
+    of the PYTHIA record and otherwise equal those of ``GenEvent.all``.
+    """
+    cdef Pythia.Event* event
+    # Particles in the copied record point into the particle data table of
+    # the generator, so keep the generator alive as long as the event.
+    cdef object generator
+    cdef public np.ndarray weights
+
+    def __dealloc__(self):
+        del self.event
+
+    @staticmethod
+    cdef inline PythiaEvent wrap_pythia(Pythia.Pythia& pythia, object generator):
+        cdef PythiaEvent wrapped_event = PythiaEvent()
+        wrapped_event.generator = generator
+        cdef int nweights = pythia.info.nWeights()
+        cdef np.ndarray weights_array = np.empty(nweights, dtype=np.float64)
+        for iweight in range(nweights):
+            weights_array[iweight] = pythia.info.weight(iweight)
+        with nogil:
+            wrapped_event.event = new Pythia.Event(pythia.event)
+        wrapped_event.weights = weights_array
+        return wrapped_event
+
+    def array(self, object selection=None):
+        cdef const numpythia.SelectionProgram* program = to_selection(selection)
+        cdef numpythia.PythiaRecord* record
+        cdef vector[int] indices
+        with nogil:
+            record = new numpythia.PythiaRecord(deref(self.event))
+            record.select(deref(program), indices)
+        cdef np.ndarray particle_array = np.empty((indices.size(),), dtype=DTYPE_PARTICLE)
+        cdef char* data = <char*> particle_array.data
+        cdef unsigned int itemsize = <unsigned int> particle_array.itemsize
+        with nogil:
+            record.to_array(indices, data, itemsize)
+            del record
+        return particle_array
 
 
 cdef class _Pythia:
     cdef Pythia.Pythia* pythia
     cdef Pythia.UserHooks* userhooks
+    # Arenas of the particles and vertices of the GenEvents, or NULL to
+    # allocate each of them on the heap
+    cdef HepMC.EventArenaPool* arenas
+    # Free list of the GenEvents to recycle, or NULL to create a new one
+    # for each event
+    cdef numpythia.GenEventPool* events
+    # Whether GenEvents are only built from a copy of the PYTHIA event when
+    # the graph is first used
+    cdef bool lazy
     cdef int verbosity
 
     def __cinit__(self, string config="",
                   int random_state=0,
                   int verbosity=1,
                   object params=None,
+                  bool arena=False,
+                  bool recycle=False,
+                  bool lazy=False,
                   **kwargs):
 
         xmldoc = resource_filename('numpythia', 'src/extern/pythia8244/share/Pythia8/xmldoc')
@@ -407,6 +765,13 @@ cdef class _Pythia:
 
         # Initialize pointers to NULL
         self.userhooks = NULL
+        self.arenas = NULL
+        if arena:
+            self.arenas = new HepMC.EventArenaPool()
+        self.events = NULL
+        if recycle:
+            self.events = new numpythia.GenEventPool(EVENT_POOL_SIZE)
+        self.lazy = lazy
 
         if verbosity > 0:
             self.pythia.readString("Init:showProcesses = on")
@@ -450,6 +815,10 @@ cdef class _Pythia:
     def __dealloc__(self):
         del self.pythia
         del self.userhooks
+        # arenas still used by events are kept alive by their particles
+        del self.arenas
+        # as is the free list by the events still in use
+        del self.events
 
     @property
     def nweights(self):
@@ -463,14 +832,18 @@ cdef class _Pythia:
             labels.append(self.pythia.info.weightLabel(iweight))
         return labels
 
-    cdef bool get_next_event(self) except *:
-        # generate event and quit if failure
-        if not self.pythia.next():
-            raise RuntimeError("PYTHIA event generation aborted prematurely")
-        return True
+    cdef int get_next_event(self, HepMC.GenEvent* event) nogil:
+        # generate the next event and convert it to HepMC without the GIL.
+        # Failures are returned as a NextStatus code for the caller to raise.
+        # Each _Pythia instance must only be driven by one thread at a time.
+        if event == NULL:
+            return numpythia.pythia_next(deref(self.pythia))
+        return numpythia.pythia_next_hepmc(deref(self.pythia), event, self.arenas)
 
     cdef GenEvent get_hepmc(self):
-        return GenEvent.wrap_pythia(deref(self.pythia))
+        if self.lazy:
+            return GenEvent.wrap_snapshot(deref(self.pythia), self, self.arenas, self.events)
+        return GenEvent.wrap_pythia(deref(self.pythia), self.arenas, self.events)
 
     """
     cdef void to_pseudojet(self, vector[PseudoJet]& particles, float eta_max):
@@ -487,57 +860,413 @@ cdef class _Pythia:
                           partons)
     """
 
+    def _hepmc_reference(self):
+        """
+        The current event converted to HepMC and converted by the upstream
+        algorithm of HepMC, both as HepMC3 ASCII text. Only for the tests.
+        """
+        cdef string converted, reference
+        numpythia.pythia_hepmc_reference(deref(self.pythia), converted, reference)
+        return converted, reference
+
     def __iter__(self):
         for event in self():
             yield event
 
-    def __call__(self, int events=-1):
+    def __call__(self, int events=-1, bool hepmc=True):
+        """
+        Generate events as ``GenEvent``, or as ``PythiaEvent`` without
+        converting to HepMC if ``hepmc`` is False.
+        """
         cdef int ievent = 0;
+        cdef int status
+        cdef shared_ptr[HepMC.GenEvent] event
         if events < 0:
             ievent = events - 1
         while ievent < events:
-            if not self.get_next_event():
-                continue
-            yield self.get_hepmc()
+            if hepmc and self.lazy:
+                with nogil:
+                    status = self.get_next_event(NULL)
+                check_next_status(status)
+                yield GenEvent.wrap_snapshot(deref(self.pythia), self, self.arenas, self.events)
+            elif hepmc:
+                event = new_event(self.events)
+                with nogil:
+                    status = self.get_next_event(event.get())
+                check_next_status(status)
+                yield GenEvent.wrap(event)
+            else:
+                with nogil:
+                    status = self.get_next_event(NULL)
+                check_next_status(status)
+                yield PythiaEvent.wrap_pythia(deref(self.pythia), self)
             if events > 0:
                 ievent += 1
         if self.verbosity > 0:
             self.pythia.stat()
 
+    def generate_batch(self, int events, object selection=None):
+        """
+        Generate ``events`` events and return the selected particles of all
+        of them as one flat array together with an int64 array of
+        ``events + 1`` offsets: the particles of event i are
+        ``particles[offsets[i]:offsets[i + 1]]``.
+        """
+        if events < 0:
+            raise ValueError("events must be non-negative")
+        cdef const numpythia.SelectionProgram* program = to_selection(selection)
+        cdef unsigned int itemsize = <unsigned int> DTYPE_PARTICLE.itemsize
+        cdef vector[char] buffer
+        cdef vector[long long] offsets
+        cdef int status
+        with nogil:
+            status = numpythia.pythia_generate_batch(
+                deref(self.pythia), events, deref(program),
+                itemsize, buffer, offsets)
+        check_next_status(status)
+        cdef np.ndarray particle_array = np.empty((offsets.back(),), dtype=DTYPE_PARTICLE)
+        cdef np.ndarray offset_array = np.empty((offsets.size(),), dtype=np.int64)
+        if offsets.back() > 0:
+            memcpy(particle_array.data, buffer.data(), offsets.back() * itemsize)
+        memcpy(offset_array.data, offsets.data(), offsets.size() * sizeof(long long))
+        return particle_array, offset_array
+
+COMPRESSIONS = {
+    'none': numpythia.COMPRESSION_NONE,
+    'gzip': numpythia.COMPRESSION_GZIP,
+    'zstd': numpythia.COMPRESSION_ZSTD,
+}
+
+
+cdef int to_compression(string filename, object compression) except -1:
+    if compression is None:
+        return numpythia.compression_from_extension(filename)
+    if compression not in COMPRESSIONS:
+        raise ValueError("compression must be one of {0}".format(', '.join(sorted(COMPRESSIONS))))
+    return COMPRESSIONS[compression]
+
+
+def compression_supported(object compression):
+    """
+    Whether numpythia was built with support for ``compression`` ('gzip'
+    or 'zstd') of HepMC files.
+    """
+    return numpythia.compression_supported(to_compression(b'', compression))
+
+
+cdef inline void check_compression(int compression) except *:
+    if not numpythia.compression_supported(compression):
+        raise ValueError("numpythia was built without support for {0} compression".format(
+            [name for name, value in COMPRESSIONS.items() if value == compression][0]))
+
+
 cdef class WriterAscii:
+    """
+    Writer of HepMC3 ASCII files. By default floating point values are
+    written with the fewest digits that read back to the same value, as
+    found by Grisu2 (rarely one digit more than the shortest).
+    ``precision`` instead writes them with that many digits after the
+    decimal point (2 to 24) like ``%.{precision}e``. ``precision=16``
+    gives the ``%.16e`` format earlier versions wrote by default.
+
+    Files ending in ``.gz`` or ``.zst`` are compressed with gzip or zstd,
+    or as given by ``compression`` ('gzip', 'zstd' or 'none'), at
+    ``compression_level`` (0 to 9 for gzip, 1 to 19 or more for zstd, the
+    default level of each by default; not allowed for uncompressed files).
+    Blocks of the output are compressed on ``compression_threads`` worker
+    threads.
+
+    With ``queue_size > 0`` events are formatted and written on a background
+    thread. ``write`` only queues the event and waits if ``queue_size``
+    events are already pending. Events must not be modified once written.
+    ``flush`` waits until all queued events are written to the file and
+    ``close`` also finishes the file. Write errors are raised as IOError by
+    the next ``write``, ``flush`` or ``close``.
+    """
+    cdef string filename
+    cdef numpythia.OutputFile* output
     cdef HepMC.WriterAscii* hepmc_writer
-
-    def __cinit__(self, string filename):
-        self.hepmc_writer = new HepMC.WriterAscii(filename)
+    cdef numpythia.AsyncWriterAscii* async_writer
+
+    def __cinit__(self, string filename, object precision=None, int queue_size=0,
+                  object compression=None, object compression_level=None, int compression_threads=1):
+        cdef int status
+        if precision is not None and not 2 <= precision <= 24:
+            raise ValueError("precision must be between 2 and 24")
+        if queue_size < 0:
+            raise ValueError("queue_size must not be negative")
+        cdef int compression_type = to_compression(filename, compression)
+        check_compression(compression_type)
+        cdef int min_level = numpythia.min_compression_level(compression_type)
+        cdef int max_level = numpythia.max_compression_level(compression_type)
+        if compression_level is not None:
+            if compression_type == numpythia.COMPRESSION_NONE:
+                raise ValueError("compression_level requires a compressed file")
+            if not min_level <= compression_level <= max_level:
+                raise ValueError("compression_level must be between {0} and {1}".format(
+                    min_level, max_level))
+        cdef int level = -1 if compression_level is None else compression_level
+        self.filename = filename
+        self.output = NULL
+        self.hepmc_writer = NULL
+        self.async_writer = NULL
+        if queue_size > 0:
+            self.async_writer = new numpythia.AsyncWriterAscii()
+            status = self.async_writer.open(filename, queue_size, precision or 0,
+                                            compression_type, level, compression_threads)
+            if status != numpythia.STREAM_OK:
+                raise IOError("unable to open {0}".format(filename))
+            return
+        self.output = new numpythia.OutputFile()
+        if self.output.open(filename, compression_type, level, compression_threads) != numpythia.STREAM_OK:
+            raise IOError("unable to open {0}".format(filename))
+        self.hepmc_writer = new HepMC.WriterAscii(self.output.stream())
+        if precision is not None:
+            self.hepmc_writer.set_precision(precision)
 
     def __dealloc__(self):
-        self.hepmc_writer.close()
-        del self.hepmc_writer
+        if self.hepmc_writer != NULL:
+            self.hepmc_writer.close()
+            del self.hepmc_writer
+        if self.output != NULL:
+            with nogil:
+                self.output.close()
+            del self.output
+        if self.async_writer != NULL:
+            with nogil:
+                self.async_writer.close()
+            del self.async_writer
+
+    cdef inline void check_status(self, int status) except *:
+        if status != numpythia.ASCII_OK:
+            raise IOError("unable to write to {0}".format(self.filename))
 
     def write(self, GenEvent event):
-        self.hepmc_writer.write_event(deref(event.event))
+        cdef shared_ptr[HepMC.GenEvent] hepmc_event = event.get_event()
+        cdef int status
+        if self.async_writer != NULL:
+            with nogil:
+                status = self.async_writer.write(hepmc_event)
+            self.check_status(status)
+        elif self.hepmc_writer != NULL:
+            self.hepmc_writer.write_event(deref(hepmc_event))
+        else:
+            raise ValueError("write to a closed WriterAscii")
+
+    def flush(self):
+        cdef int status = numpythia.ASCII_OK
+        if self.async_writer != NULL:
+            with nogil:
+                status = self.async_writer.flush()
+        elif self.output != NULL:
+            with nogil:
+                status = self.output.flush()
+        self.check_status(status)
+
+    def close(self):
+        cdef int status = numpythia.ASCII_OK
+        if self.hepmc_writer != NULL:
+            self.hepmc_writer.close()
+            del self.hepmc_writer
+            self.hepmc_writer = NULL
+        if self.output != NULL:
+            with nogil:
+                status = self.output.close()
+            del self.output
+            self.output = NULL
+        if self.async_writer != NULL:
+            with nogil:
+                status = self.async_writer.close()
+            del self.async_writer
+            self.async_writer = NULL
+        self.check_status(status)
 
 
 cdef class ReaderAscii:
+    """
+    Reader of HepMC3 ASCII files. With ``mmap=True`` the file is memory
+    mapped and parsed in place without the GIL instead of being read line by
+    line through HepMC::ReaderAscii. Both modes yield the same events.
+
+    ``len(reader)``, ``reader[i]``, slicing and ``shard`` use an index of
+    the event offsets. The index is saved to the sidecar file ``index``
+    (``filename + '.idx'`` by default, ``None`` or ``False`` to disable) and
+    reused as long as the HepMC file is unchanged. It is built by a complete
+    ``mmap=True`` pass over the file or on first use.
+
+    Files compressed with gzip or zstd are detected and decompressed while
+    reading. These can only be read sequentially and without ``mmap``.
+
+    ``arrays`` yields particle arrays without building ``GenEvent`` objects.
+
+    With ``recycle`` the C++ event of a dropped ``GenEvent`` is reused for
+    a later event, keeping the memory reserved for its particles and
+    vertices.
+    """
     cdef string filename
+    cdef string index_path
+    cdef bool mmap
+    cdef int compression
+    cdef numpythia.InputFile* input
     cdef HepMC.ReaderAscii* hepmc_reader
+    cdef numpythia.MappedReaderAscii* mapped_reader
+    cdef numpythia.AsciiRecord* record
+    cdef numpythia.GenEventPool* events
     cdef shared_ptr[HepMC.GenEvent] event
 
-    def __cinit__(self, string filename):
+    def __cinit__(self, string filename, bool mmap=False, object index=True, bool recycle=False):
         self.filename = filename
-        self.hepmc_reader = new HepMC.ReaderAscii(filename)
+        self.mmap = mmap
+        self.input = NULL
+        self.hepmc_reader = NULL
+        self.mapped_reader = NULL
+        self.record = NULL
+        self.events = NULL
+        if recycle:
+            self.events = new numpythia.GenEventPool(EVENT_POOL_SIZE)
+        self.compression = numpythia.detect_compression(filename)
+        check_compression(self.compression)
+        if index is True:
+            self.index_path = filename + '.idx'
+        elif index:
+            self.index_path = index
+        if mmap:
+            self.open_mapped()
+        elif self.compression != numpythia.COMPRESSION_NONE:
+            self.input = new numpythia.InputFile()
+            if self.input.open(filename) != numpythia.STREAM_OK:
+                raise IOError("unable to open {0}".format(filename))
+            self.hepmc_reader = new HepMC.ReaderAscii(self.input.stream())
+        else:
+            self.hepmc_reader = new HepMC.ReaderAscii(filename)
 
     def __dealloc__(self):
-        self.hepmc_reader.close()
-        del self.hepmc_reader
+        if self.hepmc_reader != NULL:
+            self.hepmc_reader.close()
+            del self.hepmc_reader
+        del self.input
+        del self.mapped_reader
+        del self.record
+        del self.events
+
+    cdef void open_mapped(self) except *:
+        if self.compression != numpythia.COMPRESSION_NONE:
+            raise ValueError("{0} is compressed and can only be read sequentially without mmap".format(
+                self.filename))
+        self.mapped_reader = new numpythia.MappedReaderAscii()
+        if self.mapped_reader.open(self.filename, self.index_path) != numpythia.ASCII_OK:
+            raise IOError("unable to open {0}".format(self.filename))
 
     def __iter__(self):
+        cdef int status
+        if self.mmap:
+            while True:
+                self.event = new_event(self.events)
+                with nogil:
+                    status = self.mapped_reader.read_event(deref(self.event))
+                if status == numpythia.ASCII_END:
+                    break
+                elif status != numpythia.ASCII_OK:
+                    raise IOError("unable to parse HepMC event in {0} before byte {1}".format(
+                        self.filename, self.mapped_reader.tell()))
+                yield GenEvent.wrap(self.event)
+            return
         while not self.hepmc_reader.failed():
-            self.event.reset(new HepMC.GenEvent())
+            self.event = new_event(self.events)
             self.hepmc_reader.read_event(deref(self.event))
             if self.hepmc_reader.failed():
                 break
             yield GenEvent.wrap(self.event)
+        if self.input != NULL and self.input.has_failed():
+            raise IOError("unable to decompress {0}".format(self.filename))
+
+    def arrays(self, object selection=None, int batch_size=100):
+        """
+        Particle arrays of the remaining events in batches of ``batch_size``
+        as ``(particles, offsets)`` like ``Pythia.generate_batch``. The rows
+        are filled directly from the particle and vertex lines of the memory
+        mapped file, without building a ``GenEvent``, and equal those of
+        ``event.all(selection)``.
+        """
+        if batch_size < 1:
+            raise ValueError("batch_size must be at least 1")
+        cdef const numpythia.SelectionProgram* program = to_selection(selection)
+        cdef int status
+        cdef vector[char] buffer
+        cdef vector[long long] offsets
+        cdef unsigned int itemsize = DTYPE_PARTICLE.itemsize
+        cdef np.ndarray particle_array
+        cdef np.ndarray offset_array
+        if self.mapped_reader == NULL:
+            self.open_mapped()
+        if self.record == NULL:
+            self.record = new numpythia.AsciiRecord()
+        while True:
+            with nogil:
+                status = numpythia.hepmc_read_arrays(deref(self.mapped_reader), deref(self.record), batch_size,
+                                                     deref(program), itemsize, buffer, offsets)
+            if status == numpythia.ASCII_END:
+                break
+            elif status != numpythia.ASCII_OK:
+                raise IOError("unable to parse HepMC event in {0} before byte {1}".format(
+                    self.filename, self.mapped_reader.tell()))
+            particle_array = np.empty((offsets.back(),), dtype=DTYPE_PARTICLE)
+            offset_array = np.empty((offsets.size(),), dtype=np.int64)
+            if offsets.back() > 0:
+                memcpy(particle_array.data, buffer.data(), offsets.back() * itemsize)
+            memcpy(offset_array.data, offsets.data(), offsets.size() * sizeof(long long))
+            yield particle_array, offset_array
+
+    def build_index(self, int n_threads=1):
+        """
+        Load the index of the event offsets or build it by scanning the file
+        on ``n_threads`` threads. Called implicitly by ``len`` and indexing.
+        """
+        if self.mapped_reader == NULL:
+            self.open_mapped()
+        with nogil:
+            self.mapped_reader.build_index(n_threads)
+
+    def __len__(self):
+        if self.compression != numpythia.COMPRESSION_NONE:
+            # as list(reader) asks for the length
+            raise TypeError("compressed HepMC files have no len()")
+        self.build_index()
+        return self.mapped_reader.size()
+
+    cdef GenEvent read_event_at(self, size_t ievent):
+        cdef int status
+        cdef shared_ptr[HepMC.GenEvent] event = new_event(self.events)
+        with nogil:
+            status = self.mapped_reader.read_event_at(ievent, deref(event))
+        if status != numpythia.ASCII_OK:
+            raise IOError("unable to parse HepMC event {0} in {1}".format(ievent, self.filename))
+        return GenEvent.wrap(event)
+
+    def __getitem__(self, object key):
+        cdef long long ievent
+        cdef long long nevents = len(self)
+        if isinstance(key, slice):
+            return [self.read_event_at(i) for i in range(*key.indices(nevents))]
+        ievent = key
+        if ievent < 0:
+            ievent += nevents
+        if ievent < 0 or ievent >= nevents:
+            raise IndexError("event index out of range")
+        return self.read_event_at(ievent)
+
+    def shard(self, int index, int count):
+        """
+        Iterate over shard ``index`` of ``count`` contiguous blocks of events
+        of about equal size, for example to split a file across workers.
+        """
+        if count < 1 or index < 0 or index >= count:
+            raise ValueError("shard index must be in [0, count)")
+        cdef long long nevents = len(self)
+        cdef long long first = nevents * index // count
+        cdef long long last = nevents * (index + 1) // count
+        for ievent in range(first, last):
+            yield self.read_event_at(ievent)
 
     def estimate_num_events(self, int sample_size=1000):
         """
@@ -547,7 +1276,8 @@ cdef class ReaderAscii:
         Instead we can estimate the number of events by averaging the event
         sizes for the first N events and then dividing the total file size by
         that. This estimate may be used to report a progress bar as the reader
-        loops over events.
+        loops over events. ``len(reader)`` gives the exact number from an
+        index of the event boundaries, which is cheap once the index exists.
         """
         cdef np.ndarray sizes = np.empty(sample_size, dtype=np.int32)
         cdef int num_found = 0
@@ -565,3 +1295,559 @@ cdef class ReaderAscii:
             else:
                 return num_found
         return long(filesize / np.average(sizes))
+
+
+cdef class ParallelReaderAscii:
+    """
+    Memory mapped reader of HepMC3 ASCII files parsing events on
+    ``n_threads`` threads (all cores by default). The event boundaries are
+    indexed when the file is opened, so ``len`` is the exact number of
+    events. The index is shared with ``ReaderAscii`` through the same
+    ``index`` sidecar file. Events are read in batches of ``batch_size`` and
+    returned in file order.
+    """
+    cdef string filename
+    cdef numpythia.ParallelReaderAscii* reader
+    cdef readonly int n_threads
+    cdef readonly int batch_size
+
+    def __cinit__(self, string filename, object n_threads=None, int batch_size=100, object index=True):
+        cdef int status
+        cdef string index_path
+        if numpythia.detect_compression(filename) != numpythia.COMPRESSION_NONE:
+            raise ValueError("{0} is compressed and can only be read sequentially by ReaderAscii".format(
+                filename))
+        if n_threads is None:
+            n_threads = multiprocessing.cpu_count()
+        if n_threads < 1:
+            raise ValueError("n_threads must be at least 1")
+        if batch_size < 1:
+            raise ValueError("batch_size must be at least 1")
+        self.filename = filename
+        self.n_threads = n_threads
+        self.batch_size = batch_size
+        if index is True:
+            index_path = filename + '.idx'
+        elif index:
+            index_path = index
+        self.reader = new numpythia.ParallelReaderAscii()
+        with nogil:
+            status = self.reader.open(filename, self.n_threads, index_path)
+        if status == numpythia.ASCII_SYSTEM_ERROR:
+            raise IOError("unable to open {0}".format(filename))
+        elif status != numpythia.ASCII_OK:
+            raise IOError("unable to parse the header of {0}".format(filename))
+
+    def __dealloc__(self):
+        del self.reader
+
+    def __len__(self):
+        return self.reader.size()
+
+    cdef inline void check_status(self, int status, size_t failed) except *:
+        if status != numpythia.ASCII_OK:
+            raise IOError("unable to parse HepMC event {0} in {1}".format(failed, self.filename))
+
+    def __iter__(self):
+        cdef size_t first, last
+        cdef size_t failed = 0
+        cdef int status
+        cdef vector[shared_ptr[HepMC.GenEvent]] events
+        cdef vector[HepMC.GenEvent*] pointers
+        for first in range(0, self.reader.size(), self.batch_size):
+            last = min(first + self.batch_size, self.reader.size())
+            events.clear()
+            pointers.clear()
+            for _ in range(last - first):
+                events.push_back(shared_ptr[HepMC.GenEvent](new HepMC.GenEvent()))
+                pointers.push_back(events.back().get())
+            with nogil:
+                status = self.reader.read_events(first, last, pointers, failed)
+            self.check_status(status, failed)
+            for ievent in range(events.size()):
+                yield GenEvent.wrap(events[ievent])
+
+    def arrays(self, object selection=None):
+        """
+        Particle arrays of all events in batches as ``(particles, offsets)``
+        like ``Pythia.generate_batch``. Events are parsed straight into
+        arrays, selected and converted on the reader threads.
+        """
+        cdef const numpythia.SelectionProgram* program = to_selection(selection)
+        cdef size_t first, last
+        cdef size_t failed = 0
+        cdef int status
+        cdef vector[char] buffer
+        cdef vector[long long] offsets
+        cdef unsigned int itemsize = DTYPE_PARTICLE.itemsize
+        cdef np.ndarray particle_array
+        cdef np.ndarray offset_array
+        for first in range(0, self.reader.size(), self.batch_size):
+            last = min(first + self.batch_size, self.reader.size())
+            with nogil:
+                status = numpythia.hepmc_read_batch(deref(self.reader), first, last, deref(program),
+                                                    itemsize, buffer, offsets, failed)
+            self.check_status(status, failed)
+            particle_array = np.empty((offsets.back(),), dtype=DTYPE_PARTICLE)
+            offset_array = np.empty((offsets.size(),), dtype=np.int64)
+            if offsets.back() > 0:
+                memcpy(particle_array.data, buffer.data(), offsets.back() * itemsize)
+            memcpy(offset_array.data, offsets.data(), offsets.size() * sizeof(long long))
+            yield particle_array, offset_array
+
+
+cdef class WriterBinary:
+    """
+    Writer of events in the numpythia binary format. The flattened
+    ``GenEventData`` of blocks of ``block_size`` events is stored as column
+    arrays with an index of the blocks at the end of the file, so that
+    ``ReaderBinary`` rebuilds events without any text parsing and reads
+    columns with a plain copy.
+    """
+    cdef string filename
+    cdef numpythia.WriterBinary* writer
+
+    def __cinit__(self, string filename, int block_size=1000):
+        if block_size < 1:
+            raise ValueError("block_size must be at least 1")
+        self.filename = filename
+        self.writer = new numpythia.WriterBinary()
+        if self.writer.open(filename, block_size) != numpythia.BINARY_OK:
+            del self.writer
+            self.writer = NULL
+            raise IOError("unable to open {0}".format(filename))
+
+    def __dealloc__(self):
+        del self.writer
+
+    cdef inline void check_status(self, int status) except *:
+        if status != numpythia.BINARY_OK:
+            raise IOError("unable to write to {0}".format(self.filename))
+
+    def write(self, GenEvent event):
+        cdef shared_ptr[HepMC.GenEvent] hepmc_event = event.get_event()
+        cdef int status
+        if self.writer == NULL:
+            raise ValueError("write to a closed WriterBinary")
+        with nogil:
+            status = self.writer.write_event(deref(hepmc_event))
+        self.check_status(status)
+
+    def close(self):
+        cdef int status = numpythia.BINARY_OK
+        if self.writer != NULL:
+            with nogil:
+                status = self.writer.close()
+            del self.writer
+            self.writer = NULL
+        self.check_status(status)
+
+
+cdef np.ndarray copy_column(const void* data, object shape, object dtype):
+    cdef np.ndarray column = np.empty(shape, dtype=dtype)
+    if column.nbytes > 0:
+        memcpy(column.data, data, column.nbytes)
+    return column
+
+
+cdef class ReaderBinary:
+    """
+    Memory mapped reader of files written by ``WriterBinary``. ``len`` is
+    the number of events, which can be read by index or iterated over.
+    ``block(i)`` returns the columns of block ``i`` as NumPy arrays.
+    """
+    cdef string filename
+    cdef numpythia.ReaderBinary* reader
+
+    def __cinit__(self, string filename):
+        cdef int status
+        self.filename = filename
+        self.reader = new numpythia.ReaderBinary()
+        with nogil:
+            status = self.reader.open(filename)
+        if status == numpythia.BINARY_SYSTEM_ERROR:
+            raise IOError("unable to open {0}".format(filename))
+        elif status != numpythia.BINARY_OK:
+            raise IOError("{0} is not a valid binary event file".format(filename))
+
+    def __dealloc__(self):
+        del self.reader
+
+    def __len__(self):
+        return self.reader.size()
+
+    @property
+    def num_blocks(self):
+        return self.reader.num_blocks()
+
+    cdef GenEvent read_event(self, size_t ievent):
+        cdef int status
+        cdef shared_ptr[HepMC.GenEvent] event = shared_ptr[HepMC.GenEvent](new HepMC.GenEvent())
+        with nogil:
+            status = self.reader.read_event(ievent, deref(event))
+        if status != numpythia.BINARY_OK:
+            raise IOError("unable to read event {0} from {1}".format(ievent, self.filename))
+        return GenEvent.wrap(event)
+
+    def __getitem__(self, object key):
+        cdef long long ievent
+        cdef long long nevents = self.reader.size()
+        if isinstance(key, slice):
+            return [self.read_event(i) for i in range(*key.indices(nevents))]
+        ievent = key
+        if ievent < 0:
+            ievent += nevents
+        if ievent < 0 or ievent >= nevents:
+            raise IndexError("event index out of range")
+        return self.read_event(ievent)
+
+    def __iter__(self):
+        for ievent in range(self.reader.size()):
+            yield self.read_event(ievent)
+
+    def block(self, int iblock):
+        """
+        Columns of a block as a dict of arrays. Particle, vertex, link,
+        weight and attribute columns are concatenated over the events of the
+        block and split by the ``*_offsets`` columns. ``momentum`` holds px,
+        py, pz and E, and ``event_pos`` and ``position`` hold x, y, z and t.
+        The attributes of an event are its rows of ``attribute_id`` (0 for
+        the event, else the id of a particle or vertex), and the uint8
+        characters of their names and values in ``attribute_names`` and
+        ``attribute_strings``, split by ``attribute_name_offsets`` and
+        ``attribute_string_offsets``. ``first_event`` is the index of the
+        first event of the block.
+        """
+        if iblock < 0:
+            iblock += self.reader.num_blocks()
+        if iblock < 0 or iblock >= <int> self.reader.num_blocks():
+            raise IndexError("block index out of range")
+        cdef const numpythia.BinaryBlock* block = &self.reader.block(iblock)
+        cdef size_t nevents = block.header.nevents
+        cdef size_t nparticles = block.header.nparticles
+        cdef size_t nvertices = block.header.nvertices
+        cdef size_t nlinks = block.header.nlinks
+        cdef size_t nattributes = block.header.nattributes
+        return {
+            'first_event': self.reader.first_event(iblock),
+            'event_number': copy_column(block.event_number, nevents, np.int32),
+            'momentum_unit': copy_column(block.momentum_unit, nevents, np.int32),
+            'length_unit': copy_column(block.length_unit, nevents, np.int32),
+            'event_pos': copy_column(block.event_pos, (nevents, 4), np.float64),
+            'particle_offsets': copy_column(block.particle_offsets, nevents + 1, np.int64),
+            'vertex_offsets': copy_column(block.vertex_offsets, nevents + 1, np.int64),
+            'link_offsets': copy_column(block.link_offsets, nevents + 1, np.int64),
+            'weight_offsets': copy_column(block.weight_offsets, nevents + 1, np.int64),
+            'attribute_offsets': copy_column(block.attribute_offsets, nevents + 1, np.int64),
+            'pid': copy_column(block.pid, nparticles, np.int32),
+            'status': copy_column(block.status, nparticles, np.int32),
+            'is_mass_set': copy_column(block.is_mass_set, nparticles, np.bool_),
+            'mass': copy_column(block.mass, nparticles, np.float64),
+            'momentum': copy_column(block.momentum, (nparticles, 4), np.float64),
+            'vertex_status': copy_column(block.vertex_status, nvertices, np.int32),
+            'position': copy_column(block.position, (nvertices, 4), np.float64),
+            'links1': copy_column(block.links1, nlinks, np.int32),
+            'links2': copy_column(block.links2, nlinks, np.int32),
+            'weights': copy_column(block.weights, block.header.nweights, np.float64),
+            'attribute_id': copy_column(block.attribute_id, nattributes, np.int32),
+            'attribute_name_offsets': copy_column(block.attribute_name_offsets, nattributes + 1,
+                                                  np.int64),
+            'attribute_names': copy_column(block.attribute_names,
+                                           block.header.attribute_name_bytes, np.uint8),
+            'attribute_string_offsets': copy_column(block.attribute_string_offsets,
+                                                    nattributes + 1, np.int64),
+            'attribute_strings': copy_column(block.attribute_strings,
+                                             block.header.attribute_string_bytes, np.uint8),
+        }
+
+
+def hdf5_supported():
+    """
+    Whether numpythia was built with HDF5 support for ``WriterHDF5``.
+    """
+    return numpythia.hdf5_supported()
+
+
+cdef void check_hdf5_layout() except *:
+    # the C++ writer copies DTYPE_PARTICLE rows as raw bytes
+    cdef unsigned int i
+    if (len(DTYPE_PARTICLE.names) != numpythia.HDF5_PARTICLE_NFIELDS or
+            DTYPE_PARTICLE.itemsize != numpythia.HDF5_PARTICLE_ROWBYTES):
+        raise RuntimeError("DTYPE_PARTICLE does not match the HDF5 row layout")
+    for i in range(numpythia.HDF5_PARTICLE_NFIELDS):
+        name = DTYPE_PARTICLE.names[i]
+        dtype, offset = DTYPE_PARTICLE.fields[name][:2]
+        if (name != numpythia.HDF5_PARTICLE_FIELDS[i] or
+                offset != numpythia.hdf5_particle_offset(i) or
+                dtype != (DTYPE if i < numpythia.HDF5_PARTICLE_DOUBLES else np.int32)):
+            raise RuntimeError("DTYPE_PARTICLE field {0} does not match the HDF5 row layout".format(name))
+
+
+cdef class WriterHDF5:
+    """
+    Writer of particle arrays to an HDF5 file with the datasets
+    ``particles`` (``DTYPE_PARTICLE`` rows of all events), ``offsets``
+    (event i is ``particles[offsets[i]:offsets[i + 1]]``) and ``weights``
+    (one row of weights per event). Events are buffered and appended to the
+    chunked datasets ``chunk_size`` particles at a time, compressed with
+    deflate at ``compression_level`` (0 disables it), and each dataset uses
+    a chunk cache of ``cache_size`` bytes. All events must have the same
+    number of weights.
+    """
+    cdef string filename
+    cdef numpythia.WriterHDF5* writer
+    cdef object selection
+
+    def __cinit__(self, string filename, object selection=None, int chunk_size=8192,
+                  int compression_level=1, size_t cache_size=1 << 24):
+        if not numpythia.hdf5_supported():
+            raise ValueError("numpythia was built without HDF5 support")
+        if chunk_size < 1:
+            raise ValueError("chunk_size must be at least 1")
+        if compression_level < 0 or compression_level > 9:
+            raise ValueError("compression_level must be between 0 and 9")
+        check_hdf5_layout()
+        to_selection(selection)
+        self.filename = filename
+        self.selection = selection
+        self.writer = new numpythia.WriterHDF5()
+        if self.writer.open(filename, chunk_size, compression_level, cache_size) != numpythia.HDF5_OK:
+            del self.writer
+            self.writer = NULL
+            raise IOError("unable to open {0}".format(filename))
+
+    def __dealloc__(self):
+        del self.writer
+
+    cdef inline void check_status(self, int status) except *:
+        if status == numpythia.HDF5_SHAPE_ERROR:
+            raise ValueError("all events written to {0} must have the same number of weights".format(
+                self.filename))
+        if status != numpythia.HDF5_OK:
+            raise IOError("unable to write to {0}".format(self.filename))
+
+    def __len__(self):
+        return self.writer.size() if self.writer != NULL else 0
+
+    def write(self, object event):
+        """
+        Append the selected particles and the weights of a ``GenEvent`` or
+        ``PythiaEvent``
+        """
+        if self.writer == NULL:
+            raise ValueError("write to a closed WriterHDF5")
+        cdef np.ndarray particles
+        if isinstance(event, PythiaEvent):
+            particles = (<PythiaEvent> event).array(self.selection)
+        else:
+            particles = (<GenEvent?> event).all(self.selection)
+        cdef np.ndarray weights = np.ascontiguousarray(event.weights, dtype=np.float64)
+        cdef int status
+        with nogil:
+            status = self.writer.write_event(particles.data, particles.shape[0],
+                                             <double*> weights.data, weights.shape[0])
+        self.check_status(status)
+
+    def write_batch(self, np.ndarray particles, object offsets, object weights=None):
+        """
+        Append the events of ``Pythia.generate_batch``. ``weights`` is an
+        array of one row of weights per event, or None for no weights.
+        """
+        if self.writer == NULL:
+            raise ValueError("write to a closed WriterHDF5")
+        if particles.dtype != DTYPE_PARTICLE:
+            raise ValueError("particles must be an array of DTYPE_PARTICLE")
+        particles = np.ascontiguousarray(particles)
+        cdef np.ndarray offset_array = np.ascontiguousarray(offsets, dtype=np.int64)
+        cdef size_t nevents = offset_array.shape[0] - 1
+        if offset_array.shape[0] < 1 or offset_array[0] < 0 or offset_array[-1] > particles.shape[0] or \
+                np.any(np.diff(offset_array) < 0):
+            raise ValueError("offsets must be increasing indices into particles")
+        cdef np.ndarray weight_array
+        if weights is None:
+            weight_array = np.empty((nevents, 0), dtype=np.float64)
+        else:
+            weight_array = np.ascontiguousarray(weights, dtype=np.float64)
+            if weight_array.ndim == 1:
+                weight_array = weight_array.reshape((nevents, 1))
+        if weight_array.ndim != 2 or <size_t> weight_array.shape[0] != nevents:
+            raise ValueError("weights must have one row per event")
+        cdef int status
+        with nogil:
+            status = self.writer.write_batch(particles.data, <long long*> offset_array.data, nevents,
+                                             <double*> weight_array.data, weight_array.shape[1])
+        self.check_status(status)
+
+    def flush(self):
+        """
+        Append the buffered events to the datasets and flush the file to
+        disk. Otherwise events are appended a chunk at a time and the file
+        is only flushed by ``close``.
+        """
+        if self.writer == NULL:
+            raise ValueError("flush of a closed WriterHDF5")
+        cdef int status
+        with nogil:
+            status = self.writer.flush()
+        self.check_status(status)
+
+    def close(self):
+        cdef int status = numpythia.HDF5_OK
+        if self.writer != NULL:
+            with nogil:
+                status = self.writer.close()
+            del self.writer
+            self.writer = NULL
+        self.check_status(status)
+
+
+cdef inline double monotonic_seconds() nogil:
+    # timeouts are measured on a clock, since usleep may sleep longer
+    cdef timespec now
+    clock_gettime(CLOCK_MONOTONIC, &now)
+    return now.tv_sec + now.tv_nsec * 1e-9
+
+
+cdef class SharedRingBuffer:
+    """
+    Lock-free single-producer/single-consumer ring buffer in POSIX shared
+    memory carrying particle batches as produced by ``generate_batch``.
+    One process creates the buffer and another attaches to it by ``name``.
+
+    ``get`` returns zero-copy views into the shared memory that remain valid
+    only until the next ``get`` or ``release``; copy them to keep the data.
+    """
+    BATCH = numpythia.RING_BATCH
+    DONE = numpythia.RING_DONE
+    ERROR = numpythia.RING_ERROR
+
+    cdef numpythia.SharedRing ring
+    cdef readonly str name
+    cdef bool owner
+    cdef bool holding
+
+    def __cinit__(self, str name=None, size_t capacity=1 << 26, bool create=True):
+        cdef int status
+        if name is None:
+            name = '/numpythia-{0}-{1}'.format(os.getpid(), uuid.uuid4().hex[:16])
+        self.name = name
+        self.holding = False
+        if create:
+            status = self.ring.create(name, capacity)
+        else:
+            status = self.ring.open(name)
+        if status != numpythia.RING_OK:
+            raise OSError("could not {0} shared memory ring buffer {1}".format(
+                'create' if create else 'open', name))
+        self.owner = create
+
+    def __dealloc__(self):
+        self.ring.close()
+        if self.owner:
+            numpythia.shared_ring_unlink(self.name)
+
+    @property
+    def capacity(self):
+        return self.ring.capacity()
+
+    def unlink(self):
+        """
+        Remove the name of a buffer created by this object. Attached processes
+        and existing views keep the memory alive.
+        """
+        if self.owner:
+            numpythia.shared_ring_unlink(self.name)
+            self.owner = False
+
+    cdef char* reserve(self, size_t size, unsigned int kind, object timeout) except NULL:
+        cdef char* payload = NULL
+        cdef int status
+        cdef double limit = -1 if timeout is None else timeout
+        cdef double start
+        cdef unsigned int delay = 1
+        with nogil:
+            start = monotonic_seconds()
+            status = self.ring.reserve(size, kind, payload)
+            while status == numpythia.RING_FULL and (limit < 0 or monotonic_seconds() - start < limit):
+                # back off exponentially up to 1ms while the consumer catches up
+                usleep(delay)
+                delay = min(2 * delay, 1000)
+                status = self.ring.reserve(size, kind, payload)
+        if status == numpythia.RING_TOO_LARGE:
+            raise ValueError("message of {0} bytes does not fit into the ring buffer "
+                             "of {1} bytes".format(size, self.ring.capacity()))
+        if status == numpythia.RING_FULL:
+            raise RuntimeError("timed out waiting for space in the ring buffer")
+        return payload
+
+    def put_batch(self, np.ndarray particles, np.ndarray offsets, timeout=None):
+        """
+        Copy a batch of particles and its int64 offsets into the buffer,
+        waiting up to ``timeout`` seconds (forever if None) for space.
+        """
+        if particles.dtype != DTYPE_PARTICLE or offsets.dtype != np.int64:
+            raise TypeError("expected particles of DTYPE_PARTICLE and int64 offsets")
+        particles = np.ascontiguousarray(particles)
+        offsets = np.ascontiguousarray(offsets)
+        cdef size_t noffsets = offsets.shape[0]
+        cdef size_t offset_bytes = (sizeof(long long) * (1 + noffsets) + 15) // 16 * 16
+        cdef size_t particle_bytes = particles.shape[0] * particles.itemsize
+        cdef char* payload = self.reserve(offset_bytes + particle_bytes,
+                                          numpythia.RING_BATCH, timeout)
+        (<long long*> payload)[0] = noffsets
+        memcpy(payload + sizeof(long long), offsets.data, noffsets * sizeof(long long))
+        memcpy(payload + offset_bytes, particles.data, particle_bytes)
+        self.ring.commit()
+
+    def put_message(self, unsigned int kind, bytes message=b'', timeout=None):
+        """
+        Send a ``DONE`` or ``ERROR`` message with optional text.
+        """
+        cdef char* payload = self.reserve(len(message), kind, timeout)
+        memcpy(payload, <char*> message, len(message))
+        self.ring.commit()
+
+    def release(self):
+        """
+        Drop the message returned by the last ``get``.
+        """
+        if self.holding:
+            self.ring.release()
+            self.holding = False
+
+    def get(self, timeout=None):
+        """
+        Wait up to ``timeout`` seconds (forever if None) for the next message.
+        Returns ``(BATCH, particles, offsets)``, ``(kind, message, None)`` with
+        the bytes of other messages, or None on timeout.
+        """
+        cdef char* payload = NULL
+        cdef size_t size = 0
+        cdef unsigned int kind = 0
+        cdef int status
+        cdef double limit = -1 if timeout is None else timeout
+        cdef double start
+        cdef unsigned int delay = 1
+        self.release()
+        with nogil:
+            start = monotonic_seconds()
+            status = self.ring.peek(kind, payload, size)
+            while status == numpythia.RING_EMPTY and (limit < 0 or monotonic_seconds() - start < limit):
+                usleep(delay)
+                delay = min(2 * delay, 1000)
+                status = self.ring.peek(kind, payload, size)
+        if status != numpythia.RING_OK:
+            return None
+        self.holding = True
+        if kind != numpythia.RING_BATCH:
+            return kind, PyBytes_FromStringAndSize(payload, size), None
+        cdef np.npy_intp nbytes = size
+        cdef np.ndarray message = np.PyArray_SimpleNewFromData(1, &nbytes, np.NPY_UINT8, payload)
+        # views keep the mapping alive
+        Py_INCREF(self)
+        np.PyArray_SetBaseObject(message, self)
+        cdef size_t noffsets = (<long long*> payload)[0]
+        cdef size_t offset_bytes = (sizeof(long long) * (1 + noffsets) + 15) // 16 * 16
+        offsets = message[sizeof(long long):sizeof(long long) * (1 + noffsets)].view(np.int64)
+        particles = message[offset_bytes:].view(DTYPE_PARTICLE)
+        return kind, particles, offsets
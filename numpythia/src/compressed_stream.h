@@ -0,0 +1,572 @@
+#ifndef NUMPYTHIA_COMPRESSED_STREAM_H
+#define NUMPYTHIA_COMPRESSED_STREAM_H
+
+#include <streambuf>
+#include <istream>
+#include <ostream>
+#include <fstream>
+#include <string>
+#include <vector>
+#include <deque>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <cstdio>
+#include <cstring>
+
+#ifdef NUMPYTHIA_ZLIB
+#include <zlib.h>
+#endif
+#ifdef NUMPYTHIA_ZSTD
+#include <zstd.h>
+#endif
+
+
+// Status codes of the compressed file streams
+enum StreamStatus {
+    STREAM_OK = 0,
+    STREAM_SYSTEM_ERROR,
+    STREAM_UNSUPPORTED
+};
+
+
+enum Compression {
+    COMPRESSION_NONE = 0,
+    COMPRESSION_GZIP,
+    COMPRESSION_ZSTD
+};
+
+
+// Whether support for a compression was compiled in
+inline bool compression_supported(int compression) {
+    switch (compression) {
+        case COMPRESSION_NONE: return true;
+#ifdef NUMPYTHIA_ZLIB
+        case COMPRESSION_GZIP: return true;
+#endif
+#ifdef NUMPYTHIA_ZSTD
+        case COMPRESSION_ZSTD: return true;
+#endif
+        default: return false;
+    }
+}
+
+
+// Range of the explicit compression levels of a compression
+inline int min_compression_level(int compression) {
+    return compression == COMPRESSION_ZSTD ? 1 : 0;
+}
+
+
+inline int max_compression_level(int compression) {
+    switch (compression) {
+#ifdef NUMPYTHIA_ZLIB
+        case COMPRESSION_GZIP: return Z_BEST_COMPRESSION;
+#endif
+#ifdef NUMPYTHIA_ZSTD
+        case COMPRESSION_ZSTD: return ZSTD_maxCLevel();
+#endif
+        default: return 0;
+    }
+}
+
+
+// Compression of a file from its magic number
+inline int detect_compression(const std::string& filename) {
+    unsigned char magic[4] = {0, 0, 0, 0};
+    FILE* file = fopen(filename.c_str(), "rb");
+    if (file == NULL) {
+        return COMPRESSION_NONE;
+    }
+    size_t size = fread(magic, 1, sizeof(magic), file);
+    fclose(file);
+    if (size >= 2 && magic[0] == 0x1f && magic[1] == 0x8b) {
+        return COMPRESSION_GZIP;
+    }
+    if (size == 4 && magic[0] == 0x28 && magic[1] == 0xb5 && magic[2] == 0x2f && magic[3] == 0xfd) {
+        return COMPRESSION_ZSTD;
+    }
+    return COMPRESSION_NONE;
+}
+
+
+// Compression implied by the file name extension (.gz, .zst or .zstd)
+inline int compression_from_extension(const std::string& filename) {
+    size_t dot = filename.rfind('.');
+    std::string extension = dot == std::string::npos ? std::string() : filename.substr(dot);
+    if (extension == ".gz") return COMPRESSION_GZIP;
+    if (extension == ".zst" || extension == ".zstd") return COMPRESSION_ZSTD;
+    return COMPRESSION_NONE;
+}
+
+
+// Compress input into a complete gzip member or zstd frame. A negative
+// level selects the default level of the compression.
+inline bool compress_block(int compression, int level, const std::vector<char>& input, std::vector<char>& output) {
+#ifdef NUMPYTHIA_ZLIB
+    if (compression == COMPRESSION_GZIP) {
+        z_stream stream;
+        memset(&stream, 0, sizeof(stream));
+        if (deflateInit2(&stream, level < 0 ? Z_DEFAULT_COMPRESSION : level, Z_DEFLATED,
+                         16 + MAX_WBITS, 8, Z_DEFAULT_STRATEGY) != Z_OK) {
+            return false;
+        }
+        output.resize(deflateBound(&stream, input.size()));
+        stream.next_in = (Bytef*) (input.empty() ? NULL : &input[0]);
+        stream.avail_in = input.size();
+        stream.next_out = (Bytef*) &output[0];
+        stream.avail_out = output.size();
+        int status = deflate(&stream, Z_FINISH);
+        output.resize(output.size() - stream.avail_out);
+        deflateEnd(&stream);
+        return status == Z_STREAM_END;
+    }
+#endif
+#ifdef NUMPYTHIA_ZSTD
+    if (compression == COMPRESSION_ZSTD) {
+        output.resize(ZSTD_compressBound(input.size()));
+        size_t size = ZSTD_compress(&output[0], output.size(), input.empty() ? NULL : &input[0], input.size(),
+                                    level < 0 ? ZSTD_CLEVEL_DEFAULT : level);
+        if (ZSTD_isError(size)) {
+            return false;
+        }
+        output.resize(size);
+        return true;
+    }
+#endif
+    return false;
+}
+
+
+// Output stream buffer compressing blocks of BLOCK_SIZE bytes into
+// independent gzip members or zstd frames, which concatenated are still a
+// valid gzip or zstd file. With several threads up to n_threads blocks are
+// compressed at the same time by n_threads workers that live as long as the
+// file is open, and written in order.
+class CompressingOutputBuffer : public std::streambuf {
+  public:
+    static const size_t BLOCK_SIZE = 1 << 20;
+
+    CompressingOutputBuffer(): file(NULL), compression(COMPRESSION_NONE), level(-1), n_threads(1), failed(false),
+                               stopping(false) {}
+
+    ~CompressingOutputBuffer() {
+        close();
+    }
+
+    int open(const std::string& filename, int compression_, int level_, int n_threads_) {
+        if (!compression_supported(compression_) || compression_ == COMPRESSION_NONE) {
+            return STREAM_UNSUPPORTED;
+        }
+        file = fopen(filename.c_str(), "wb");
+        if (file == NULL) {
+            return STREAM_SYSTEM_ERROR;
+        }
+        compression = compression_;
+        level = level_;
+        n_threads = n_threads_ < 1 ? 1 : n_threads_;
+        failed = false;
+        block.resize(BLOCK_SIZE);
+        setp(&block[0], &block[0] + block.size());
+        if (n_threads > 1) {
+            stopping = false;
+            for (int i = 0; i < n_threads; ++i) {
+                workers.push_back(std::thread(&CompressingOutputBuffer::work, this));
+            }
+        }
+        return STREAM_OK;
+    }
+
+    // Compress and write all data so far
+    int flush() {
+        if (file == NULL) return failed ? STREAM_SYSTEM_ERROR : STREAM_OK;
+        submit_block();
+        while (!jobs.empty()) {
+            finish_job();
+        }
+        if (fflush(file) != 0) {
+            failed = true;
+        }
+        return failed ? STREAM_SYSTEM_ERROR : STREAM_OK;
+    }
+
+    int close() {
+        if (file == NULL) return failed ? STREAM_SYSTEM_ERROR : STREAM_OK;
+        flush();
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            stopping = true;
+        }
+        queue_ready.notify_all();
+        for (size_t i = 0; i < workers.size(); ++i) {
+            workers[i].join();
+        }
+        workers.clear();
+        if (fclose(file) != 0) {
+            failed = true;
+        }
+        file = NULL;
+        setp(NULL, NULL);
+        return failed ? STREAM_SYSTEM_ERROR : STREAM_OK;
+    }
+
+  protected:
+    virtual int overflow(int c) {
+        if (file == NULL || !submit_block()) {
+            return traits_type::eof();
+        }
+        if (!traits_type::eq_int_type(c, traits_type::eof())) {
+            *pptr() = traits_type::to_char_type(c);
+            pbump(1);
+        }
+        return traits_type::not_eof(c);
+    }
+
+    // A flush of the stream (as by std::endl) does not end the current
+    // block, which would only make the compression worse
+    virtual int sync() {
+        return failed ? -1 : 0;
+    }
+
+  private:
+    struct Job {
+        std::vector<char> input;
+        std::vector<char> output;
+        bool compressed;
+        bool done;
+
+        Job(): compressed(false), done(false) {}
+    };
+
+    // Compress queued jobs until the file is closed
+    void work() {
+        std::unique_lock<std::mutex> lock(mutex);
+        while (true) {
+            while (!stopping && queue.empty()) {
+                queue_ready.wait(lock);
+            }
+            if (queue.empty()) return;
+            Job* job = queue.front();
+            queue.pop_front();
+            lock.unlock();
+            bool compressed = compress_block(compression, level, job->input, job->output);
+            lock.lock();
+            job->compressed = compressed;
+            job->done = true;
+            job_done.notify_all();
+        }
+    }
+
+    // Hand the filled part of the block over to compression
+    bool submit_block() {
+        size_t size = pptr() - pbase();
+        if (size > 0) {
+            jobs.push_back(Job());
+            Job& job = jobs.back();
+            job.input.swap(block);
+            job.input.resize(size);
+            if (workers.empty()) {
+                job.compressed = compress_block(compression, level, job.input, job.output);
+                job.done = true;
+            } else {
+                std::lock_guard<std::mutex> lock(mutex);
+                queue.push_back(&job);
+                queue_ready.notify_one();
+            }
+            while (jobs.size() >= (size_t) n_threads) {
+                finish_job();
+            }
+            block.resize(BLOCK_SIZE);
+            setp(&block[0], &block[0] + block.size());
+        }
+        return !failed;
+    }
+
+    // Wait for the oldest block and write it
+    void finish_job() {
+        Job& job = jobs.front();
+        if (!workers.empty()) {
+            std::unique_lock<std::mutex> lock(mutex);
+            while (!job.done) {
+                job_done.wait(lock);
+            }
+        }
+        if (!job.compressed || fwrite(&job.output[0], 1, job.output.size(), file) != job.output.size()) {
+            failed = true;
+        }
+        jobs.pop_front();
+    }
+
+    FILE* file;
+    int compression;
+    int level;
+    int n_threads;
+    bool failed;
+    std::vector<char> block;
+    // references to deque elements stay valid while jobs are added and removed
+    std::deque<Job> jobs;
+    // workers and the jobs they have not started yet
+    std::vector<std::thread> workers;
+    std::mutex mutex;
+    std::condition_variable queue_ready;
+    std::condition_variable job_done;
+    std::deque<Job*> queue;
+    bool stopping;
+};
+
+
+// Input stream buffer decompressing a gzip or zstd file, including files of
+// several concatenated members or frames
+class DecompressingInputBuffer : public std::streambuf {
+  public:
+    static const size_t BUFFER_SIZE = 1 << 18;
+
+    DecompressingInputBuffer(): file(NULL), compression(COMPRESSION_NONE), in_member(false), failed(false) {
+#ifdef NUMPYTHIA_ZLIB
+        memset(&zstream, 0, sizeof(zstream));
+#endif
+#ifdef NUMPYTHIA_ZSTD
+        dstream = NULL;
+#endif
+    }
+
+    ~DecompressingInputBuffer() {
+        close();
+    }
+
+    int open(const std::string& filename, int compression_) {
+        if (!compression_supported(compression_) || compression_ == COMPRESSION_NONE) {
+            return STREAM_UNSUPPORTED;
+        }
+        file = fopen(filename.c_str(), "rb");
+        if (file == NULL) {
+            return STREAM_SYSTEM_ERROR;
+        }
+        compression = compression_;
+        in_member = false;
+        failed = false;
+        input.resize(BUFFER_SIZE);
+        output.resize(BUFFER_SIZE);
+        setg(&output[0], &output[0], &output[0]);
+#ifdef NUMPYTHIA_ZLIB
+        if (compression == COMPRESSION_GZIP && inflateInit2(&zstream, 16 + MAX_WBITS) != Z_OK) {
+            close();
+            return STREAM_SYSTEM_ERROR;
+        }
+#endif
+#ifdef NUMPYTHIA_ZSTD
+        if (compression == COMPRESSION_ZSTD) {
+            dstream = ZSTD_createDStream();
+            zinput.src = &input[0];
+            zinput.size = zinput.pos = 0;
+        }
+#endif
+        return STREAM_OK;
+    }
+
+    void close() {
+        if (file == NULL) return;
+        fclose(file);
+        file = NULL;
+#ifdef NUMPYTHIA_ZLIB
+        if (compression == COMPRESSION_GZIP) {
+            inflateEnd(&zstream);
+            memset(&zstream, 0, sizeof(zstream));
+        }
+#endif
+#ifdef NUMPYTHIA_ZSTD
+        if (compression == COMPRESSION_ZSTD) {
+            ZSTD_freeDStream(dstream);
+            dstream = NULL;
+        }
+#endif
+        setg(NULL, NULL, NULL);
+    }
+
+    // Whether the file was corrupt or ended within a member or frame
+    bool has_failed() const { return failed; }
+
+  protected:
+    virtual int underflow() {
+        if (gptr() < egptr()) {
+            return traits_type::to_int_type(*gptr());
+        }
+        size_t size = file == NULL || failed ? 0 : decompress();
+        setg(&output[0], &output[0], &output[0] + size);
+        return size == 0 ? traits_type::eof() : traits_type::to_int_type(output[0]);
+    }
+
+  private:
+    size_t read_input() {
+        return fread(&input[0], 1, input.size(), file);
+    }
+
+    // Decompress the next bytes into output, returning how many. Pending
+    // output of the decoder is collected before reading more input.
+    size_t decompress() {
+#ifdef NUMPYTHIA_ZLIB
+        if (compression == COMPRESSION_GZIP) {
+            while (true) {
+                zstream.next_out = (Bytef*) &output[0];
+                zstream.avail_out = output.size();
+                uInt available = zstream.avail_in;
+                int status = inflate(&zstream, Z_NO_FLUSH);
+                if (status == Z_STREAM_END) {
+                    // the next member, if any, starts after this one
+                    in_member = false;
+                    inflateReset(&zstream);
+                } else if (status == Z_OK) {
+                    in_member = in_member || zstream.avail_in != available;
+                } else if (status != Z_BUF_ERROR) {
+                    failed = true;
+                    return 0;
+                }
+                size_t size = output.size() - zstream.avail_out;
+                if (size > 0) return size;
+                if (zstream.avail_in == 0) {
+                    size_t read = read_input();
+                    if (read == 0) {
+                        failed = in_member;
+                        return 0;
+                    }
+                    zstream.next_in = (Bytef*) &input[0];
+                    zstream.avail_in = read;
+                }
+            }
+        }
+#endif
+#ifdef NUMPYTHIA_ZSTD
+        if (compression == COMPRESSION_ZSTD) {
+            ZSTD_outBuffer zoutput = {&output[0], output.size(), 0};
+            while (true) {
+                size_t position = zinput.pos;
+                size_t status = ZSTD_decompressStream(dstream, &zoutput, &zinput);
+                if (ZSTD_isError(status)) {
+                    failed = true;
+                    return 0;
+                }
+                if (zinput.pos != position || zoutput.pos > 0) {
+                    // 0 once a frame is complete
+                    in_member = status != 0;
+                }
+                if (zoutput.pos > 0) return zoutput.pos;
+                if (zinput.pos == zinput.size) {
+                    size_t read = read_input();
+                    if (read == 0) {
+                        failed = in_member;
+                        return 0;
+                    }
+                    zinput.size = read;
+                    zinput.pos = 0;
+                }
+            }
+        }
+#endif
+        return 0;
+    }
+
+    FILE* file;
+    int compression;
+    bool in_member;
+    bool failed;
+    std::vector<char> input;
+    std::vector<char> output;
+#ifdef NUMPYTHIA_ZLIB
+    z_stream zstream;
+#endif
+#ifdef NUMPYTHIA_ZSTD
+    ZSTD_DStream* dstream;
+    ZSTD_inBuffer zinput;
+#endif
+};
+
+
+// Output file that is either plain or compressed
+class OutputFile {
+  public:
+    OutputFile(): compressed_stream(&compressed), stream_(NULL) {}
+
+    ~OutputFile() {
+        close();
+    }
+
+    int open(const std::string& filename, int compression, int level, int n_threads) {
+        if (compression == COMPRESSION_NONE) {
+            plain.open(filename.c_str());
+            if (!plain.is_open()) return STREAM_SYSTEM_ERROR;
+            stream_ = &plain;
+            return STREAM_OK;
+        }
+        int status = compressed.open(filename, compression, level, n_threads);
+        if (status == STREAM_OK) {
+            stream_ = &compressed_stream;
+        }
+        return status;
+    }
+
+    std::ostream& stream() { return *stream_; }
+
+    // Write everything so far to the file
+    int flush() {
+        if (stream_ == NULL) return STREAM_OK;
+        stream_->flush();
+        if (stream_ == &compressed_stream && compressed.flush() != STREAM_OK) {
+            compressed_stream.setstate(std::ios::badbit);
+        }
+        return stream_->fail() ? STREAM_SYSTEM_ERROR : STREAM_OK;
+    }
+
+    int close() {
+        if (stream_ == NULL) return STREAM_OK;
+        bool failed = stream_->fail();
+        if (stream_ == &plain) {
+            // HepMC::WriterAscii::close() already closes std::ofstream
+            if (plain.is_open()) plain.close();
+            failed = failed || plain.fail();
+        } else {
+            failed = compressed.close() != STREAM_OK || failed;
+        }
+        stream_ = NULL;
+        return failed ? STREAM_SYSTEM_ERROR : STREAM_OK;
+    }
+
+  private:
+    std::ofstream plain;
+    CompressingOutputBuffer compressed;
+    std::ostream compressed_stream;
+    std::ostream* stream_;
+};
+
+
+// Input file that is either plain or compressed, detected from its content
+class InputFile {
+  public:
+    InputFile(): compressed_stream(&compressed), stream_(NULL) {}
+
+    int open(const std::string& filename) {
+        int compression = detect_compression(filename);
+        if (compression == COMPRESSION_NONE) {
+            plain.open(filename.c_str());
+            if (!plain.is_open()) return STREAM_SYSTEM_ERROR;
+            stream_ = &plain;
+            return STREAM_OK;
+        }
+        int status = compressed.open(filename, compression);
+        if (status == STREAM_OK) {
+            stream_ = &compressed_stream;
+        }
+        return status;
+    }
+
+    std::istream& stream() { return *stream_; }
+
+    bool has_failed() const { return compressed.has_failed(); }
+
+  private:
+    std::ifstream plain;
+    DecompressingInputBuffer compressed;
+    std::istream compressed_stream;
+    std::istream* stream_;
+};
+
+#endif // NUMPYTHIA_COMPRESSED_STREAM_H
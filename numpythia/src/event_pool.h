@@ -0,0 +1,81 @@
+#ifndef NUMPYTHIA_EVENT_POOL_H
+#define NUMPYTHIA_EVENT_POOL_H
+
+#include <memory>
+#include <mutex>
+#include <vector>
+
+#include "HepMC/GenEvent.h"
+
+
+// Free list of GenEvents. acquire() hands out a cleared event whose deleter
+// puts it back instead of deleting it, so the particle and vertex vectors
+// keep their capacity from one event to the next. Events may be released
+// from any thread and after the pool itself is gone.
+class GenEventPool {
+  public:
+    explicit GenEventPool(size_t capacity = 16): state(new State(capacity)) {}
+
+    std::shared_ptr<HepMC::GenEvent> acquire() {
+        HepMC::GenEvent* event = NULL;
+        {
+            std::lock_guard<std::mutex> lock(state->mutex);
+            if (!state->events.empty()) {
+                event = state->events.back();
+                state->events.pop_back();
+            }
+        }
+        if (event == NULL) {
+            event = new HepMC::GenEvent(HepMC::Units::GEV, HepMC::Units::MM);
+        }
+        return std::shared_ptr<HepMC::GenEvent>(event, Recycle(state));
+    }
+
+    // Number of events on the free list
+    size_t size() const {
+        std::lock_guard<std::mutex> lock(state->mutex);
+        return state->events.size();
+    }
+
+  private:
+    struct State {
+        explicit State(size_t capacity_): capacity(capacity_) {
+            events.reserve(capacity);
+        }
+
+        ~State() {
+            for (size_t i = 0; i < events.size(); ++i) {
+                delete events[i];
+            }
+        }
+
+        std::mutex mutex;
+        size_t capacity;
+        std::vector<HepMC::GenEvent*> events;
+    };
+
+    struct Recycle {
+        explicit Recycle(const std::shared_ptr<State>& state_): state(state_) {}
+
+        void operator()(HepMC::GenEvent* event) const {
+            // same state as a new event, but with the vectors still reserved
+            event->clear();
+            event->set_units(HepMC::Units::GEV, HepMC::Units::MM);
+            event->set_run_info(std::shared_ptr<HepMC::GenRunInfo>());
+            {
+                std::lock_guard<std::mutex> lock(state->mutex);
+                if (state->events.size() < state->capacity) {
+                    state->events.push_back(event);
+                    return;
+                }
+            }
+            delete event;
+        }
+
+        std::shared_ptr<State> state;
+    };
+
+    std::shared_ptr<State> state;
+};
+
+#endif // NUMPYTHIA_EVENT_POOL_H
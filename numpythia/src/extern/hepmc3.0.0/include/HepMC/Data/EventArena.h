@@ -0,0 +1,150 @@
+// -*- C++ -*-
+//
+// This file is part of HepMC
+// Copyright (C) 2014 The HepMC collaboration (see AUTHORS for details)
+//
+#ifndef  HEPMC_DATA_EVENTARENA_H
+#define  HEPMC_DATA_EVENTARENA_H
+/**
+ *  @file EventArena.h
+ *  @brief Definition of \b class EventArena, \b class ArenaAllocator
+ *  and \b class EventArenaPool
+ *
+ *  ADDED FOR NUMPYTHIA
+ *
+ *  @class HepMC::EventArena
+ *  @brief Monotonic memory of the particles and vertices of one event
+ *
+ *  Memory is bumped out of large blocks and never freed one object at a
+ *  time. reset() makes the blocks available to the next event.
+ *
+ *  @class HepMC::ArenaAllocator
+ *  @brief Allocator for std::allocate_shared placing an object and its
+ *  control block in an EventArena
+ *
+ *  Every control block holds a copy of the allocator and thereby keeps the
+ *  arena alive as long as any particle or vertex of the event is
+ *  referenced, also after the GenEvent is gone.
+ *
+ *  @class HepMC::EventArenaPool
+ *  @brief Arenas of the events of one generator
+ *
+ *  acquire() hands out an arena that no object refers to anymore after
+ *  resetting it, or a new one if all arenas are still in use.
+ *
+ *  @ingroup data
+ *
+ */
+#include <vector>
+#include <cstddef>
+#include <cstdlib>
+#include <new>
+#include "HepMC/Data/SmartPointer.h"
+
+namespace HepMC {
+
+class EventArena {
+public:
+    /** @brief Arena allocating blocks of at least block_size bytes */
+    explicit EventArena(size_t block_size = 1 << 18):
+        m_block_size(block_size), m_block(0), m_used(0) {}
+
+    ~EventArena() {
+        for (size_t i = 0; i < m_blocks.size(); ++i) std::free(m_blocks[i].data);
+    }
+
+    /** @brief Memory for size bytes aligned to align */
+    void* allocate(size_t size, size_t align) {
+        while (m_block < m_blocks.size()) {
+            Block& block = m_blocks[m_block];
+            size_t start = (m_used + align - 1) & ~(align - 1);
+            if (start + size <= block.size) {
+                m_used = start + size;
+                return block.data + start;
+            }
+            ++m_block;
+            m_used = 0;
+        }
+        Block block;
+        block.size = size + align > m_block_size ? size + align : m_block_size;
+        block.data = static_cast<char*>(std::malloc(block.size));
+        if (!block.data) throw std::bad_alloc();
+        m_blocks.push_back(block);
+        m_block = m_blocks.size() - 1;
+        m_used = 0;
+        return allocate(size, align);
+    }
+
+    /** @brief Reuse all blocks. Only valid when nothing lives in the arena */
+    void reset() { m_block = 0; m_used = 0; }
+
+private:
+    EventArena(const EventArena&);
+    EventArena& operator=(const EventArena&);
+
+    struct Block {
+        char*  data;
+        size_t size;
+    };
+
+    size_t             m_block_size; ///< Size of new blocks
+    std::vector<Block> m_blocks;     ///< Blocks in order of use
+    size_t             m_block;      ///< Block currently bumped
+    size_t             m_used;       ///< Bytes used of the current block
+};
+
+
+template<class T>
+class ArenaAllocator {
+public:
+    typedef T value_type;
+
+    explicit ArenaAllocator(const shared_ptr<EventArena>& arena): m_arena(arena) {}
+
+    template<class U>
+    ArenaAllocator(const ArenaAllocator<U>& other): m_arena(other.arena()) {}
+
+    T* allocate(size_t n) {
+        return static_cast<T*>(m_arena->allocate(n * sizeof(T), alignof(T)));
+    }
+
+    /** @brief Memory is only reclaimed by EventArena::reset */
+    void deallocate(T*, size_t) {}
+
+    const shared_ptr<EventArena>& arena() const { return m_arena; }
+
+    template<class U>
+    bool operator==(const ArenaAllocator<U>& other) const { return m_arena == other.arena(); }
+    template<class U>
+    bool operator!=(const ArenaAllocator<U>& other) const { return m_arena != other.arena(); }
+
+private:
+    shared_ptr<EventArena> m_arena; ///< Arena of the event
+};
+
+
+class EventArenaPool {
+public:
+    /** @brief Arena for the next event */
+    shared_ptr<EventArena> acquire() {
+        for (size_t i = 0; i < m_arenas.size(); ++i) {
+            // Only the pool refers to it, so every object in it is destroyed
+            if (m_arenas[i].use_count() == 1) {
+                m_arenas[i]->reset();
+                return m_arenas[i];
+            }
+        }
+        m_arenas.push_back(make_shared<EventArena>());
+        return m_arenas.back();
+    }
+
+    /** @brief Number of arenas */
+    size_t size() const { return m_arenas.size(); }
+
+private:
+    std::vector< shared_ptr<EventArena> > m_arenas; ///< Arenas of previous events
+};
+
+} // namespace HepMC
+
+#endif
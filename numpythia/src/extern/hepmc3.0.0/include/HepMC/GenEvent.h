@@ -29,6 +29,7 @@ class TBuffer;
 namespace HepMC {
 
 struct GenEventData;
+class Pythia8ToHepMC3;
 
 /// @brief Stores event-related information
 ///
@@ -36,6 +37,9 @@ struct GenEventData;
 /// Contains lists of GenParticle and GenVertex objects
 class GenEvent {
 
+/// ADDED FOR NUMPYTHIA: appends converted events in one pass
+friend class Pythia8ToHepMC3;
+
 public:
 
     /// @brief Event constructor without a run
@@ -129,19 +133,19 @@ public:
     #endif
 
     /// @brief Get heavy ion generator additional information
-    const GenHeavyIonPtr heavy_ion() const { return attribute<GenHeavyIon>("GenHeavyIon"); }
+    const GenHeavyIonPtr heavy_ion() const { return attribute<GenHeavyIon>(GenRunInfo::HEAVY_ION_KEY); }
     /// @brief Set heavy ion generator additional information
-    void set_heavy_ion(const GenHeavyIonPtr &hi) { add_attribute("GenHeavyIon",hi); }
+    void set_heavy_ion(const GenHeavyIonPtr &hi) { add_attribute(GenRunInfo::HEAVY_ION_KEY,hi); }
 
     /// @brief Get PDF information
-    const GenPdfInfoPtr pdf_info() const { return attribute<GenPdfInfo>("GenPdfInfo"); }
+    const GenPdfInfoPtr pdf_info() const { return attribute<GenPdfInfo>(GenRunInfo::PDF_INFO_KEY); }
     /// @brief Set PDF information
-    void set_pdf_info(const GenPdfInfoPtr &pi) { add_attribute("GenPdfInfo",pi); }
+    void set_pdf_info(const GenPdfInfoPtr &pi) { add_attribute(GenRunInfo::PDF_INFO_KEY,pi); }
 
     /// @brief Get cross-section information
-    const GenCrossSectionPtr cross_section() const { return attribute<GenCrossSection>("GenCrossSection"); }
+    const GenCrossSectionPtr cross_section() const { return attribute<GenCrossSection>(GenRunInfo::CROSS_SECTION_KEY); }
     /// @brief Set cross-section information
-    void set_cross_section(const GenCrossSectionPtr &cs) { add_attribute("GenCrossSection",cs); }
+    void set_cross_section(const GenCrossSectionPtr &cs) { add_attribute(GenRunInfo::CROSS_SECTION_KEY,cs); }
 
     //@}
 
@@ -169,20 +173,38 @@ public:
 
     /// @name Additional attributes
     //@{
+
+    /// @brief Attributes of one name
+    ///
+    /// ADDED FOR NUMPYTHIA: pairs of ID (0 = event, <0 = vertex,
+    /// >0 = particle) and attribute, sorted by ID
+    typedef std::vector< std::pair<int, shared_ptr<Attribute> > > AttributeColumn;
+
     /// @brief Add event attribute to event
     ///
     /// This will overwrite existing attribute if an attribute
     /// with the same name is present
     void add_attribute(const string &name, const shared_ptr<Attribute> &att, int id = 0) {
-      if ( att ) m_attributes[name][id] = att;
+      if ( att ) add_attribute(GenRunInfo::attribute_key(name), att, id);
     }
 
+    /// @brief Add attribute by the key of its name (see GenRunInfo::attribute_key)
+    void add_attribute(int key, const shared_ptr<Attribute> &att, int id = 0);
+
     /// @brief Remove attribute
     void remove_attribute(const string &name, int id = 0);
 
     /// @brief Get attribute of type T
     template<class T>
-    shared_ptr<T> attribute(const string &name, int id = 0) const;
+    shared_ptr<T> attribute(const string &name, int id = 0) const {
+      return attribute<T>(GenRunInfo::find_attribute_key(name), id, name);
+    }
+
+    /// @brief Get attribute of type T by the key of its name
+    template<class T>
+    shared_ptr<T> attribute(int key, int id = 0) const {
+      return attribute<T>(key, id, string());
+    }
 
     /// @brief Get attribute of any type as string
     string attribute_as_string(const string &name, int id = 0) const;
@@ -190,8 +212,11 @@ public:
     /// @brief Get list of attribute names
     std::vector<string> attribute_names(int id = 0) const;
 
-    /// @brief Get list of attributes
-    const std::map< string, std::map<int, shared_ptr<Attribute> > >& attributes() const { return m_attributes; }
+    /// @brief Get attribute columns, indexed by the key of their name
+    const std::vector<AttributeColumn>& attributes() const { return m_attributes; }
+
+    /// @brief Keys of the names with attributes, in alphabetical order of the names
+    std::vector<int> attribute_keys() const;
 
     //@}
 
@@ -413,16 +438,20 @@ private:
     /// Global run information.
     shared_ptr<GenRunInfo> m_run_info;
 
-    /// @brief Map of event, particle and vertex attributes
+    /// @brief Event, particle and vertex attributes
     ///
-    /// Keys are name and ID (0 = event, <0 = vertex, >0 = particle)
-    mutable std::map< string, std::map<int, shared_ptr<Attribute> > > m_attributes;
+    /// ADDED FOR NUMPYTHIA: one column per interned name instead of a map
+    /// keyed by name and ID. Cleared columns keep their memory for the next
+    /// event.
+    mutable std::vector<AttributeColumn> m_attributes;
 
-    /// @brief Attribute map key type
-    typedef std::map< string, std::map<int, shared_ptr<Attribute> > >::value_type att_key_t;
+    /// @brief Attribute of a name key and ID or NULL
+    shared_ptr<Attribute>* find_attribute(int key, int id) const;
 
-    /// @brief Attribute map value type
-    typedef std::map<int, shared_ptr<Attribute> >::value_type att_val_t;
+    /// @brief Get attribute of type T, falling back to the run attribute
+    /// of that name for ID 0 if the event has none of the name
+    template<class T>
+    shared_ptr<T> attribute(int key, int id, const string &name) const;
     #endif // __CINT__
 
     //@}
@@ -438,31 +467,29 @@ private:
 //
 
 template<class T>
-shared_ptr<T> GenEvent::attribute(const std::string &name, int id) const {
+shared_ptr<T> GenEvent::attribute(int key, int id, const string &name) const {
 
-    std::map< string, std::map<int, shared_ptr<Attribute> > >::iterator i1 = m_attributes.find(name);
-    if( i1 == m_attributes.end() ) {
-        if ( id == 0 && run_info() ) {
-            return run_info()->attribute<T>(name);
+    shared_ptr<Attribute> *i2 = find_attribute(key, id);
+    if( !i2 ) {
+        bool has_name = key >= 0 && key < (int)m_attributes.size() && !m_attributes[key].empty();
+        if ( !has_name && id == 0 && run_info() ) {
+            return run_info()->attribute<T>(name.empty() ? GenRunInfo::attribute_name(key) : name);
         }
         return shared_ptr<T>();
     }
 
-    std::map<int, shared_ptr<Attribute> >::iterator i2 = i1->second.find(id);
-    if (i2 == i1->second.end() ) return shared_ptr<T>();
-
-    if (!i2->second->is_parsed() ) {
+    if (!(*i2)->is_parsed() ) {
 
         shared_ptr<T> att = make_shared<T>();
-        if ( att->from_string(i2->second->unparsed_string()) && att->init(*this) ) {
-            // update map with new pointer
-            i2->second = att;
+        if ( att->from_string((*i2)->unparsed_string()) && att->init(*this) ) {
+            // update column with new pointer
+            *i2 = att;
             return att;
         } else {
             return shared_ptr<T>();
         }
     }
-    else return dynamic_pointer_cast<T>(i2->second);
+    else return dynamic_pointer_cast<T>(*i2);
 }
 
 #endif // __CINT__
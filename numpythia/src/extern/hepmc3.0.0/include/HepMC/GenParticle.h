@@ -25,6 +25,7 @@ using namespace std;
 
 class GenEvent;
 class Attribute;
+class Pythia8ToHepMC3;
 
 
 class GenParticle {
@@ -32,6 +33,8 @@ class GenParticle {
 friend class GenEvent;
 friend class GenVertex;
 friend class SmartPointer<GenParticle>;
+// ADDED FOR NUMPYTHIA: links whole events without the checks of GenVertex
+friend class Pythia8ToHepMC3;
 
 //
 // Constructors
@@ -66,6 +69,10 @@ public:
     GenVertexPtr production_vertex();        //!< Get production vertex
     GenVertexPtr end_vertex();               //!< Get end vertex
 
+    // ADDED FOR NUMPYTHIA
+    bool has_production_vertex() const { return !m_production_vertex.expired(); } //!< Check for production vertex without locking it
+    bool has_end_vertex()        const { return !m_end_vertex.expired();        } //!< Check for end vertex without locking it
+
     /// @brief Convenience access to immediate incoming particles via production vertex
     /// @note Less efficient than via the vertex since return must be by value (in case there is no vertex)
     vector<GenParticlePtr> parents() const;
@@ -113,6 +113,31 @@ public:
       return m_attributes;
     }
 
+    /// @name Interned attribute names
+    ///
+    /// ADDED FOR NUMPYTHIA: every attribute name gets a small integer key
+    /// when it is first used. The keys are shared by all runs and events and
+    /// index the attribute columns of GenEvent.
+    //@{
+
+    /// @brief Keys of the attributes with accessors in GenEvent
+    enum AttributeKey {
+      HEAVY_ION_KEY = 0,
+      PDF_INFO_KEY,
+      CROSS_SECTION_KEY
+    };
+
+    /// @brief Key of an attribute name, interning the name if it is new
+    static int attribute_key(const string &name);
+
+    /// @brief Key of an attribute name or -1 if it was never interned
+    static int find_attribute_key(const string &name);
+
+    /// @brief Name of an attribute key
+    static const string& attribute_name(int key);
+
+    //@}
+
     #endif // __CINT__
 
     /// @name Methods to fill GenRunInfoData and to read it back
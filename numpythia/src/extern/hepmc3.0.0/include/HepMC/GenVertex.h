@@ -28,6 +28,7 @@ namespace HepMC {
 
     class GenEvent;
     class Attribute;
+    class Pythia8ToHepMC3;
 
 
     /// Stores vertex-related information
@@ -36,6 +37,9 @@ namespace HepMC {
         /// @todo Are these really needed? Friends usually indicate a problem...
         friend class GenEvent;
         friend class SmartPointer<GenVertex>;
+        /// ADDED FOR NUMPYTHIA: links whole events without the checks of
+        /// add_particle_in and add_particle_out
+        friend class Pythia8ToHepMC3;
 
 
     public:
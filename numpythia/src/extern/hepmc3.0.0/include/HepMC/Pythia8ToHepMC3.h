@@ -7,6 +7,8 @@
 #define Pythia8_Pythia8ToHepMC3_H
 
 #include "Pythia8/Pythia.h"
+#include "HepMC/Data/EventArena.h"
+#include "HepMC/FourVector.h"
 
 #include <vector>
 namespace HepMC {
@@ -15,6 +17,52 @@ class GenEvent;
 class GenVertex;
 class GenParticle;
 
+// ADDED FOR NUMPYTHIA: the mothers of Pythia8::Particle::motherList() as
+// a range first, first + step, ..., last instead of a new vector
+struct Pythia8Mothers {
+    int first, last, step;
+
+    Pythia8Mothers(const Pythia8::Particle& particle);
+
+    bool empty() const { return last < first; }
+};
+
+// ADDED FOR NUMPYTHIA: the graph Pythia8ToHepMC3::fill_next_event builds,
+// on the indices of the PYTHIA record. The incoming particles of a vertex
+// are the mothers of the particle that created it which have not been moved
+// to a later vertex since, just like GenVertex::add_particle_in moves a
+// particle from its previous end vertex. sort() finds the particles and
+// vertices of the event in the order GenEvent::add_tree adds them.
+struct Pythia8Graph {
+    Pythia8Graph(const Pythia8::Event& pyev);
+
+    int size() const { return creator.size(); }
+
+    Pythia8Mothers mothers(int vertex) const { return Pythia8Mothers(event[creator[vertex]]); }
+
+    bool no_particles_in(int vertex) const;
+
+    // GenVertex::position() while the graph is built: its own position or
+    // that of the production vertex of the first incoming particle with one
+    FourVector current_position(int vertex) const;
+
+    // Fill particle_order, vertex_order and root_particles. Vertex index
+    // size() stands for the root vertex of the event, which is already in
+    // the event if root_in_event is true.
+    void sort(bool root_in_event);
+
+    const Pythia8::Event& event;
+    std::vector<int>        end_vertex;        ///< Vertex of each particle or -1
+    std::vector<int>        production_vertex; ///< Vertex of each particle or -1
+    std::vector<int>        creator;           ///< Particle that created each vertex
+    std::vector<FourVector> position;          ///< Position set on each vertex
+    std::vector<int>        out_offsets;       ///< Vertex v has out[out_offsets[v]:out_offsets[v + 1]]
+    std::vector<int>        out;               ///< Outgoing particles
+    std::vector<int>        particle_order;    ///< Particles of the event in order
+    std::vector<int>        vertex_order;      ///< Vertices of the event in order
+    std::vector<int>        root_particles;    ///< Particles attached to the root vertex
+};
+
 class Pythia8ToHepMC3 {
 
 public:
@@ -61,6 +109,10 @@ public:
     void set_store_xsec(bool b = true)           { m_store_xsec           = b; }
     void set_store_weights(bool b = true)        { m_store_weights        = b; }
 
+    // ADDED FOR NUMPYTHIA: allocate the particles and vertices of the next
+    // event in this arena instead of one heap allocation each
+    void set_arena(const shared_ptr<EventArena>& arena) { m_arena = arena; }
+
 private:
 
     // Following methods are not implemented for this class
@@ -80,6 +132,7 @@ private:
     bool m_store_proc;
     bool m_store_xsec;
     bool m_store_weights;
+    shared_ptr<EventArena> m_arena;
 };
 
 } // namespace HepMC
@@ -59,17 +59,25 @@ private:
     /** @brief Check if particle passed all filters */
     bool passed_all_filters(const GenParticlePtr &p, FilterList &filter_list);
 
+    // ADDED FOR NUMPYTHIA: the ancestor and descendant searches are
+    // iterative and mark checked vertices in a bitset indexed by vertex id
+    // instead of scanning a list of vertices, so long decay chains neither
+    // take quadratic time nor overflow the stack.
+
     /** @brief Check if all ancestors passed the filter
      *
-     *  Recursively check all particles and production vertices of these particles
+     *  Depth-first traversal of all particles and production vertices of these particles
      */
-    void recursive_check_ancestors(const GenVertexPtr &v, FilterList &filter_list);
+    void check_ancestors(const GenVertexPtr &v, FilterList &filter_list);
 
     /** @brief Check if all descendants passed the filter
      *
-     *  Recursively check all particles and end vertices of these particles
+     *  Depth-first traversal of all particles and end vertices of these particles
      */
-    void recursive_check_descendants(const GenVertexPtr &v, FilterList &filter_list);
+    void check_descendants(const GenVertexPtr &v, FilterList &filter_list);
+
+    /** @brief Mark vertex as checked. @return false if it was checked before */
+    bool mark_checked(const GenVertexPtr &v);
 //
 // Accessors
 //
@@ -81,7 +89,8 @@ public:
 //
 private:
     vector<GenParticlePtr> m_results;          //!< List of results
-    vector<GenVertexPtr>   m_checked_vertices; //!< List of already checked vertices
+    vector<bool>           m_checked_vertices;          //!< Already checked vertices by -id-1
+    vector<GenVertexPtr>   m_checked_detached_vertices; //!< Already checked vertices without event
 };
 
 
@@ -53,9 +53,11 @@ public:
 
     /// @brief Set output precision
     ///
-    /// Available range is [2,24]. Default is 16.
+    /// Available range is [2,24], or 0 for the shortest representation
+    /// that reads back to the same value. Default is 0.
+    /// ADDED FOR NUMPYTHIA: the default was 16
     void set_precision( size_t prec ) {
-        if (prec < 2 || prec > 24) return;
+        if (prec != 0 && (prec < 2 || prec > 24)) return;
         m_precision = prec;
     }
 
@@ -114,6 +116,10 @@ private:
     /// Helper routine for writing single particle to file
     void write_particle(const GenParticlePtr &p, int second_field);
 
+    /// @brief Write the four components of a position preceded by spaces
+    /// ADDED FOR NUMPYTHIA
+    void write_position(const FourVector &pos);
+
     //@}
 
 private:
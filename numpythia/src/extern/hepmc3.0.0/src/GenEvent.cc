@@ -109,41 +109,12 @@ void GenEvent::remove_particle( GenParticlePtr p ) {
     //
     // Reassign id of attributes with id above this one
     //
-#ifndef HEPMC_HAS_CXX0X_GCC_ONLY
-       vector<att_val_t> changed_attributes;
-
-    FOREACH( att_key_t& vt1, m_attributes ) {
-        changed_attributes.clear();
-
-      FOREACH( const att_val_t& vt2, vt1.second ) {
-            if( vt2.first > p->id() ) {
-                changed_attributes.push_back(vt2);
-            }
-        }
-
-        FOREACH( att_val_t val, changed_attributes ) {
-            vt1.second.erase(val.first);
-            vt1.second[val.first-1] = val.second;
+    FOREACH( AttributeColumn& column, m_attributes ) {
+        FOREACH( AttributeColumn::value_type& val, column ) {
+            if( val.first > p->id() ) --val.first;
         }
     }
-#else
-       vector< pair< int, shared_ptr<Attribute> > > changed_attributes;
-
-    FOREACH( att_key_t& vt1, m_attributes ) {
-        changed_attributes.clear();
-
-        for ( std::map<int, shared_ptr<Attribute> >::iterator vt2=vt1.second.begin();vt2!=vt1.second.end();vt2++){
-            if( (*vt2).first > p->id() ) {
-                   changed_attributes.push_back(*vt2);
-            }
-        }
 
-        FOREACH( att_val_t val, changed_attributes ) {
-            vt1.second.erase(val.first);
-            vt1.second[val.first-1] = val.second;
-        }
-    }
-#endif
     // Reassign id of particles with id above this one
     for(;it != m_particles.end(); ++it) {
         --((*it)->m_id);
@@ -203,21 +174,9 @@ void GenEvent::remove_vertex( GenVertexPtr v ) {
     //
     // Reassign id of attributes with id below this one
     //
-#ifndef HEPMC_HAS_CXX0X_GCC_ONLY
-    vector<att_val_t> changed_attributes;
-
-    FOREACH( att_key_t& vt1, m_attributes ) {
-        changed_attributes.clear();
-
-        FOREACH( const att_val_t& vt2, vt1.second ) {
-            if( vt2.first < v->id() ) {
-                changed_attributes.push_back(vt2);
-            }
-        }
-
-        FOREACH( att_val_t val, changed_attributes ) {
-            vt1.second.erase(val.first);
-            vt1.second[val.first+1] = val.second;
+    FOREACH( AttributeColumn& column, m_attributes ) {
+        FOREACH( AttributeColumn::value_type& val, column ) {
+            if( val.first < v->id() ) ++val.first;
         }
     }
 
@@ -230,34 +189,6 @@ void GenEvent::remove_vertex( GenVertexPtr v ) {
     v->m_event = NULL;
     v->m_id    = 0;
 }
-#else
-    vector< pair< int, shared_ptr<Attribute> > > changed_attributes;
-
-    FOREACH( att_key_t& vt1, m_attributes ) {
-        changed_attributes.clear();
-
-        for ( std::map<int, shared_ptr<Attribute> >::iterator vt2=vt1.second.begin();vt2!=vt1.second.end();vt2++){			
-            if( (*vt2).first < v->id() ) {
-                  changed_attributes.push_back(*vt2);
-            }
-        }
-
-        FOREACH( att_val_t val, changed_attributes ) {
-            vt1.second.erase(val.first);
-            vt1.second[val.first+1] = val.second;
-        }
-    }
-
-    // Reassign id of particles with id above this one
-    for(;it != m_vertices.end(); ++it) {
-        ++((*it)->m_id);
-    }
-
-    // Finally - set parent event and id of this vertex to 0
-    v->m_event = NULL;
-    v->m_id    = 0;
-}
-#endif
 
 void GenEvent::add_tree( const vector<GenParticlePtr> &parts ) {
 
@@ -372,10 +303,23 @@ void GenEvent::shift_position_by( const FourVector & delta ) {
 
 
 void GenEvent::clear() {
+    // ADDED FOR NUMPYTHIA: detach the particles and vertices that are still
+    // referenced elsewhere so that they are not taken for those of the next
+    // event stored in this GenEvent
+    for (size_t i = 0; i < m_particles.size(); ++i) {
+        (*m_particles[i]).m_event = NULL;
+        (*m_particles[i]).m_id = 0;
+    }
+    for (size_t i = 0; i < m_vertices.size(); ++i) {
+        (*m_vertices[i]).m_event = NULL;
+        (*m_vertices[i]).m_id = 0;
+    }
     m_event_number = 0;
     m_rootvertex = make_shared<GenVertex>();
     m_weights.clear();
-    m_attributes.clear();
+    FOREACH( AttributeColumn& column, m_attributes ) {
+        column.clear();
+    }
     m_particles.clear();
     m_vertices.clear();
 }
@@ -395,23 +339,73 @@ void GenEvent::add_vertex( GenVertex *v ) {
 }
 
 
+// ADDED FOR NUMPYTHIA
+namespace {
+
+struct id_less {
+    bool operator()(const GenEvent::AttributeColumn::value_type& val, int id) const {
+        return val.first < id;
+    }
+};
+
+struct name_less {
+    bool operator()(const pair<const string*, int>& a, const pair<const string*, int>& b) const {
+        return *a.first < *b.first;
+    }
+};
+
+} // namespace
+
+void GenEvent::add_attribute(int key, const shared_ptr<Attribute> &att, int id) {
+    if( !att ) return;
+    if( key >= (int)m_attributes.size() ) m_attributes.resize(key + 1);
+    AttributeColumn &column = m_attributes[key];
+    // Attributes are mostly added in order of ID
+    if( column.empty() || column.back().first < id ) {
+        column.push_back(make_pair(id, att));
+        return;
+    }
+    AttributeColumn::iterator i = lower_bound(column.begin(), column.end(), id, id_less());
+    if( i != column.end() && i->first == id ) i->second = att;
+    else column.insert(i, make_pair(id, att));
+}
+
+shared_ptr<Attribute>* GenEvent::find_attribute(int key, int id) const {
+    if( key < 0 || key >= (int)m_attributes.size() ) return NULL;
+    AttributeColumn &column = m_attributes[key];
+    AttributeColumn::iterator i = lower_bound(column.begin(), column.end(), id, id_less());
+    if( i == column.end() || i->first != id ) return NULL;
+    return &i->second;
+}
+
 void GenEvent::remove_attribute(const string &name, int id) {
-    map< string, map<int, shared_ptr<Attribute> > >::iterator i1 = m_attributes.find(name);
-    if( i1 == m_attributes.end() ) return;
+    int key = GenRunInfo::find_attribute_key(name);
+    if( !find_attribute(key, id) ) return;
 
-    map<int, shared_ptr<Attribute> >::iterator i2 = i1->second.find(id);
-    if( i2 == i1->second.end() ) return;
+    AttributeColumn &column = m_attributes[key];
+    column.erase(lower_bound(column.begin(), column.end(), id, id_less()));
+}
+
+vector<int> GenEvent::attribute_keys() const {
+    vector< pair<const string*, int> > names;
+    for( int key = 0; key < (int)m_attributes.size(); ++key ) {
+        if( !m_attributes[key].empty() ) {
+            names.push_back(make_pair(&GenRunInfo::attribute_name(key), key));
+        }
+    }
+    sort(names.begin(), names.end(), name_less());
 
-    i1->second.erase(i2);
+    vector<int> keys;
+    keys.reserve(names.size());
+    for( unsigned int i = 0; i < names.size(); ++i ) keys.push_back(names[i].second);
+    return keys;
 }
 
 vector<string> GenEvent::attribute_names(int id) const {
     vector<string> results;
 
-    FOREACH( const att_key_t& vt1, this->attributes() ) {
-        FOREACH( const att_val_t& vt2, vt1.second ) {
-            if( vt2.first == id ) results.push_back( vt1.first );
-        }
+    FOREACH( int key, attribute_keys() ) {
+        if( find_attribute(key, id) ) results.push_back( GenRunInfo::attribute_name(key) );
     }
 
     return results;
@@ -423,9 +417,10 @@ void GenEvent::write_data(GenEventData& data) const {
     data.vertices.reserve( this->vertices().size() );
     data.links1.reserve( this->particles().size()*2 );
     data.links2.reserve( this->particles().size()*2 );
-    data.attribute_id.reserve( this->attributes().size() );
-    data.attribute_name.reserve( this->attributes().size() );
-    data.attribute_string.reserve( this->attributes().size() );
+    vector<int> keys = attribute_keys();
+    data.attribute_id.reserve( keys.size() );
+    data.attribute_name.reserve( keys.size() );
+    data.attribute_string.reserve( keys.size() );
 
     // Fill event data
     data.event_number  = this->event_number();
@@ -455,19 +450,20 @@ void GenEvent::write_data(GenEventData& data) const {
         }
     }
 
-    FOREACH( const att_key_t& vt1, this->attributes() ) {
-        FOREACH( const att_val_t& vt2, vt1.second ) {
+    FOREACH( int key, keys ) {
+        const string &name = GenRunInfo::attribute_name(key);
+        FOREACH( const AttributeColumn::value_type& vt2, m_attributes[key] ) {
 
             string st;
 
             bool status = vt2.second->to_string(st);
 
             if( !status ) {
-                WARNING( "GenEvent::write_data: problem serializing attribute: "<<vt1.first )
+                WARNING( "GenEvent::write_data: problem serializing attribute: "<<name )
             }
             else {
                 data.attribute_id.push_back(vt2.first);
-                data.attribute_name.push_back(vt1.first);
+                data.attribute_name.push_back(name);
                 data.attribute_string.push_back(st);
             }
         }
@@ -554,21 +550,20 @@ void GenEvent::set_beam_particles(const pair<GenParticlePtr,GenParticlePtr>& p)
 
 string GenEvent::attribute_as_string(const string &name, int id) const {
 
-    std::map< string, std::map<int, shared_ptr<Attribute> > >::iterator i1 = m_attributes.find(name);
-    if( i1 == m_attributes.end() ) {
-        if ( id == 0 && run_info() ) {
+    int key = GenRunInfo::find_attribute_key(name);
+    shared_ptr<Attribute> *i2 = find_attribute(key, id);
+    if( !i2 ) {
+        bool has_name = key >= 0 && key < (int)m_attributes.size() && !m_attributes[key].empty();
+        if ( !has_name && id == 0 && run_info() ) {
             return run_info()->attribute_as_string(name);
         }
         return string();
     }
 
-    std::map<int, shared_ptr<Attribute> >::iterator i2 = i1->second.find(id);
-    if (i2 == i1->second.end() ) return string();
-
-    if( !i2->second ) return string();
+    if( !*i2 ) return string();
 
     string ret;
-    i2->second->to_string(ret);
+    (*i2)->to_string(ret);
 
     return ret;
 }
@@ -11,9 +11,107 @@
 #include "HepMC/GenRunInfo.h"
 #include "HepMC/Data/GenRunInfoData.h"
 #include <sstream>
+#include <atomic>
+#include <cassert>
+#include <mutex>
+#include <stdexcept>
+#include <unordered_map>
 
 namespace HepMC {
 
+namespace {
+
+// ADDED FOR NUMPYTHIA: names of the attribute keys. Names are only ever
+// appended, in chunks that never move, so references to them stay valid
+// and attribute_name reads them without a lock once the size published
+// after each append covers the key. New names are interned under the
+// mutex; each thread caches the keys it has seen to look them up without
+// it.
+struct AttributeNames {
+    static const int CHUNK_SIZE = 256;
+    static const int MAX_CHUNKS = 4096;
+
+    AttributeNames(): size(0) {
+        for( int i = 0; i < MAX_CHUNKS; ++i ) chunks[i] = NULL;
+        intern("GenHeavyIon");
+        intern("GenPdfInfo");
+        intern("GenCrossSection");
+    }
+
+    // Call with the mutex held
+    int intern(const string &name) {
+        std::unordered_map<string, int>::const_iterator i = keys.find(name);
+        if( i != keys.end() ) return i->second;
+        int key = size.load(std::memory_order_relaxed);
+        if( key % CHUNK_SIZE == 0 ) {
+            if( key / CHUNK_SIZE == MAX_CHUNKS ) throw std::length_error("too many attribute names");
+            chunks[key / CHUNK_SIZE] = new string[CHUNK_SIZE];
+        }
+        chunks[key / CHUNK_SIZE][key % CHUNK_SIZE] = name;
+        keys[name] = key;
+        size.store(key + 1, std::memory_order_release);
+        return key;
+    }
+
+    const string& name(int key) const {
+        assert( key >= 0 && key < size.load(std::memory_order_acquire) );
+        return chunks[key / CHUNK_SIZE][key % CHUNK_SIZE];
+    }
+
+    std::mutex                       mutex;
+    std::unordered_map<string, int>  keys;
+    string*                          chunks[MAX_CHUNKS];
+    std::atomic<int>                 size;
+};
+
+// Never destroyed, so that threads still running at exit can use it
+AttributeNames& attribute_names() {
+    static AttributeNames *names = new AttributeNames();
+    return *names;
+}
+
+// Keys of the names this thread has looked up
+std::unordered_map<string, int>& cached_attribute_keys() {
+    static thread_local std::unordered_map<string, int> keys;
+    return keys;
+}
+
+} // namespace
+
+int GenRunInfo::attribute_key(const string &name) {
+    std::unordered_map<string, int> &cache = cached_attribute_keys();
+    std::unordered_map<string, int>::const_iterator i = cache.find(name);
+    if( i != cache.end() ) return i->second;
+    AttributeNames &names = attribute_names();
+    int key;
+    {
+        std::lock_guard<std::mutex> lock(names.mutex);
+        key = names.intern(name);
+    }
+    cache[name] = key;
+    return key;
+}
+
+int GenRunInfo::find_attribute_key(const string &name) {
+    std::unordered_map<string, int> &cache = cached_attribute_keys();
+    std::unordered_map<string, int>::const_iterator i = cache.find(name);
+    if( i != cache.end() ) return i->second;
+    AttributeNames &names = attribute_names();
+    int key;
+    {
+        std::lock_guard<std::mutex> lock(names.mutex);
+        i = names.keys.find(name);
+        if( i == names.keys.end() ) return -1;
+        key = i->second;
+    }
+    cache[name] = key;
+    return key;
+}
+
+const string& GenRunInfo::attribute_name(int key) {
+    return attribute_names().name(key);
+}
+
 
 void GenRunInfo::set_weight_names(const std::vector<std::string> & names) {
     m_weight_indices.clear();
@@ -30,12 +30,9 @@ void Print::content( const GenEvent &event ) {
 
     cout<<"Attributes:"<<endl;
 
-    typedef map< string, map<int, shared_ptr<Attribute> > >::value_type value_type1;
-    typedef map<int, shared_ptr<Attribute> >::value_type                value_type2;
-
-    FOREACH( const value_type1& vt1, event.attributes() ) {
-        FOREACH( const value_type2& vt2, vt1.second ) {
-            cout << vt2.first << ": " << vt1.first << endl;
+    FOREACH( int key, event.attribute_keys() ) {
+        FOREACH( const GenEvent::AttributeColumn::value_type& vt2, event.attributes()[key] ) {
+            cout << vt2.first << ": " << GenRunInfo::attribute_name(key) << endl;
         }
     }
 
@@ -6,9 +6,176 @@
 
 #include <deque>
 #include <cassert>
+#include <algorithm>
 
 namespace HepMC {
 
+// ADDED FOR NUMPYTHIA: objects of the event in the arena if there is one
+template<class T, class... Args>
+static inline SmartPointer<T> make_event_object(const shared_ptr<EventArena>& arena, Args&&... args) {
+    if (arena) {
+        return std::allocate_shared<T>(ArenaAllocator<T>(arena), std::forward<Args>(args)...);
+    }
+    return make_shared<T>(std::forward<Args>(args)...);
+}
+
+// ADDED FOR NUMPYTHIA
+Pythia8Mothers::Pythia8Mothers(const Pythia8::Particle& particle) {
+    int mother1 = particle.mother1();
+    int mother2 = particle.mother2();
+    int status = particle.statusAbs();
+    step = 1;
+    if (status == 11 || status == 12) {
+        first = 1;
+        last = 0;
+    } else if (mother1 == 0 && mother2 == 0) {
+        first = last = 0;
+    } else if (mother2 == 0 || mother2 == mother1) {
+        first = last = mother1;
+    } else if ((status > 80 && status < 90) || (status > 100 && status < 107)) {
+        first = mother1;
+        last = mother2;
+    } else {
+        first = std::min(mother1, mother2);
+        last = std::max(mother1, mother2);
+        step = last - first;
+    }
+}
+
+// ADDED FOR NUMPYTHIA
+Pythia8Graph::Pythia8Graph(const Pythia8::Event& pyev):
+    event(pyev),
+    end_vertex(pyev.size(), -1),
+    production_vertex(pyev.size(), -1) {
+    int n = pyev.size();
+    creator.reserve(n);
+    position.reserve(n);
+    for (int i = 1; i < n; ++i) {
+        Pythia8Mothers mothers(pyev[i]);
+        if (mothers.empty()) continue;
+        int vertex = end_vertex[mothers.first];
+        if (vertex < 0) {
+            vertex = creator.size();
+            creator.push_back(i);
+            position.push_back(FourVector());
+            for (int j = mothers.first; j <= mothers.last; j += mothers.step) end_vertex[j] = vertex;
+        }
+        // Update vertex position if necessary
+        FourVector prod_pos( pyev[i].xProd(), pyev[i].yProd(),
+                             pyev[i].zProd(), pyev[i].tProd() );
+        if (!prod_pos.is_zero() && current_position(vertex).is_zero()) position[vertex] = prod_pos;
+        production_vertex[i] = vertex;
+    }
+    // Outgoing particles of each vertex in the order of the record
+    out_offsets.assign(creator.size() + 1, 0);
+    for (int i = 1; i < n; ++i) {
+        if (production_vertex[i] >= 0) ++out_offsets[production_vertex[i] + 1];
+    }
+    for (size_t v = 0; v < creator.size(); ++v) out_offsets[v + 1] += out_offsets[v];
+    out.resize(out_offsets.back());
+    std::vector<int> next(out_offsets.begin(), out_offsets.end() - 1);
+    for (int i = 1; i < n; ++i) {
+        if (production_vertex[i] >= 0) out[next[production_vertex[i]]++] = i;
+    }
+}
+
+bool Pythia8Graph::no_particles_in(int vertex) const {
+    Pythia8Mothers in = mothers(vertex);
+    for (int j = in.first; j <= in.last; j += in.step) {
+        if (end_vertex[j] == vertex) return false;
+    }
+    return true;
+}
+
+FourVector Pythia8Graph::current_position(int vertex) const {
+    while (position[vertex].is_zero()) {
+        int next = -1;
+        Pythia8Mothers in = mothers(vertex);
+        for (int j = in.first; j <= in.last && next < 0; j += in.step) {
+            if (end_vertex[j] == vertex) next = production_vertex[j];
+        }
+        if (next < 0) return FourVector::ZERO_VECTOR();
+        vertex = next;
+    }
+    return position[vertex];
+}
+
+// Simulates GenEvent::add_tree on the indices, starting from the system
+// entry and both beams so that subtrees only attached to the second beam
+// (e.g. in diffractive events) are not dropped. Particles without a
+// production vertex are attached to the root vertex when they are added.
+void Pythia8Graph::sort(bool root_in_event) {
+    int n = event.size();
+    const int root = size();
+    std::vector<char> particle_added(n, 0);
+    std::vector<char> vertex_added(root + 1, 0);
+    vertex_added[root] = root_in_event;
+    particle_order.clear();
+    vertex_order.clear();
+    root_particles.clear();
+    particle_order.reserve(n);
+    vertex_order.reserve(root);
+
+    std::deque<int> sorting;
+    for (int i = 0; i < 3 && i < n; ++i) {
+        int v = production_vertex[i];
+        if (v < 0 || no_particles_in(v)) {
+            if (end_vertex[i] >= 0) sorting.push_back(end_vertex[i]);
+        }
+    }
+
+    while (!sorting.empty()) {
+        int v = sorting.front();
+        bool added = false;
+
+        // Add all mothers to the front of the list
+        if (v != root) {
+            Pythia8Mothers in = mothers(v);
+            for (int j = in.first; j <= in.last; j += in.step) {
+                if (end_vertex[j] != v) continue;
+                int v2 = production_vertex[j];
+                if (v2 < 0 && particle_added[j]) v2 = root;
+                if (v2 >= 0 && !vertex_added[v2]) {
+                    sorting.push_front(v2);
+                    added = true;
+                }
+            }
+        }
+        if (added) continue;
+
+        if (!vertex_added[v]) {
+            vertex_added[v] = 1;
+            vertex_order.push_back(v);
+            const int* out_begin = root_particles.data();
+            const int* out_end = out_begin + root_particles.size();
+            if (v != root) {
+                Pythia8Mothers in = mothers(v);
+                for (int j = in.first; j <= in.last; j += in.step) {
+                    if (end_vertex[j] != v || particle_added[j]) continue;
+                    particle_added[j] = 1;
+                    particle_order.push_back(j);
+                    if (production_vertex[j] < 0) root_particles.push_back(j);
+                }
+                out_begin = out.data() + out_offsets[v];
+                out_end = out.data() + out_offsets[v + 1];
+                for (const int* i = out_begin; i != out_end; ++i) {
+                    if (particle_added[*i]) continue;
+                    particle_added[*i] = 1;
+                    particle_order.push_back(*i);
+                }
+            }
+
+            // Add all end vertices to the end of the list
+            for (const int* i = out_begin; i != out_end; ++i) {
+                int v2 = end_vertex[*i];
+                if (v2 >= 0 && !vertex_added[v2]) sorting.push_back(v2);
+            }
+        }
+
+        sorting.pop_front();
+    }
+}
+
 /** What is not in current HepMC implementation:
  *  - units
  *  - color flow (will probably be removed altogether)
@@ -38,20 +205,37 @@ bool Pythia8ToHepMC3::fill_next_event( Pythia8::Event& pyev, GenEvent* evt, int
 
     evt->set_units(HepMC::Units::GEV,HepMC::Units::MM);
 
-    // 2. Fill particle information
-    std::vector<GenParticlePtr> hepevt_particles;
-    hepevt_particles.reserve( pyev.size() );
-
-    for(int i=0;i<pyev.size(); ++i) {
-        hepevt_particles.push_back( make_shared<GenParticle>( FourVector( pyev[i].px(), pyev[i].py(),
-                                                              pyev[i].pz(), pyev[i].e() ),
-                                                              pyev[i].id(), pyev[i].statusHepMC() )
-                                  );
-
-/*
-        hepevt_particles[i]->suggest_barcode(i);
-*/
-        hepevt_particles[i]->set_generated_mass( pyev[i].m() );
+    // ADDED FOR NUMPYTHIA: the vertices are found on the indices of the
+    // record and only the particles and vertices reachable from the beams
+    // are created, directly in the topological order of GenEvent::add_tree.
+    // The event is the same as when linking all particles and vertices one
+    // at a time and calling add_tree.
+
+    // 2. Fill vertex information
+    Pythia8Graph graph(pyev);
+    int n = pyev.size();
+    int nvertices = graph.size();
+
+    // 3. Find the particles and vertices in the order of GenEvent::add_tree
+    const int root = nvertices;
+    graph.sort(evt->m_rootvertex->in_event());
+    const std::vector<int>& particle_order = graph.particle_order;
+    const std::vector<int>& vertex_order = graph.vertex_order;
+    const std::vector<int>& root_particles = graph.root_particles;
+
+    // 4. Create the particles and vertices of the event and link them
+    evt->reserve( evt->m_particles.size() + particle_order.size(),
+                  evt->m_vertices.size() + vertex_order.size() );
+
+    std::vector<GenParticlePtr> hepevt_particles( n );
+    for (size_t k = 0; k < particle_order.size(); ++k) {
+        int i = particle_order[k];
+        GenParticlePtr p = make_event_object<GenParticle>( m_arena,
+                                                           FourVector( pyev[i].px(), pyev[i].py(),
+                                                           pyev[i].pz(), pyev[i].e() ),
+                                                           pyev[i].id(), pyev[i].statusHepMC() );
+        GenParticle& particle = *p;
+        particle.set_generated_mass( pyev[i].m() );
 
 /*
         // Colour flow uses index 1 and 2.
@@ -61,46 +245,43 @@ bool Pythia8ToHepMC3::fill_next_event( Pythia8::Event& pyev, GenEvent* evt, int
         if (colType == -1 || colType == 2)
             hepevt_particles[i]->set_flow(2, pyev[i].acol());
 */
+        evt->m_particles.push_back(p);
+        particle.m_event = evt;
+        particle.m_id    = evt->m_particles.size();
+        hepevt_particles[i] = p;
     }
 
-    // 3. Fill vertex information
-    std::vector<GenVertexPtr> vertex_cache;
-
-    for(int i=1;i<pyev.size(); ++i) {
-
-        std::vector<int> mothers = pyev[i].motherList();
-
-        if(mothers.size()) {
-            GenVertexPtr prod_vtx = hepevt_particles[mothers[0]]->end_vertex();
-
-            if(!prod_vtx) {
-                prod_vtx = make_shared<GenVertex>();
-                vertex_cache.push_back(prod_vtx);
-
-                for(unsigned int j=0; j<mothers.size(); ++j) {
-                    prod_vtx->add_particle_in( hepevt_particles[mothers[j]] );
-                }
-            }
-            FourVector prod_pos( pyev[i].xProd(), pyev[i].yProd(),
-                                 pyev[i].zProd(), pyev[i].tProd() );
-
-            // Update vertex position if necessary
-            if(!prod_pos.is_zero() && prod_vtx->position().is_zero()) prod_vtx->set_position( prod_pos );
-
-            prod_vtx->add_particle_out( hepevt_particles[i] );
+    std::vector<GenVertexPtr> vertices( nvertices + 1 );
+    vertices[root] = evt->m_rootvertex;
+    for (size_t k = 0; k < vertex_order.size(); ++k) {
+        int v = vertex_order[k];
+        if (v != root) vertices[v] = make_event_object<GenVertex>( m_arena, graph.position[v] );
+        evt->m_vertices.push_back(vertices[v]);
+        GenVertex& vertex = *vertices[v];
+        vertex.m_event = evt;
+        vertex.m_id    = -(int)evt->m_vertices.size();
+        if (v == root) continue;
+
+        Pythia8Mothers in = graph.mothers(v);
+        for (int j = in.first; j <= in.last; j += in.step) {
+            if (graph.end_vertex[j] != v) continue;
+            vertex.m_particles_in.push_back(hepevt_particles[j]);
+            (*hepevt_particles[j]).m_end_vertex = vertex.m_this;
+        }
+        vertex.m_particles_out.reserve(graph.out_offsets[v + 1] - graph.out_offsets[v]);
+        for (int k2 = graph.out_offsets[v]; k2 < graph.out_offsets[v + 1]; ++k2) {
+            int i = graph.out[k2];
+            vertex.m_particles_out.push_back(hepevt_particles[i]);
+            (*hepevt_particles[i]).m_production_vertex = vertex.m_this;
         }
     }
 
-    // Reserve memory for the event
-    evt->reserve( hepevt_particles.size(), vertex_cache.size() );
-
-    // Here we assume that the first two particles are the beam particles
-    vector<GenParticlePtr> beam_particles;
-    beam_particles.push_back(hepevt_particles[0]);
-    beam_particles.push_back(hepevt_particles[1]);
-
-    // Add particles and vertices in topological order
-    evt->add_tree( beam_particles );
+    GenVertex& root_vertex = *evt->m_rootvertex;
+    for (size_t k = 0; k < root_particles.size(); ++k) {
+        GenParticlePtr& p = hepevt_particles[root_particles[k]];
+        root_vertex.m_particles_out.push_back(p);
+        (*p).m_production_vertex = root_vertex.m_this;
+    }
 
 /*
     evt->set_beam_particles( hepevt_particles[1], hepevt_particles[2] );
@@ -109,29 +290,16 @@ bool Pythia8ToHepMC3::fill_next_event( Pythia8::Event& pyev, GenEvent* evt, int
     // If hadronization switched on then no final coloured particles.
     bool doHadr = (pyset == 0) ? m_free_parton_warnings : pyset->flag("HadronLevel:all") && pyset->flag("HadronLevel:Hadronize");
 
-    // 4. Check for particles which come from nowhere, i.e. are without
-    // mothers or daughters. These need to be attached to a vertex, or else
-    // they will never become part of the event.
-    for (int i = 1; i < pyev.size(); ++i) {
-
-        // Check for particles not added to the event
-        // NOTE: We have to check if this step makes any sense in HepMC event standard
-        if ( !hepevt_particles[i] ) {
-            std::cerr << "hanging particle " << i << std::endl;
-
-            GenVertexPtr prod_vtx;
-
-            prod_vtx->add_particle_out( hepevt_particles[i] );
-            evt->add_vertex(prod_vtx);
-        }
-
-        // Also check for free partons (= gluons and quarks; not diquarks?).
-        if ( doHadr && m_free_parton_warnings ) {
-            if ( hepevt_particles[i]->pid() == 21 && !hepevt_particles[i]->end_vertex() ) {
+    // Check for free partons (= gluons and quarks; not diquarks?).
+    // Particles that are not reachable from the beams are not part of the
+    // event.
+    if ( doHadr && m_free_parton_warnings ) {
+        for (int i = 1; i < n; ++i) {
+            if ( pyev[i].id() == 21 && graph.end_vertex[i] < 0 ) {
                 std::cerr << "gluon without end vertex " << i << std::endl;
                 if ( m_crash_on_problem ) exit(1);
             }
-            if ( abs(hepevt_particles[i]->pid()) <= 6 && !hepevt_particles[i]->end_vertex() ) {
+            if ( abs(pyev[i].id()) <= 6 && graph.end_vertex[i] < 0 ) {
                 std::cerr << "quark without end vertex " << i << std::endl;
                 if ( m_crash_on_problem ) exit(1);
             }
@@ -16,6 +16,8 @@
 #include "HepMC/GenVertex.h"
 #include "HepMC/GenParticle.h"
 
+#include <utility>
+
 namespace HepMC {
 
 
@@ -40,12 +42,12 @@ FindParticles::FindParticles(const GenParticlePtr &p, FilterParticle filter_type
         case FIND_ALL_ANCESTORS:
             if( !p->production_vertex() ) break;
 
-            recursive_check_ancestors( p->production_vertex(), filter_list );
+            check_ancestors( p->production_vertex(), filter_list );
             break;
         case FIND_ALL_DESCENDANTS:
             if( !p->end_vertex() ) break;
 
-            recursive_check_descendants( p->end_vertex(), filter_list );
+            check_descendants( p->end_vertex(), filter_list );
             break;
         case FIND_MOTHERS:
             if( !p->production_vertex() ) break;
@@ -85,10 +87,10 @@ FindParticles::FindParticles(const GenVertexPtr &v, FilterParticle filter_type,
 
     switch(filter_type) {
         case FIND_ALL_ANCESTORS:
-            recursive_check_ancestors( v, filter_list );
+            check_ancestors( v, filter_list );
             break;
         case FIND_ALL_DESCENDANTS:
-            recursive_check_descendants( v, filter_list );
+            check_descendants( v, filter_list );
             break;
         case FIND_MOTHERS:
             FOREACH( const GenParticlePtr &p_in, v->particles_in() ) {
@@ -144,41 +146,87 @@ bool FindParticles::passed_all_filters(const GenParticlePtr &p, FilterList &filt
     return true;
 }
 
-void FindParticles::recursive_check_ancestors(const GenVertexPtr &v, FilterList &filter_list) {
+// ADDED FOR NUMPYTHIA: iterative traversals visiting the particles in the
+// same order as the former recursive implementation
+void FindParticles::check_ancestors(const GenVertexPtr &v, FilterList &filter_list) {
 
-    FOREACH( const GenVertexPtr &v_list, m_checked_vertices ) {
-        if( v_list->id() == v->id() ) return;
-    }
+    if( !mark_checked(v) ) return;
+
+    // stack of vertices and the index of their next incoming particle
+    vector< std::pair<GenVertexPtr, size_t> > stack;
+    stack.push_back( std::make_pair(v, 0) );
 
-    m_checked_vertices.push_back(v);
+    while( !stack.empty() ) {
+        const vector<GenParticlePtr> &particles = (*stack.back().first).particles_in();
+        size_t next = stack.back().second++;
 
-    FOREACH( const GenParticlePtr &p_in, v->particles_in() ) {
+        if( next == particles.size() ) {
+            stack.pop_back();
+            continue;
+        }
+
+        const GenParticlePtr &p_in = particles[next];
 
         if( passed_all_filters(p_in,filter_list) ) {
             m_results.push_back(p_in);
         }
 
-        if( !p_in->production_vertex() ) continue;
-        recursive_check_ancestors( p_in->production_vertex(), filter_list );
+        if( !(*p_in).has_production_vertex() ) continue;
+
+        const GenVertexPtr production_vertex = (*p_in).production_vertex();
+        if( mark_checked(production_vertex) ) stack.push_back( std::make_pair(production_vertex, 0) );
     }
 }
 
-void FindParticles::recursive_check_descendants(const GenVertexPtr &v, FilterList &filter_list) {
+void FindParticles::check_descendants(const GenVertexPtr &v, FilterList &filter_list) {
 
-    FOREACH( const GenVertexPtr &v_list, m_checked_vertices ) {
-        if( v_list->id() == v->id() ) return;
-    }
+    if( !mark_checked(v) ) return;
+
+    // stack of vertices and the index of their next outgoing particle
+    vector< std::pair<GenVertexPtr, size_t> > stack;
+    stack.push_back( std::make_pair(v, 0) );
+
+    while( !stack.empty() ) {
+        const vector<GenParticlePtr> &particles = (*stack.back().first).particles_out();
+        size_t next = stack.back().second++;
+
+        if( next == particles.size() ) {
+            stack.pop_back();
+            continue;
+        }
 
-    m_checked_vertices.push_back(v);
+        const GenParticlePtr &p_out = particles[next];
 
-    FOREACH( const GenParticlePtr &p_out, v->particles_out() ) {
         if( passed_all_filters(p_out,filter_list) ) {
             m_results.push_back(p_out);
         }
 
-        if( !p_out->end_vertex() ) continue;
-        recursive_check_descendants( p_out->end_vertex(), filter_list );
+        if( !(*p_out).has_end_vertex() ) continue;
+
+        const GenVertexPtr end_vertex = (*p_out).end_vertex();
+        if( mark_checked(end_vertex) ) stack.push_back( std::make_pair(end_vertex, 0) );
+    }
+}
+
+bool FindParticles::mark_checked(const GenVertexPtr &v) {
+
+    // vertices of an event have ids -1, -2, ...
+    int id = (*v).id();
+
+    if( id < 0 ) {
+        size_t index = -(id + 1);
+        if( index >= m_checked_vertices.size() ) m_checked_vertices.resize( 2 * index + 1, false );
+        if( m_checked_vertices[index] ) return false;
+        m_checked_vertices[index] = true;
+        return true;
+    }
+
+    FOREACH( const GenVertexPtr &v_list, m_checked_detached_vertices ) {
+        if( v_list == v ) return false;
     }
+
+    m_checked_detached_vertices.push_back(v);
+    return true;
 }
 
 } // namespace HepMC
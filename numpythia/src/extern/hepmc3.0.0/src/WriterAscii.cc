@@ -15,14 +15,283 @@
 #include "HepMC/GenVertex.h"
 #include "HepMC/Units.h"
 #include <cstring>
+#include <cmath>
+#include <stdint.h>
 
 namespace HepMC {
 
+// ADDED FOR NUMPYTHIA: number formatting without sprintf. Doubles are
+// written with the Grisu2 algorithm (F. Loitsch, "Printing floating-point
+// numbers quickly and accurately with integers", PLDI 2010) as decimal
+// digits that always read back to the same value, which is as exact as the
+// former %.16e format. Without Grisu3's exact fallback the digits are the
+// shortest for all but about 0.1% of values, which get one digit more
+// (e.g. 1e23 is written as 9.999999999999999e+22).
+namespace {
+
+struct DiyFp {
+    uint64_t f;
+    int e;
+    DiyFp(uint64_t f_, int e_): f(f_), e(e_) {}
+};
+
+struct CachedPower {
+    uint64_t f;
+    int e;
+    int k;
+};
+
+// Normalized 64 bit approximations of 10^k for k = -300, -292, ..., 324
+const CachedPower CACHED_POWERS[] = {
+    { 0xAB70FE17C79AC6CAULL, -1060, -300 },
+    { 0xFF77B1FCBEBCDC4FULL, -1034, -292 },
+    { 0xBE5691EF416BD60CULL, -1007, -284 },
+    { 0x8DD01FAD907FFC3CULL,  -980, -276 },
+    { 0xD3515C2831559A83ULL,  -954, -268 },
+    { 0x9D71AC8FADA6C9B5ULL,  -927, -260 },
+    { 0xEA9C227723EE8BCBULL,  -901, -252 },
+    { 0xAECC49914078536DULL,  -874, -244 },
+    { 0x823C12795DB6CE57ULL,  -847, -236 },
+    { 0xC21094364DFB5637ULL,  -821, -228 },
+    { 0x9096EA6F3848984FULL,  -794, -220 },
+    { 0xD77485CB25823AC7ULL,  -768, -212 },
+    { 0xA086CFCD97BF97F4ULL,  -741, -204 },
+    { 0xEF340A98172AACE5ULL,  -715, -196 },
+    { 0xB23867FB2A35B28EULL,  -688, -188 },
+    { 0x84C8D4DFD2C63F3BULL,  -661, -180 },
+    { 0xC5DD44271AD3CDBAULL,  -635, -172 },
+    { 0x936B9FCEBB25C996ULL,  -608, -164 },
+    { 0xDBAC6C247D62A584ULL,  -582, -156 },
+    { 0xA3AB66580D5FDAF6ULL,  -555, -148 },
+    { 0xF3E2F893DEC3F126ULL,  -529, -140 },
+    { 0xB5B5ADA8AAFF80B8ULL,  -502, -132 },
+    { 0x87625F056C7C4A8BULL,  -475, -124 },
+    { 0xC9BCFF6034C13053ULL,  -449, -116 },
+    { 0x964E858C91BA2655ULL,  -422, -108 },
+    { 0xDFF9772470297EBDULL,  -396, -100 },
+    { 0xA6DFBD9FB8E5B88FULL,  -369,  -92 },
+    { 0xF8A95FCF88747D94ULL,  -343,  -84 },
+    { 0xB94470938FA89BCFULL,  -316,  -76 },
+    { 0x8A08F0F8BF0F156BULL,  -289,  -68 },
+    { 0xCDB02555653131B6ULL,  -263,  -60 },
+    { 0x993FE2C6D07B7FACULL,  -236,  -52 },
+    { 0xE45C10C42A2B3B06ULL,  -210,  -44 },
+    { 0xAA242499697392D3ULL,  -183,  -36 },
+    { 0xFD87B5F28300CA0EULL,  -157,  -28 },
+    { 0xBCE5086492111AEBULL,  -130,  -20 },
+    { 0x8CBCCC096F5088CCULL,  -103,  -12 },
+    { 0xD1B71758E219652CULL,   -77,   -4 },
+    { 0x9C40000000000000ULL,   -50,    4 },
+    { 0xE8D4A51000000000ULL,   -24,   12 },
+    { 0xAD78EBC5AC620000ULL,     3,   20 },
+    { 0x813F3978F8940984ULL,    30,   28 },
+    { 0xC097CE7BC90715B3ULL,    56,   36 },
+    { 0x8F7E32CE7BEA5C70ULL,    83,   44 },
+    { 0xD5D238A4ABE98068ULL,   109,   52 },
+    { 0x9F4F2726179A2245ULL,   136,   60 },
+    { 0xED63A231D4C4FB27ULL,   162,   68 },
+    { 0xB0DE65388CC8ADA8ULL,   189,   76 },
+    { 0x83C7088E1AAB65DBULL,   216,   84 },
+    { 0xC45D1DF942711D9AULL,   242,   92 },
+    { 0x924D692CA61BE758ULL,   269,  100 },
+    { 0xDA01EE641A708DEAULL,   295,  108 },
+    { 0xA26DA3999AEF774AULL,   322,  116 },
+    { 0xF209787BB47D6B85ULL,   348,  124 },
+    { 0xB454E4A179DD1877ULL,   375,  132 },
+    { 0x865B86925B9BC5C2ULL,   402,  140 },
+    { 0xC83553C5C8965D3DULL,   428,  148 },
+    { 0x952AB45CFA97A0B3ULL,   455,  156 },
+    { 0xDE469FBD99A05FE3ULL,   481,  164 },
+    { 0xA59BC234DB398C25ULL,   508,  172 },
+    { 0xF6C69A72A3989F5CULL,   534,  180 },
+    { 0xB7DCBF5354E9BECEULL,   561,  188 },
+    { 0x88FCF317F22241E2ULL,   588,  196 },
+    { 0xCC20CE9BD35C78A5ULL,   614,  204 },
+    { 0x98165AF37B2153DFULL,   641,  212 },
+    { 0xE2A0B5DC971F303AULL,   667,  220 },
+    { 0xA8D9D1535CE3B396ULL,   694,  228 },
+    { 0xFB9B7CD9A4A7443CULL,   720,  236 },
+    { 0xBB764C4CA7A44410ULL,   747,  244 },
+    { 0x8BAB8EEFB6409C1AULL,   774,  252 },
+    { 0xD01FEF10A657842CULL,   800,  260 },
+    { 0x9B10A4E5E9913129ULL,   827,  268 },
+    { 0xE7109BFBA19C0C9DULL,   853,  276 },
+    { 0xAC2820D9623BF429ULL,   880,  284 },
+    { 0x80444B5E7AA7CF85ULL,   907,  292 },
+    { 0xBF21E44003ACDD2DULL,   933,  300 },
+    { 0x8E679C2F5E44FF8FULL,   960,  308 },
+    { 0xD433179D9C8CB841ULL,   986,  316 },
+    { 0x9E19DB92B4E31BA9ULL,  1013,  324 },
+};
+
+// Upper 64 bits of the product, rounded on the highest bit of the lower 64
+inline DiyFp diyfp_multiply(const DiyFp &x, const DiyFp &y) {
+#ifdef __SIZEOF_INT128__
+    unsigned __int128 product = (unsigned __int128) x.f * y.f;
+    uint64_t high = (uint64_t) (product >> 64);
+    uint64_t low = (uint64_t) product;
+    return DiyFp(high + (low >> 63), x.e + y.e + 64);
+#else
+    const uint64_t mask = 0xFFFFFFFFULL;
+    uint64_t a = x.f >> 32, b = x.f & mask, c = y.f >> 32, d = y.f & mask;
+    uint64_t ac = a * c, bc = b * c, ad = a * d, bd = b * d;
+    uint64_t middle = (bd >> 32) + (ad & mask) + (bc & mask) + (1ULL << 31);
+    return DiyFp(ac + (ad >> 32) + (bc >> 32) + (middle >> 32), x.e + y.e + 64);
+#endif
+}
+
+inline DiyFp diyfp_normalize(DiyFp x) {
+#ifdef __SIZEOF_INT128__
+    int shift = __builtin_clzll(x.f);
+#else
+    int shift = 0;
+    while ( !((x.f << shift) & (1ULL << 63)) ) ++shift;
+#endif
+    return DiyFp(x.f << shift, x.e - shift);
+}
+
+inline void grisu2_round(char *digits, int length, uint64_t distance, uint64_t delta,
+                         uint64_t rest, uint64_t ten_k) {
+    // Move the last digit towards the exact value while staying in the
+    // rounding interval
+    while ( rest < distance && delta - rest >= ten_k &&
+            ( rest + ten_k < distance || distance - rest > rest + ten_k - distance ) ) {
+        --digits[length - 1];
+        rest += ten_k;
+    }
+}
+
+// Shortest digits of a positive finite value, which is digits * 10^exponent.
+// Returns the number of digits.
+int grisu2_digits(double value, char *digits, int &exponent) {
+    uint64_t bits;
+    memcpy(&bits, &value, sizeof(bits));
+    uint64_t fraction = bits & ((1ULL << 52) - 1);
+    int biased_exponent = (int) (bits >> 52) & 0x7FF;
+
+    // Value and the boundaries of its rounding interval
+    DiyFp v = biased_exponent == 0 ? DiyFp(fraction, 1 - 1075)
+                                   : DiyFp(fraction | (1ULL << 52), biased_exponent - 1075);
+    bool closer_lower_boundary = fraction == 0 && biased_exponent > 1;
+    DiyFp plus = diyfp_normalize(DiyFp(2 * v.f + 1, v.e - 1));
+    DiyFp minus = closer_lower_boundary ? DiyFp(4 * v.f - 1, v.e - 2) : DiyFp(2 * v.f - 1, v.e - 1);
+    minus = DiyFp(minus.f << (minus.e - plus.e), plus.e);
+    v = diyfp_normalize(v);
+
+    // Scale by a cached power of ten so that the binary exponent of the
+    // upper boundary is in [-60, -32]
+    int f = -60 - plus.e - 1;
+    int k = (f * 78913) / (1 << 18) + (f > 0);
+    const CachedPower &cached = CACHED_POWERS[(300 + k + 7) / 8];
+    DiyFp c(cached.f, cached.e);
+    DiyFp w = diyfp_multiply(v, c);
+    DiyFp w_minus = diyfp_multiply(minus, c);
+    DiyFp w_plus = diyfp_multiply(plus, c);
+    w_minus.f += 1;
+    w_plus.f -= 1;
+    exponent = -cached.k;
+
+    uint64_t delta = w_plus.f - w_minus.f;
+    uint64_t distance = w_plus.f - w.f;
+    int shift = -w_plus.e;
+    uint64_t one = 1ULL << shift;
+    uint32_t integral = (uint32_t) (w_plus.f >> shift);
+    uint64_t fractional = w_plus.f & (one - 1);
+
+    // Digits of the integral part
+    uint32_t power = 1000000000;
+    int n = 10;
+    while ( n > 1 && integral < power ) {
+        power /= 10;
+        --n;
+    }
+    int length = 0;
+    while ( n > 0 ) {
+        digits[length++] = (char) ('0' + integral / power);
+        integral %= power;
+        --n;
+        uint64_t rest = ((uint64_t) integral << shift) + fractional;
+        if ( rest <= delta ) {
+            exponent += n;
+            grisu2_round(digits, length, distance, delta, rest, (uint64_t) power << shift);
+            return length;
+        }
+        power /= 10;
+    }
+
+    // Digits of the fractional part
+    int m = 0;
+    for (;;) {
+        fractional *= 10;
+        digits[length++] = (char) ('0' + (fractional >> shift));
+        fractional &= one - 1;
+        ++m;
+        delta *= 10;
+        distance *= 10;
+        if ( fractional <= delta ) break;
+    }
+    exponent -= m;
+    grisu2_round(digits, length, distance, delta, fractional, one);
+    return length;
+}
+
+inline char *write_unsigned(char *cursor, unsigned long value) {
+    char digits[24];
+    int n = 0;
+    do {
+        digits[n++] = (char) ('0' + value % 10);
+        value /= 10;
+    } while ( value );
+    while ( n ) *cursor++ = digits[--n];
+    return cursor;
+}
+
+inline char *write_int(char *cursor, long value) {
+    if ( value < 0 ) {
+        *cursor++ = '-';
+        return write_unsigned(cursor, 0UL - (unsigned long) value);
+    }
+    return write_unsigned(cursor, value);
+}
+
+// Write value in scientific notation, with the shortest round trip digits
+// if precision is 0 or as "%.*e" with the given precision otherwise
+char *write_double(char *cursor, double value, int precision) {
+    if ( precision > 0 || !std::isfinite(value) ) {
+        return cursor + sprintf(cursor, "%.*e", precision > 0 ? precision : 16, value);
+    }
+    if ( std::signbit(value) ) {
+        *cursor++ = '-';
+        value = -value;
+    }
+    if ( value == 0 ) {
+        memcpy(cursor, "0e+00", 5);
+        return cursor + 5;
+    }
+    char digits[24];
+    int exponent;
+    int length = grisu2_digits(value, digits, exponent);
+    *cursor++ = digits[0];
+    if ( length > 1 ) {
+        *cursor++ = '.';
+        memcpy(cursor, digits + 1, length - 1);
+        cursor += length - 1;
+    }
+    exponent += length - 1;
+    *cursor++ = 'e';
+    *cursor++ = exponent < 0 ? '-' : '+';
+    if ( exponent < 0 ) exponent = -exponent;
+    if ( exponent < 10 ) *cursor++ = '0';
+    return write_unsigned(cursor, exponent);
+}
+
+} // namespace
+
 
 WriterAscii::WriterAscii(const std::string &filename, shared_ptr<GenRunInfo> run)
   : m_file(filename),
     m_stream(&m_file),
-    m_precision(16),
+    m_precision(0),
     m_buffer(NULL),
     m_cursor(NULL),
     m_buffer_size( 256*1024 )
@@ -41,7 +310,7 @@ WriterAscii::WriterAscii(const std::string &filename, shared_ptr<GenRunInfo> run
 WriterAscii::WriterAscii(std::ostream &stream, shared_ptr<GenRunInfo> run)
   : m_file(),
     m_stream(&stream),
-    m_precision(16),
+    m_precision(0),
     m_buffer(NULL),
     m_cursor(NULL),
     m_buffer_size( 256*1024 )
@@ -86,23 +355,23 @@ void WriterAscii::write_event(const GenEvent &evt) {
     }
 
     // Write event info
-    m_cursor += sprintf(m_cursor, "E %d %lu %lu", evt.event_number(), evt.vertices().size(), evt.particles().size());
-    flush();
+    *m_cursor++ = 'E';
+    *m_cursor++ = ' ';
+    m_cursor = write_int(m_cursor, evt.event_number());
+    *m_cursor++ = ' ';
+    m_cursor = write_unsigned(m_cursor, evt.vertices().size());
+    *m_cursor++ = ' ';
+    m_cursor = write_unsigned(m_cursor, evt.particles().size());
 
     // Write event position if not zero
     const FourVector &pos = evt.event_pos();
     if ( !pos.is_zero() ) {
-        m_cursor += sprintf(m_cursor," @ %.*e",m_precision,pos.x());
-        flush();
-        m_cursor += sprintf(m_cursor," %.*e",  m_precision,pos.y());
-        flush();
-        m_cursor += sprintf(m_cursor," %.*e",  m_precision,pos.z());
-        flush();
-        m_cursor += sprintf(m_cursor," %.*e",  m_precision,pos.t());
-        flush();
+        *m_cursor++ = ' ';
+        *m_cursor++ = '@';
+        write_position(pos);
     }
 
-    m_cursor += sprintf(m_cursor,"\n");
+    *m_cursor++ = '\n';
     flush();
 
     // Write units
@@ -118,22 +387,21 @@ void WriterAscii::write_event(const GenEvent &evt) {
       flush();
     }
 
-    // Write attributes
-    typedef map< string, map<int, shared_ptr<Attribute> > >::value_type value_type1;
-    typedef map<int, shared_ptr<Attribute> >::value_type                value_type2;
-    FOREACH ( const value_type1& vt1, evt.attributes() ) {
-        FOREACH ( const value_type2& vt2, vt1.second ) {
+    // Write attributes. ADDED FOR NUMPYTHIA: in order of name as before
+    FOREACH ( int key, evt.attribute_keys() ) {
+        const string &name = GenRunInfo::attribute_name(key);
+        FOREACH ( const GenEvent::AttributeColumn::value_type& vt2, evt.attributes()[key] ) {
 
             string st;
             /// @todo This would be nicer as a return value of string & throw exception if there's a conversion problem...
             bool status = vt2.second->to_string(st);
 
             if( !status ) {
-                WARNING( "WriterAscii::write_event: problem serializing attribute: "<<vt1.first )
+                WARNING( "WriterAscii::write_event: problem serializing attribute: "<<name )
             }
             else {
                 m_cursor +=
-                  sprintf(m_cursor, "A %i %s ",vt2.first,vt1.first.c_str());
+                  sprintf(m_cursor, "A %i %s ",vt2.first,name.c_str());
                 flush();
                 write_string(escape(st));
                 m_cursor += sprintf(m_cursor, "\n");
@@ -208,46 +476,60 @@ string WriterAscii::escape(const string s) {
 
 void WriterAscii::write_vertex(const GenVertexPtr &v) {
 
-    m_cursor += sprintf( m_cursor, "V %i %i [",v->id(),v->status() );
-    flush();
+    const GenVertex &vertex = *v;
+
+    // ADDED FOR NUMPYTHIA: fields are written without sprintf and the
+    // buffer is only checked once per particle id and once per line
+    *m_cursor++ = 'V';
+    *m_cursor++ = ' ';
+    m_cursor = write_int(m_cursor, vertex.id());
+    *m_cursor++ = ' ';
+    m_cursor = write_int(m_cursor, vertex.status());
+    *m_cursor++ = ' ';
+    *m_cursor++ = '[';
 
     bool printed_first = false;
 
-    FOREACH( const GenParticlePtr &p, v->particles_in() ) {
+    FOREACH( const GenParticlePtr &p, vertex.particles_in() ) {
 
-        if ( !printed_first ) {
-            m_cursor  += sprintf(m_cursor,"%i", p->id());
-            printed_first = true;
-        }
-        else m_cursor += sprintf(m_cursor,",%i",p->id());
+        if ( printed_first ) *m_cursor++ = ',';
+        printed_first = true;
+        m_cursor = write_int(m_cursor, (*p).id());
 
         flush();
     }
 
-    const FourVector &pos = v->position();
+    *m_cursor++ = ']';
+    const FourVector &pos = vertex.position();
     if ( !pos.is_zero() ) {
-        m_cursor += sprintf(m_cursor,"] @ %.*e",m_precision,pos.x());
-        flush();
-        m_cursor += sprintf(m_cursor," %.*e",   m_precision,pos.y());
-        flush();
-        m_cursor += sprintf(m_cursor," %.*e",   m_precision,pos.z());
-        flush();
-        m_cursor += sprintf(m_cursor," %.*e\n", m_precision,pos.t());
-        flush();
-    }
-    else {
-        m_cursor += sprintf(m_cursor,"]\n");
-        flush();
+        *m_cursor++ = ' ';
+        *m_cursor++ = '@';
+        write_position(pos);
     }
+    *m_cursor++ = '\n';
+    flush();
+}
+
+
+void WriterAscii::write_position(const FourVector &pos) {
+    *m_cursor++ = ' ';
+    m_cursor = write_double(m_cursor, pos.x(), m_precision);
+    *m_cursor++ = ' ';
+    m_cursor = write_double(m_cursor, pos.y(), m_precision);
+    *m_cursor++ = ' ';
+    m_cursor = write_double(m_cursor, pos.z(), m_precision);
+    *m_cursor++ = ' ';
+    m_cursor = write_double(m_cursor, pos.t(), m_precision);
 }
 
 
 inline void WriterAscii::flush() {
-    // The maximum size of single add to the buffer (other than by
-    // using WriterAscii::write) is 32 bytes. This is a safe value as
-    // we will not allow precision larger than 24 anyway
+    // ADDED FOR NUMPYTHIA: the maximum size added to the buffer between
+    // two calls (other than by using WriterAscii::write_string) is one
+    // particle or vertex position line of at most 256 bytes. This is a safe
+    // value as we will not allow precision larger than 24 anyway
     unsigned long length = m_cursor - m_buffer;
-    if ( m_buffer_size - length < 32 ) {
+    if ( m_buffer_size - length < 256 ) {
         // m_file.write( m_buffer, length );
         m_stream->write( m_buffer, length );
         m_cursor = m_buffer;
@@ -308,24 +590,29 @@ void WriterAscii::write_run_info() {
 
 void WriterAscii::write_particle(const GenParticlePtr &p, int second_field) {
 
-    m_cursor += sprintf(m_cursor,"P %i",p->id());
-    flush();
-
-    m_cursor += sprintf(m_cursor," %i",   second_field);
-    flush();
-    m_cursor += sprintf(m_cursor," %i",   p->pid() );
-    flush();
-    m_cursor += sprintf(m_cursor," %.*e", m_precision,p->momentum().px() );
-    flush();
-    m_cursor += sprintf(m_cursor," %.*e", m_precision,p->momentum().py());
-    flush();
-    m_cursor += sprintf(m_cursor," %.*e", m_precision,p->momentum().pz() );
-    flush();
-    m_cursor += sprintf(m_cursor," %.*e", m_precision,p->momentum().e() );
-    flush();
-    m_cursor += sprintf(m_cursor," %.*e", m_precision,p->generated_mass() );
-    flush();
-    m_cursor += sprintf(m_cursor," %i\n", p->status() );
+    const GenParticle &particle = *p;
+    const FourVector &momentum = particle.momentum();
+
+    *m_cursor++ = 'P';
+    *m_cursor++ = ' ';
+    m_cursor = write_int(m_cursor, particle.id());
+    *m_cursor++ = ' ';
+    m_cursor = write_int(m_cursor, second_field);
+    *m_cursor++ = ' ';
+    m_cursor = write_int(m_cursor, particle.pid());
+    *m_cursor++ = ' ';
+    m_cursor = write_double(m_cursor, momentum.px(), m_precision);
+    *m_cursor++ = ' ';
+    m_cursor = write_double(m_cursor, momentum.py(), m_precision);
+    *m_cursor++ = ' ';
+    m_cursor = write_double(m_cursor, momentum.pz(), m_precision);
+    *m_cursor++ = ' ';
+    m_cursor = write_double(m_cursor, momentum.e(), m_precision);
+    *m_cursor++ = ' ';
+    m_cursor = write_double(m_cursor, particle.generated_mass(), m_precision);
+    *m_cursor++ = ' ';
+    m_cursor = write_int(m_cursor, particle.status());
+    *m_cursor++ = '\n';
     flush();
 }
 
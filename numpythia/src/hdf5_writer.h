@@ -0,0 +1,289 @@
+#ifndef NUMPYTHIA_HDF5_WRITER_H
+#define NUMPYTHIA_HDF5_WRITER_H
+
+#include <string>
+#include <vector>
+#include <cstring>
+
+#ifdef NUMPYTHIA_HDF5
+#include <hdf5.h>
+#endif
+
+
+// Status codes of the HDF5 writer
+enum Hdf5Status {
+    HDF5_OK = 0,
+    HDF5_SYSTEM_ERROR,
+    HDF5_UNSUPPORTED,
+    HDF5_SHAPE_ERROR
+};
+
+
+// Whether support for HDF5 was compiled in
+inline bool hdf5_supported() {
+#ifdef NUMPYTHIA_HDF5
+    return true;
+#else
+    return false;
+#endif
+}
+
+
+// Fields of a DTYPE_PARTICLE row: 14 doubles followed by pdgid and status.
+// WriterHDF5 in _libnumpythia.pyx checks this layout against DTYPE_PARTICLE.
+static const char* const HDF5_PARTICLE_FIELDS[] = {
+    "E", "px", "py", "pz", "pT", "mass", "rap", "eta", "theta", "phi",
+    "prodx", "prody", "prodz", "prodt", "pdgid", "status"
+};
+static const unsigned int HDF5_PARTICLE_NFIELDS = sizeof(HDF5_PARTICLE_FIELDS) / sizeof(HDF5_PARTICLE_FIELDS[0]);
+static const unsigned int HDF5_PARTICLE_DOUBLES = 14;
+static const unsigned int HDF5_PARTICLE_ROWBYTES = HDF5_PARTICLE_DOUBLES * sizeof(double) + 2 * sizeof(int);
+
+
+// Byte offset of field i in a DTYPE_PARTICLE row
+inline size_t hdf5_particle_offset(unsigned int i) {
+    if (i <= HDF5_PARTICLE_DOUBLES) {
+        return i * sizeof(double);
+    }
+    return HDF5_PARTICLE_DOUBLES * sizeof(double) + (i - HDF5_PARTICLE_DOUBLES) * sizeof(int);
+}
+
+
+// Writer of events to an HDF5 file of three extendible, chunked datasets:
+//
+//   particles  DTYPE_PARTICLE rows of all events
+//   offsets    int64, event i is particles[offsets[i]:offsets[i + 1]]
+//   weights    float64 matrix with one row of weights per event
+//
+// Events are buffered and appended to the datasets a chunk at a time. The
+// chunks are compressed with shuffle and deflate if compression_level > 0
+// and each dataset gets a chunk cache of cache_bytes. All events must have
+// the same number of weights.
+class WriterHDF5 {
+  public:
+    WriterHDF5(): chunk_size(0), nevents(0), nparticles(0), nweights(0), has_weights(false) {
+#ifdef NUMPYTHIA_HDF5
+        file = particles = offsets = weights = -1;
+#endif
+    }
+
+    ~WriterHDF5() {
+        close();
+    }
+
+    int open(const std::string& filename, size_t chunk_size_, int compression_level, size_t cache_bytes) {
+#ifdef NUMPYTHIA_HDF5
+        chunk_size = chunk_size_;
+        nevents = nparticles = nweights = 0;
+        has_weights = false;
+        rows.clear();
+        pending_offsets.clear();
+        pending_weights.clear();
+        file = H5Fcreate(filename.c_str(), H5F_ACC_TRUNC, H5P_DEFAULT, H5P_DEFAULT);
+        if (file < 0) {
+            return HDF5_SYSTEM_ERROR;
+        }
+        hid_t row_type = particle_type();
+        particles = create_dataset("particles", row_type, 1, chunk_size, compression_level, cache_bytes);
+        H5Tclose(row_type);
+        offsets = create_dataset("offsets", H5T_NATIVE_LLONG, 1, chunk_size, compression_level, cache_bytes);
+        weights = create_dataset("weights", H5T_NATIVE_DOUBLE, 2, chunk_size, compression_level, cache_bytes);
+        if (particles < 0 || offsets < 0 || weights < 0) {
+            close();
+            return HDF5_SYSTEM_ERROR;
+        }
+        long long zero = 0;
+        if (!append(offsets, H5T_NATIVE_LLONG, 1, 0, 1, 1, &zero)) {
+            close();
+            return HDF5_SYSTEM_ERROR;
+        }
+        return HDF5_OK;
+#else
+        return HDF5_UNSUPPORTED;
+#endif
+    }
+
+    // Append one event of nrows DTYPE_PARTICLE rows
+    int write_event(const char* event_rows, size_t nrows, const double* event_weights, size_t event_nweights) {
+        long long event_offsets[2] = {0, (long long) nrows};
+        return write_batch(event_rows, event_offsets, 1, event_weights, event_nweights);
+    }
+
+    // Append nevents_ events as returned by pythia_generate_batch: event i
+    // spans rows [event_offsets[i], event_offsets[i + 1]) and its weights
+    // are event_weights[i * event_nweights:(i + 1) * event_nweights]
+    int write_batch(const char* event_rows, const long long* event_offsets, size_t nevents_,
+                    const double* event_weights, size_t event_nweights) {
+        if (has_weights) {
+            if (event_nweights != nweights) {
+                return HDF5_SHAPE_ERROR;
+            }
+        } else {
+            nweights = event_nweights;
+            has_weights = true;
+        }
+        long long first = event_offsets[0];
+        long long end = event_offsets[nevents_];
+        long long base = nparticles + rows.size() / HDF5_PARTICLE_ROWBYTES - first;
+        rows.insert(rows.end(), event_rows + first * HDF5_PARTICLE_ROWBYTES,
+                    event_rows + end * HDF5_PARTICLE_ROWBYTES);
+        for (size_t ievent = 1; ievent <= nevents_; ++ievent) {
+            pending_offsets.push_back(base + event_offsets[ievent]);
+        }
+        pending_weights.insert(pending_weights.end(), event_weights, event_weights + nevents_ * nweights);
+        if (rows.size() >= chunk_size * HDF5_PARTICLE_ROWBYTES || pending_offsets.size() >= chunk_size) {
+            return append_pending();
+        }
+        return HDF5_OK;
+    }
+
+    // Append the buffered events to the datasets and flush the file to disk
+    int flush() {
+#ifdef NUMPYTHIA_HDF5
+        int status = append_pending();
+        if (status != HDF5_OK) {
+            return status;
+        }
+        return H5Fflush(file, H5F_SCOPE_LOCAL) < 0 ? HDF5_SYSTEM_ERROR : HDF5_OK;
+#else
+        return HDF5_UNSUPPORTED;
+#endif
+    }
+
+    int close() {
+#ifdef NUMPYTHIA_HDF5
+        if (file < 0) {
+            return HDF5_OK;
+        }
+        // closing the file flushes it
+        int status = append_pending();
+        hid_t* handles[3] = {&particles, &offsets, &weights};
+        for (int i = 0; i < 3; ++i) {
+            if (*handles[i] >= 0 && H5Dclose(*handles[i]) < 0) {
+                status = HDF5_SYSTEM_ERROR;
+            }
+            *handles[i] = -1;
+        }
+        if (H5Fclose(file) < 0) {
+            status = HDF5_SYSTEM_ERROR;
+        }
+        file = -1;
+        return status;
+#else
+        return HDF5_OK;
+#endif
+    }
+
+    // Number of events written or buffered
+    size_t size() const {
+        return nevents + pending_offsets.size();
+    }
+
+  private:
+    // Append the buffered events to the datasets. The chunk cache decides
+    // when the chunks are written to the file.
+    int append_pending() {
+#ifdef NUMPYTHIA_HDF5
+        if (file < 0) {
+            return HDF5_SYSTEM_ERROR;
+        }
+        size_t nrows = rows.size() / HDF5_PARTICLE_ROWBYTES;
+        size_t nnew = pending_offsets.size();
+        if (nrows > 0) {
+            hid_t row_type = particle_type();
+            bool ok = append(particles, row_type, 1, nparticles, nrows, 1, &rows[0]);
+            H5Tclose(row_type);
+            if (!ok) {
+                return HDF5_SYSTEM_ERROR;
+            }
+        }
+        if (nnew > 0) {
+            if (!append(offsets, H5T_NATIVE_LLONG, 1, nevents + 1, nnew, 1, &pending_offsets[0])) {
+                return HDF5_SYSTEM_ERROR;
+            }
+            if (!append(weights, H5T_NATIVE_DOUBLE, 2, nevents, nnew, nweights,
+                        pending_weights.empty() ? NULL : &pending_weights[0])) {
+                return HDF5_SYSTEM_ERROR;
+            }
+        }
+        nparticles += nrows;
+        nevents += nnew;
+        rows.clear();
+        pending_offsets.clear();
+        pending_weights.clear();
+        return HDF5_OK;
+#else
+        return HDF5_UNSUPPORTED;
+#endif
+    }
+
+#ifdef NUMPYTHIA_HDF5
+    static hid_t particle_type() {
+        hid_t type = H5Tcreate(H5T_COMPOUND, HDF5_PARTICLE_ROWBYTES);
+        for (unsigned int i = 0; i < HDF5_PARTICLE_NFIELDS; ++i) {
+            H5Tinsert(type, HDF5_PARTICLE_FIELDS[i], hdf5_particle_offset(i),
+                      i < HDF5_PARTICLE_DOUBLES ? H5T_NATIVE_DOUBLE : H5T_NATIVE_INT);
+        }
+        return type;
+    }
+
+    // An empty dataset that is extendible along its first dimension (and
+    // the second for the weights, whose number is only known later)
+    hid_t create_dataset(const char* name, hid_t type, int rank, size_t chunk_rows,
+                         int compression_level, size_t cache_bytes) {
+        hsize_t dims[2] = {0, 0};
+        hsize_t maxdims[2] = {H5S_UNLIMITED, H5S_UNLIMITED};
+        hsize_t chunk[2] = {chunk_rows, 1};
+        if (rank == 2) {
+            // chunks of a few weights of chunk_rows / 4 events
+            chunk[0] = chunk_rows / 4 > 0 ? chunk_rows / 4 : 1;
+            chunk[1] = 4;
+        }
+        hid_t space = H5Screate_simple(rank, dims, maxdims);
+        hid_t create = H5Pcreate(H5P_DATASET_CREATE);
+        hid_t access = H5Pcreate(H5P_DATASET_ACCESS);
+        H5Pset_chunk(create, rank, chunk);
+        if (compression_level > 0) {
+            H5Pset_shuffle(create);
+            H5Pset_deflate(create, compression_level);
+        }
+        H5Pset_chunk_cache(access, H5D_CHUNK_CACHE_NSLOTS_DEFAULT, cache_bytes, H5D_CHUNK_CACHE_W0_DEFAULT);
+        hid_t dataset = H5Dcreate2(file, name, type, space, H5P_DEFAULT, create, access);
+        H5Pclose(access);
+        H5Pclose(create);
+        H5Sclose(space);
+        return dataset;
+    }
+
+    // Write count rows of columns values at row start, growing the dataset
+    bool append(hid_t dataset, hid_t type, int rank, hsize_t start, hsize_t count, hsize_t columns,
+                const void* data) {
+        hsize_t dims[2] = {start + count, columns};
+        if (H5Dset_extent(dataset, dims) < 0) {
+            return false;
+        }
+        if (count * columns == 0) {
+            return true;
+        }
+        hsize_t offset[2] = {start, 0};
+        hsize_t size[2] = {count, columns};
+        hid_t file_space = H5Dget_space(dataset);
+        hid_t memory_space = H5Screate_simple(rank, size, NULL);
+        bool ok = H5Sselect_hyperslab(file_space, H5S_SELECT_SET, offset, NULL, size, NULL) >= 0 &&
+                  H5Dwrite(dataset, type, memory_space, file_space, H5P_DEFAULT, data) >= 0;
+        H5Sclose(memory_space);
+        H5Sclose(file_space);
+        return ok;
+    }
+
+    hid_t file, particles, offsets, weights;
+#endif
+    size_t chunk_size;
+    size_t nevents, nparticles, nweights;
+    bool has_weights;
+    std::vector<char> rows;
+    std::vector<long long> pending_offsets;
+    std::vector<double> pending_weights;
+};
+
+#endif // NUMPYTHIA_HDF5_WRITER_H
@@ -51,8 +51,10 @@ cdef extern from "HepMC/GenVertex.h" namespace "HepMC":
 
 cdef extern from "HepMC/GenParticle.h" namespace "HepMC":
     cdef cppclass GenParticle:
+        int id()
         int pid()
         int status()
+        GenEvent* parent_event()
         FourVector& momentum()
         SmartPointer[GenVertex] end_vertex()
         SmartPointer[GenVertex] production_vertex()
@@ -65,9 +67,23 @@ cdef extern from "HepMC/GenEvent.h" namespace "HepMC":
         vector[double] weights()
         vector[string] weight_names()
 
+cdef extern from "HepMC/Data/EventArena.h" namespace "HepMC":
+    cdef cppclass EventArenaPool:
+        EventArenaPool()
+        size_t size()
+
+cdef extern from "<istream>" namespace "std":
+    cdef cppclass istream:
+        pass
+
+cdef extern from "<ostream>" namespace "std":
+    cdef cppclass ostream:
+        pass
+
 cdef extern from "HepMC/ReaderAscii.h" namespace "HepMC":
     cdef cppclass ReaderAscii:
         ReaderAscii(string& filename)
+        ReaderAscii(istream&)
         bool read_event(GenEvent&)
         void close()
         bool failed()
@@ -75,8 +91,10 @@ cdef extern from "HepMC/ReaderAscii.h" namespace "HepMC":
 cdef extern from "HepMC/WriterAscii.h" namespace "HepMC":
     cdef cppclass WriterAscii:
         WriterAscii(string& filename)
+        WriterAscii(ostream&)
         void write_event(GenEvent&)
         void close()
+        void set_precision(size_t)
 
 cdef extern from "HepMC/Search/FilterBase.h" namespace "HepMC":
     cdef cppclass FilterBase:
@@ -143,4 +161,4 @@ cdef extern from "HepMC/Search/FindParticles.h" namespace "HepMC":
 cdef extern from "HepMC/Pythia8ToHepMC3.h" namespace "HepMC":
     cdef cppclass Pythia8ToHepMC3:
         void set_print_inconsistency(bool)
-        bool fill_next_event(Pythia.Pythia&, GenEvent*)
+        bool fill_next_event(Pythia.Pythia&, GenEvent*) nogil
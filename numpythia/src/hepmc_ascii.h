@@ -0,0 +1,1419 @@
+#ifndef NUMPYTHIA_HEPMC_ASCII_H
+#define NUMPYTHIA_HEPMC_ASCII_H
+
+#include "HepMC/GenEvent.h"
+#include "HepMC/GenParticle.h"
+#include "HepMC/GenVertex.h"
+#include "HepMC/GenRunInfo.h"
+#include "HepMC/Attribute.h"
+#include "HepMC/Units.h"
+#include "HepMC/WriterAscii.h"
+
+#include "compressed_stream.h"
+#include "selection.h"
+
+#include <string>
+#include <vector>
+#include <utility>
+#include <algorithm>
+#include <thread>
+#include <atomic>
+#include <mutex>
+#include <condition_variable>
+#include <deque>
+#include <cstring>
+#include <cstdlib>
+#include <cstdio>
+#include <stdint.h>
+
+#include <fcntl.h>
+#include <locale.h>
+#ifdef __APPLE__
+#include <xlocale.h>
+#endif
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+
+// Status codes of the memory mapped HepMC reader. As for event generation,
+// errors are returned instead of thrown so that events can be read without
+// the GIL.
+enum AsciiStatus {
+    ASCII_OK = 0,
+    ASCII_END,
+    ASCII_SYSTEM_ERROR,
+    ASCII_PARSE_ERROR
+};
+
+
+// Locale independent number parsing on [cursor, end) without requiring NUL
+// terminated strings. Leading spaces are skipped as by atoi and atof, and on
+// success cursor is moved past the number.
+
+inline const char* ascii_skip_spaces(const char* cursor, const char* end) {
+    while (cursor < end && (*cursor == ' ' || *cursor == '\t')) ++cursor;
+    return cursor;
+}
+
+
+inline bool ascii_parse_int(const char*& cursor, const char* end, int& value) {
+    const char* c = ascii_skip_spaces(cursor, end);
+    bool negative = false;
+    if (c < end && (*c == '-' || *c == '+')) {
+        negative = *c == '-';
+        ++c;
+    }
+    const char* digits = c;
+    long long result = 0;
+    while (c < end && (unsigned) (*c - '0') < 10) {
+        result = result * 10 + (*c - '0');
+        ++c;
+    }
+    if (c == digits) return false;
+    value = (int) (negative ? -result : result);
+    cursor = c;
+    return true;
+}
+
+
+// The "C" locale, whose decimal point strtod_l uses regardless of the
+// LC_NUMERIC of the process
+inline locale_t ascii_c_locale() {
+    static const locale_t locale = newlocale(LC_NUMERIC_MASK, "C", (locale_t) 0);
+    return locale;
+}
+
+
+// strtod in the "C" locale on a NUL terminated copy of the token at cursor
+inline double ascii_strtod(const char*& cursor, const char* end) {
+    const char* token_end = cursor;
+    while (token_end < end && *token_end != ' ' && *token_end != '\t') ++token_end;
+    std::string token(cursor, token_end);
+    char* parsed;
+    locale_t locale = ascii_c_locale();
+    double value = locale != (locale_t) 0 ? strtod_l(token.c_str(), &parsed, locale)
+                                          : strtod(token.c_str(), &parsed);
+    cursor += parsed - token.c_str();
+    return value;
+}
+
+
+static const uint64_t ASCII_POWERS_OF_TEN[20] = {
+    1ULL, 10ULL, 100ULL, 1000ULL, 10000ULL, 100000ULL, 1000000ULL, 10000000ULL,
+    100000000ULL, 1000000000ULL, 10000000000ULL, 100000000000ULL, 1000000000000ULL,
+    10000000000000ULL, 100000000000000ULL, 1000000000000000ULL, 10000000000000000ULL,
+    100000000000000000ULL, 1000000000000000000ULL, 10000000000000000000ULL
+};
+
+
+// 2^-n for 0 <= n < 1023
+inline double ascii_inverse_power_of_two(int n) {
+    uint64_t bits = (uint64_t) (1023 - n) << 52;
+    double value;
+    memcpy(&value, &bits, sizeof(value));
+    return value;
+}
+
+
+// Parse a double rounded exactly as strtod does. Numbers with up to 19
+// significant digits and a decimal exponent within +-19, which covers the
+// %.16e output of WriterAscii for all but small or extreme values, are
+// converted with integer arithmetic. Anything else falls back to strtod_l in
+// the "C" locale.
+inline bool ascii_parse_double(const char*& cursor, const char* end, double& value) {
+    const char* start = ascii_skip_spaces(cursor, end);
+    const char* c = start;
+    bool negative = false;
+    if (c < end && (*c == '-' || *c == '+')) {
+        negative = *c == '-';
+        ++c;
+    }
+    uint64_t mantissa = 0;
+    int digits = 0;
+    int exponent = 0;
+    bool exact = true;
+    const char* first = c;
+    while (c < end && (unsigned) (*c - '0') < 10) {
+        if (digits < 19) {
+            mantissa = mantissa * 10 + (*c - '0');
+            if (mantissa) ++digits;
+        } else {
+            ++exponent;
+            if (*c != '0') exact = false;
+        }
+        ++c;
+    }
+    bool any = c != first;
+    if (c < end && *c == '.') {
+        ++c;
+        first = c;
+#if defined(__BYTE_ORDER__) && __BYTE_ORDER__ == __ORDER_LITTLE_ENDIAN__
+        // eight digits at a time once the leading zeros are skipped
+        while (mantissa != 0 && digits + 8 <= 19 && end - c >= 8) {
+            uint64_t chunk;
+            memcpy(&chunk, c, sizeof(chunk));
+            if (((chunk & 0xF0F0F0F0F0F0F0F0ULL) |
+                 (((chunk + 0x0606060606060606ULL) & 0xF0F0F0F0F0F0F0F0ULL) >> 4)) != 0x3333333333333333ULL) {
+                break;
+            }
+            chunk -= 0x3030303030303030ULL;
+            chunk = chunk * 10 + (chunk >> 8);
+            chunk = (((chunk & 0x000000FF000000FFULL) * (100 + (1000000ULL << 32))) +
+                     (((chunk >> 16) & 0x000000FF000000FFULL) * (1 + (10000ULL << 32)))) >> 32;
+            mantissa = mantissa * 100000000ULL + chunk;
+            digits += 8;
+            exponent -= 8;
+            c += 8;
+        }
+#endif
+        while (c < end && (unsigned) (*c - '0') < 10) {
+            if (digits < 19) {
+                mantissa = mantissa * 10 + (*c - '0');
+                if (mantissa) ++digits;
+                --exponent;
+            } else if (*c != '0') {
+                exact = false;
+            }
+            ++c;
+        }
+        any = any || c != first;
+    }
+    if (any && c < end && (*c == 'e' || *c == 'E')) {
+        const char* e = c + 1;
+        bool negative_exponent = false;
+        if (e < end && (*e == '-' || *e == '+')) {
+            negative_exponent = *e == '-';
+            ++e;
+        }
+        if (e < end && (unsigned) (*e - '0') < 10) {
+            int power = 0;
+            while (e < end && (unsigned) (*e - '0') < 10) {
+                if (power < 10000) power = power * 10 + (*e - '0');
+                ++e;
+            }
+            exponent += negative_exponent ? -power : power;
+            c = e;
+        }
+    }
+    if (!any) {
+        // nan, inf or not a number at all
+        const char* parsed = start;
+        value = ascii_strtod(parsed, end);
+        if (parsed == start) return false;
+        cursor = parsed;
+        return true;
+    }
+    cursor = c;
+    if (mantissa == 0) {
+        value = negative ? -0.0 : 0.0;
+        return true;
+    }
+#ifdef __SIZEOF_INT128__
+    // The exact product, or a quotient of 63 or 64 bits with the remainder
+    // folded into its lowest bit, is rounded to double only once.
+    if (exact && exponent >= 0 && exponent <= 19) {
+        value = (double) ((unsigned __int128) mantissa * ASCII_POWERS_OF_TEN[exponent]);
+        if (negative) value = -value;
+        return true;
+    }
+    if (exact && exponent < 0 && exponent >= -19) {
+        uint64_t divisor = ASCII_POWERS_OF_TEN[-exponent];
+        int shift = 63 + (64 - __builtin_clzll(divisor)) - (64 - __builtin_clzll(mantissa));
+        unsigned __int128 numerator = (unsigned __int128) mantissa << shift;
+        unsigned __int128 quotient = numerator / divisor;
+        uint64_t bits = (uint64_t) quotient;
+        if (numerator != quotient * divisor) bits |= 1;
+        value = (double) bits * ascii_inverse_power_of_two(shift);
+        if (negative) value = -value;
+        return true;
+    }
+#endif
+    const char* parsed = start;
+    value = ascii_strtod(parsed, end);
+    return true;
+}
+
+
+// Read-only memory mapping of a whole file
+class MappedFile {
+  public:
+    MappedFile(): data_(NULL), size_(0), mtime_seconds_(0), mtime_nanoseconds_(0) {}
+
+    ~MappedFile() {
+        close();
+    }
+
+    int open(const std::string& filename) {
+        struct stat info;
+        int fd = ::open(filename.c_str(), O_RDONLY);
+        if (fd < 0) {
+            return ASCII_SYSTEM_ERROR;
+        }
+        if (fstat(fd, &info) != 0) {
+            ::close(fd);
+            return ASCII_SYSTEM_ERROR;
+        }
+        size_ = info.st_size;
+        mtime_seconds_ = info.st_mtime;
+#ifdef __linux__
+        mtime_nanoseconds_ = info.st_mtim.tv_nsec;
+#else
+        mtime_nanoseconds_ = 0;
+#endif
+        if (size_ > 0) {
+            void* address = mmap(NULL, size_, PROT_READ, MAP_PRIVATE, fd, 0);
+            if (address == MAP_FAILED) {
+                ::close(fd);
+                size_ = 0;
+                return ASCII_SYSTEM_ERROR;
+            }
+            data_ = (const char*) address;
+            madvise(address, size_, MADV_SEQUENTIAL);
+        }
+        ::close(fd);
+        return ASCII_OK;
+    }
+
+    void close() {
+        if (data_ != NULL) {
+            munmap((void*) data_, size_);
+        }
+        data_ = NULL;
+        size_ = 0;
+    }
+
+    const char* data() const { return data_; }
+
+    const char* end() const { return data_ + size_; }
+
+    size_t size() const { return size_; }
+
+    // Modification time when the file was opened
+    int64_t mtime_seconds() const { return mtime_seconds_; }
+
+    int64_t mtime_nanoseconds() const { return mtime_nanoseconds_; }
+
+  private:
+    const char* data_;
+    size_t size_;
+    int64_t mtime_seconds_;
+    int64_t mtime_nanoseconds_;
+};
+
+
+// Parser of the HepMC3 ASCII format of HepMC::ReaderAscii working in place
+// on a buffer, producing the same events as ReaderAscii::read_event.
+class AsciiEventParser {
+  public:
+    AsciiEventParser(): run_info(HepMC::make_shared<HepMC::GenRunInfo>()), event_line(NULL) {}
+
+    // Parse the next event starting at cursor, which is moved to the start
+    // of the following event. Returns ASCII_END if there are no more events.
+    int parse(const char*& cursor, const char* end, HepMC::GenEvent& event) {
+        bool parsed_event_header = false;
+        std::pair<int, int> vertices_and_particles(0, 0);
+
+        event.clear();
+        event.set_run_info(run_info);
+
+        while (cursor < end) {
+            const char* line = cursor;
+            const char* line_end = (const char*) memchr(line, '\n', end - line);
+            if (line_end == NULL) {
+                line_end = end;
+                cursor = end;
+            } else {
+                cursor = line_end + 1;
+            }
+            if (line_end == line) continue;
+
+            // header and footer lines end the current event
+            if (line_end - line >= 5 && strncmp(line, "HepMC", 5) == 0) {
+                if (parsed_event_header) break;
+                continue;
+            }
+
+            bool parsed = true;
+            switch (line[0]) {
+                case 'E':
+                    parsed = parse_event_information(event, line, line_end, vertices_and_particles);
+                    parsed_event_header = parsed_event_header || parsed;
+                    event_line = line;
+                    break;
+                case 'V':
+                    parsed = parse_vertex_information(event, line, line_end);
+                    break;
+                case 'P':
+                    parsed = parse_particle_information(event, line, line_end);
+                    break;
+                case 'W':
+                    if (parsed_event_header) {
+                        parsed = parse_weight_values(event, line, line_end);
+                    } else {
+                        parsed = parse_weight_names(line, line_end);
+                    }
+                    break;
+                case 'U':
+                    parsed = parse_units(event, line, line_end);
+                    break;
+                case 'T':
+                    parsed = parse_tool(line, line_end);
+                    break;
+                case 'A':
+                    if (parsed_event_header) {
+                        parsed = parse_attribute(event, line, line_end);
+                    } else {
+                        parsed = parse_run_attribute(line, line_end);
+                    }
+                    break;
+                default:
+                    // unrecognised prefixes are skipped
+                    break;
+            }
+            if (!parsed) {
+                event.clear();
+                return ASCII_PARSE_ERROR;
+            }
+
+            // stop before the next event
+            if (parsed_event_header && cursor < end && *cursor == 'E') break;
+        }
+
+        if (!parsed_event_header) {
+            return ASCII_END;
+        }
+        if ((int) event.particles().size() != vertices_and_particles.second ||
+            (int) event.vertices().size() != vertices_and_particles.first) {
+            event.clear();
+            return ASCII_PARSE_ERROR;
+        }
+        return ASCII_OK;
+    }
+
+    HepMC::shared_ptr<HepMC::GenRunInfo> run_info;
+
+    // Start of the "E" line of the last parsed event
+    const char* event_line;
+
+  private:
+    static bool parse_position(const char*& cursor, const char* end, HepMC::FourVector& position) {
+        double x, y, z, t;
+        if (!ascii_parse_double(cursor, end, x) || !ascii_parse_double(cursor, end, y) ||
+            !ascii_parse_double(cursor, end, z) || !ascii_parse_double(cursor, end, t)) {
+            return false;
+        }
+        position.set(x, y, z, t);
+        return true;
+    }
+
+    // Optional "@ x y z t" at cursor
+    static bool has_position(const char*& cursor, const char* end) {
+        cursor = ascii_skip_spaces(cursor, end);
+        if (cursor < end && *cursor == '@') {
+            ++cursor;
+            return true;
+        }
+        return false;
+    }
+
+    static bool parse_event_information(HepMC::GenEvent& event, const char* cursor, const char* end,
+                                        std::pair<int, int>& vertices_and_particles) {
+        int event_number;
+        HepMC::FourVector position;
+        ++cursor;
+        if (!ascii_parse_int(cursor, end, event_number) ||
+            !ascii_parse_int(cursor, end, vertices_and_particles.first) ||
+            !ascii_parse_int(cursor, end, vertices_and_particles.second)) {
+            return false;
+        }
+        event.set_event_number(event_number);
+        if (has_position(cursor, end)) {
+            if (!parse_position(cursor, end, position)) return false;
+            event.shift_position_to(position);
+        }
+        return true;
+    }
+
+    static bool parse_vertex_information(HepMC::GenEvent& event, const char* cursor, const char* end) {
+        HepMC::GenVertexPtr vertex = HepMC::make_shared<HepMC::GenVertex>();
+        HepMC::FourVector position;
+        int id, status, particle_in;
+        int highest_id = event.particles().size();
+        ++cursor;
+        if (!ascii_parse_int(cursor, end, id) || !ascii_parse_int(cursor, end, status)) {
+            return false;
+        }
+        (*vertex).set_status(status);
+        cursor = ascii_skip_spaces(cursor, end);
+        if (cursor == end || *cursor != '[') return false;
+        ++cursor;
+        while (true) {
+            if (!ascii_parse_int(cursor, end, particle_in)) return false;
+            if (particle_in <= 0 || particle_in > highest_id) return false;
+            (*vertex).add_particle_in(event.particles()[particle_in - 1]);
+            cursor = ascii_skip_spaces(cursor, end);
+            if (cursor == end) return false;
+            if (*cursor == ']') break;
+            if (*cursor != ',') return false;
+            ++cursor;
+        }
+        ++cursor;
+        if (has_position(cursor, end)) {
+            if (!parse_position(cursor, end, position)) return false;
+            (*vertex).set_position(position);
+        }
+        event.add_vertex(vertex);
+        return true;
+    }
+
+    static bool parse_particle_information(HepMC::GenEvent& event, const char* cursor, const char* end) {
+        HepMC::GenParticlePtr particle = HepMC::make_shared<HepMC::GenParticle>();
+        int id, mother_id, pid, status;
+        double px, py, pz, e, mass;
+        ++cursor;
+        if (!ascii_parse_int(cursor, end, id) || id != (int) event.particles().size() + 1) {
+            return false;
+        }
+        if (!ascii_parse_int(cursor, end, mother_id)) return false;
+
+        // add particle to corresponding vertex
+        if (mother_id > 0 && mother_id <= (int) event.particles().size()) {
+            const HepMC::GenParticlePtr& mother = event.particles()[mother_id - 1];
+            HepMC::GenVertexPtr vertex = (*mother).end_vertex();
+            // create new vertex if needed
+            if (!vertex) {
+                vertex = HepMC::make_shared<HepMC::GenVertex>();
+                (*vertex).add_particle_in(mother);
+            }
+            (*vertex).add_particle_out(particle);
+            event.add_vertex(vertex);
+        } else if (mother_id < 0 && -mother_id <= (int) event.vertices().size()) {
+            (*event.vertices()[-mother_id - 1]).add_particle_out(particle);
+        }
+
+        if (!ascii_parse_int(cursor, end, pid) ||
+            !ascii_parse_double(cursor, end, px) || !ascii_parse_double(cursor, end, py) ||
+            !ascii_parse_double(cursor, end, pz) || !ascii_parse_double(cursor, end, e) ||
+            !ascii_parse_double(cursor, end, mass) || !ascii_parse_int(cursor, end, status)) {
+            return false;
+        }
+        (*particle).set_pid(pid);
+        (*particle).set_momentum(HepMC::FourVector(px, py, pz, e));
+        (*particle).set_generated_mass(mass);
+        (*particle).set_status(status);
+        event.add_particle(particle);
+        return true;
+    }
+
+    bool parse_weight_values(HepMC::GenEvent& event, const char* cursor, const char* end) {
+        std::vector<double> weights;
+        double weight;
+        ++cursor;
+        while (ascii_parse_double(cursor, end, weight)) {
+            weights.push_back(weight);
+        }
+        if (run_info && run_info->weight_names().size() &&
+            run_info->weight_names().size() != weights.size()) {
+            return false;
+        }
+        event.weights() = weights;
+        return true;
+    }
+
+    static bool parse_units(HepMC::GenEvent& event, const char* line, const char* end) {
+        const char* momentum = (const char*) memchr(line + 1, ' ', end - line - 1);
+        if (momentum == NULL || momentum + 1 >= end) return false;
+        ++momentum;
+        const char* length = (const char*) memchr(momentum + 1, ' ', end - momentum - 1);
+        if (length == NULL) return false;
+        ++length;
+        event.set_units(HepMC::Units::momentum_unit(std::string(momentum, end)),
+                        HepMC::Units::length_unit(std::string(length, end)));
+        return true;
+    }
+
+    static bool parse_attribute(HepMC::GenEvent& event, const char* cursor, const char* end) {
+        int id;
+        ++cursor;
+        if (!ascii_parse_int(cursor, end, id)) return false;
+        if (cursor == end || *cursor != ' ') return false;
+        const char* name = cursor + 1;
+        const char* name_end = (const char*) memchr(name, ' ', end - name);
+        if (name_end == NULL) return false;
+        event.add_attribute(std::string(name, name_end),
+                            HepMC::make_shared<HepMC::StringAttribute>(
+                                HepMC::StringAttribute(unescape(name_end + 1, end))), id);
+        return true;
+    }
+
+    bool parse_run_attribute(const char* line, const char* end) {
+        const char* name = (const char*) memchr(line + 1, ' ', end - line - 1);
+        if (name == NULL) return false;
+        ++name;
+        const char* name_end = (const char*) memchr(name, ' ', end - name);
+        if (name_end == NULL) return false;
+        run_info->add_attribute(std::string(name, name_end),
+                                HepMC::make_shared<HepMC::StringAttribute>(
+                                    HepMC::StringAttribute(unescape(name_end + 1, end))));
+        return true;
+    }
+
+    bool parse_weight_names(const char* line, const char* end) {
+        const char* cursor = (const char*) memchr(line + 1, ' ', end - line - 1);
+        if (cursor == NULL) return false;
+        std::string names = unescape(cursor + 1, end);
+        std::vector<std::string> weight_names;
+        size_t position = 0;
+        while (true) {
+            position = names.find_first_not_of(" \t\n\r\f\v", position);
+            if (position == std::string::npos) break;
+            size_t name_end = names.find_first_of(" \t\n\r\f\v", position);
+            weight_names.push_back(names.substr(position, name_end - position));
+            position = name_end;
+        }
+        run_info->set_weight_names(weight_names);
+        return true;
+    }
+
+    bool parse_tool(const char* line, const char* end) {
+        const char* cursor = (const char*) memchr(line + 1, ' ', end - line - 1);
+        if (cursor == NULL) return false;
+        std::string text = unescape(cursor + 1, end);
+        HepMC::GenRunInfo::ToolInfo tool;
+        std::string::size_type position = text.find("\n");
+        tool.name = text.substr(0, position);
+        text = text.substr(position + 1);
+        position = text.find("\n");
+        tool.version = text.substr(0, position);
+        tool.description = text.substr(position + 1);
+        run_info->tools().push_back(tool);
+        return true;
+    }
+
+    // Undo the escaping of '\' and newlines (as "\|") of WriterAscii
+    static std::string unescape(const char* cursor, const char* end) {
+        std::string result;
+        result.reserve(end - cursor);
+        for (; cursor < end; ++cursor) {
+            if (*cursor == '\\' && cursor + 1 < end) {
+                ++cursor;
+                result += *cursor == '|' ? '\n' : *cursor;
+            } else {
+                result += *cursor;
+            }
+        }
+        return result;
+    }
+};
+
+
+// One event of a HepMC3 ASCII buffer parsed into flat arrays instead of a
+// GenEvent, for reading particle arrays without allocating a particle and a
+// vertex object per line. The links of the P and V lines are resolved as
+// AsciiEventParser and GenEvent do: a mother without an end vertex gets a
+// new one, particles without a mother are attached to the root vertex at the
+// event position, and a vertex without a position takes that of the
+// production vertex of its first incoming particle (GenVertex::position).
+// Selected rows are therefore equal to those of the parsed GenEvent. Weights,
+// units and attributes are skipped. The arrays are reused between events.
+class AsciiRecord {
+  public:
+    AsciiRecord(): event_line(NULL) {}
+
+    // Parse the next event starting at cursor like AsciiEventParser::parse
+    int parse(const char*& cursor, const char* end) {
+        bool parsed_event_header = false;
+        int nvertices = 0, nparticles = 0;
+        clear();
+
+        while (cursor < end) {
+            const char* line = cursor;
+            const char* line_end = (const char*) memchr(line, '\n', end - line);
+            if (line_end == NULL) {
+                line_end = end;
+                cursor = end;
+            } else {
+                cursor = line_end + 1;
+            }
+            if (line_end == line) continue;
+
+            // header and footer lines end the current event
+            if (line_end - line >= 5 && strncmp(line, "HepMC", 5) == 0) {
+                if (parsed_event_header) break;
+                continue;
+            }
+
+            bool parsed = true;
+            switch (line[0]) {
+                case 'E':
+                    parsed = parse_event_information(line, line_end, nvertices, nparticles);
+                    parsed_event_header = parsed_event_header || parsed;
+                    event_line = line;
+                    break;
+                case 'V':
+                    parsed = parse_vertex_information(line, line_end);
+                    break;
+                case 'P':
+                    parsed = parse_particle_information(line, line_end);
+                    break;
+                default:
+                    break;
+            }
+            if (!parsed) {
+                clear();
+                return ASCII_PARSE_ERROR;
+            }
+
+            // stop before the next event
+            if (parsed_event_header && cursor < end && *cursor == 'E') break;
+        }
+
+        if (!parsed_event_header) {
+            return ASCII_END;
+        }
+        if ((int) pid.size() != nparticles || (int) vertex_position.size() != nvertices) {
+            clear();
+            return ASCII_PARSE_ERROR;
+        }
+        resolve_positions();
+        return ASCII_OK;
+    }
+
+    size_t size() const { return pid.size(); }
+
+    // Indices of the selected particles in the order of GenEvent::particles()
+    void select(const SelectionProgram& selection, std::vector<int>& indices) {
+        size_t n = pid.size();
+        columns.size = n;
+        if (selection.needs(SEL_STATUS)) columns.status = status;
+        if (selection.needs(SEL_PDG_ID)) columns.pdg_id = pid;
+        if (selection.needs(SEL_HAS_END_VERTEX)) {
+            columns.has_end_vertex.resize(n);
+            for (size_t i = 0; i < n; ++i) columns.has_end_vertex[i] = end_vertex[i] >= 0;
+        }
+        if (selection.needs(SEL_HAS_PRODUCTION_VERTEX)) {
+            // the root vertex counts as production vertex
+            columns.has_production_vertex.assign(n, 1);
+        }
+        if (selection.needs(SEL_HAS_SAME_PDG_ID_DAUGHTER)) {
+            columns.has_same_pdg_id_daughter.assign(n, 0);
+            for (size_t i = 0; i < n; ++i) {
+                int vertex = production_vertex[i];
+                if (vertex < 0) continue;
+                for (int j = in_begin[vertex]; j < in_end[vertex]; ++j) {
+                    int mother = in_particles[j];
+                    if (end_vertex[mother] == vertex && pid[mother] == pid[i]) {
+                        columns.has_same_pdg_id_daughter[mother] = 1;
+                    }
+                }
+            }
+        }
+        selection.evaluate(columns, mask);
+        indices.clear();
+        for (size_t i = 0; i < n; ++i) {
+            if (mask[i]) indices.push_back(i);
+        }
+    }
+
+    void to_array(const std::vector<int>& indices, char* array, unsigned int rowbytes) const {
+        char* row;
+        double* double_fields;
+        int* int_fields;
+        for (unsigned int i = 0; i < indices.size(); ++i) {
+            int index = indices[i];
+            const HepMC::FourVector& momentum = this->momentum[index];
+            int vertex = production_vertex[index];
+            const HepMC::FourVector& prod_vertex = vertex < 0 ? event_position : resolved_position[vertex];
+            row = &array[i * rowbytes];
+            // doubles
+            double_fields = (double*) row;
+            double_fields[0] = momentum.e();
+            double_fields[1] = momentum.px();
+            double_fields[2] = momentum.py();
+            double_fields[3] = momentum.pz();
+            double_fields[4] = momentum.pt();
+            double_fields[5] = momentum.m();
+            double_fields[6] = momentum.rap();
+            double_fields[7] = momentum.eta();
+            double_fields[8] = momentum.theta();
+            double_fields[9] = momentum.phi();
+            double_fields[10] = prod_vertex.x();
+            double_fields[11] = prod_vertex.y();
+            double_fields[12] = prod_vertex.z();
+            double_fields[13] = prod_vertex.t();
+            // integers
+            int_fields = (int*)&row[14 * sizeof(double)];
+            int_fields[0] = pid[index];
+            int_fields[1] = status[index];
+        }
+    }
+
+    // Start of the "E" line of the last parsed event
+    const char* event_line;
+
+  private:
+    void clear() {
+        event_position = HepMC::FourVector::ZERO_VECTOR();
+        pid.clear();
+        status.clear();
+        momentum.clear();
+        production_vertex.clear();
+        end_vertex.clear();
+        vertex_position.clear();
+        in_begin.clear();
+        in_end.clear();
+        in_particles.clear();
+    }
+
+    static bool parse_position(const char*& cursor, const char* end, HepMC::FourVector& position) {
+        double x, y, z, t;
+        if (!ascii_parse_double(cursor, end, x) || !ascii_parse_double(cursor, end, y) ||
+            !ascii_parse_double(cursor, end, z) || !ascii_parse_double(cursor, end, t)) {
+            return false;
+        }
+        position.set(x, y, z, t);
+        return true;
+    }
+
+    // Optional "@ x y z t" at cursor
+    static bool has_position(const char*& cursor, const char* end) {
+        cursor = ascii_skip_spaces(cursor, end);
+        if (cursor < end && *cursor == '@') {
+            ++cursor;
+            return true;
+        }
+        return false;
+    }
+
+    bool parse_event_information(const char* cursor, const char* end, int& nvertices, int& nparticles) {
+        int event_number;
+        ++cursor;
+        if (!ascii_parse_int(cursor, end, event_number) ||
+            !ascii_parse_int(cursor, end, nvertices) ||
+            !ascii_parse_int(cursor, end, nparticles)) {
+            return false;
+        }
+        if (has_position(cursor, end)) {
+            if (!parse_position(cursor, end, event_position)) return false;
+        }
+        return true;
+    }
+
+    // New vertex, numbered like GenEvent::add_vertex
+    int add_vertex(const HepMC::FourVector& position) {
+        vertex_position.push_back(position);
+        in_begin.push_back(in_particles.size());
+        in_end.push_back(in_particles.size());
+        return vertex_position.size() - 1;
+    }
+
+    // GenVertex::add_particle_in for the last vertex. A particle that
+    // already had an end vertex is moved, which leaves a stale entry in the
+    // list of that vertex; entries only count if end_vertex still matches.
+    void add_particle_in(int vertex, int particle) {
+        for (int j = in_begin[vertex]; j < in_end[vertex]; ++j) {
+            if (in_particles[j] == particle) return;
+        }
+        in_particles.push_back(particle);
+        in_end[vertex] = in_particles.size();
+        end_vertex[particle] = vertex;
+    }
+
+    bool parse_vertex_information(const char* cursor, const char* end) {
+        HepMC::FourVector position;
+        int id, vertex_status, particle_in;
+        int highest_id = pid.size();
+        ++cursor;
+        if (!ascii_parse_int(cursor, end, id) || !ascii_parse_int(cursor, end, vertex_status)) {
+            return false;
+        }
+        int vertex = add_vertex(position);
+        cursor = ascii_skip_spaces(cursor, end);
+        if (cursor == end || *cursor != '[') return false;
+        ++cursor;
+        while (true) {
+            if (!ascii_parse_int(cursor, end, particle_in)) return false;
+            if (particle_in <= 0 || particle_in > highest_id) return false;
+            add_particle_in(vertex, particle_in - 1);
+            cursor = ascii_skip_spaces(cursor, end);
+            if (cursor == end) return false;
+            if (*cursor == ']') break;
+            if (*cursor != ',') return false;
+            ++cursor;
+        }
+        ++cursor;
+        if (has_position(cursor, end)) {
+            if (!parse_position(cursor, end, vertex_position[vertex])) return false;
+        }
+        return true;
+    }
+
+    bool parse_particle_information(const char* cursor, const char* end) {
+        int id, mother_id, particle_pid, particle_status;
+        double px, py, pz, e, mass;
+        int index = pid.size();
+        ++cursor;
+        if (!ascii_parse_int(cursor, end, id) || id != index + 1) {
+            return false;
+        }
+        if (!ascii_parse_int(cursor, end, mother_id)) return false;
+        if (!ascii_parse_int(cursor, end, particle_pid) ||
+            !ascii_parse_double(cursor, end, px) || !ascii_parse_double(cursor, end, py) ||
+            !ascii_parse_double(cursor, end, pz) || !ascii_parse_double(cursor, end, e) ||
+            !ascii_parse_double(cursor, end, mass) || !ascii_parse_int(cursor, end, particle_status)) {
+            return false;
+        }
+        pid.push_back(particle_pid);
+        status.push_back(particle_status);
+        momentum.push_back(HepMC::FourVector(px, py, pz, e));
+        end_vertex.push_back(-1);
+
+        // production vertex, -1 for the root vertex
+        int vertex = -1;
+        if (mother_id > 0 && mother_id <= index) {
+            vertex = end_vertex[mother_id - 1];
+            if (vertex < 0) {
+                vertex = add_vertex(HepMC::FourVector::ZERO_VECTOR());
+                add_particle_in(vertex, mother_id - 1);
+            }
+        } else if (mother_id < 0 && -mother_id <= (int) vertex_position.size()) {
+            vertex = -mother_id - 1;
+        }
+        production_vertex.push_back(vertex);
+        return true;
+    }
+
+    // GenVertex::position of every vertex. Each vertex without a position
+    // depends on at most one other vertex, so the chains are followed
+    // iteratively and every vertex is resolved once.
+    void resolve_positions() {
+        size_t nvertices = vertex_position.size();
+        resolved_position.resize(nvertices);
+        resolved.assign(nvertices, 0);
+        for (size_t first = 0; first < nvertices; ++first) {
+            chain.clear();
+            int vertex = first;
+            const HepMC::FourVector* position = &event_position;
+            while (vertex >= 0) {
+                if (resolved[vertex] == 2) {
+                    position = &resolved_position[vertex];
+                    break;
+                }
+                if (!vertex_position[vertex].is_zero()) {
+                    position = &vertex_position[vertex];
+                    break;
+                }
+                if (resolved[vertex] == 1) {
+                    // a cycle of vertices, which GenVertex::position does not survive
+                    break;
+                }
+                resolved[vertex] = 1;
+                chain.push_back(vertex);
+                int next = -2;
+                for (int j = in_begin[vertex]; j < in_end[vertex]; ++j) {
+                    int particle = in_particles[j];
+                    if (end_vertex[particle] == vertex) {
+                        next = production_vertex[particle];
+                        break;
+                    }
+                }
+                vertex = next;
+            }
+            HepMC::FourVector resolved_value = *position;
+            if (vertex >= 0 && resolved[vertex] != 1) {
+                resolved_position[vertex] = resolved_value;
+                resolved[vertex] = 2;
+            }
+            for (size_t i = 0; i < chain.size(); ++i) {
+                resolved_position[chain[i]] = resolved_value;
+                resolved[chain[i]] = 2;
+            }
+        }
+    }
+
+    HepMC::FourVector event_position;
+    std::vector<int> pid, status;
+    std::vector<HepMC::FourVector> momentum;
+    std::vector<int> production_vertex, end_vertex;
+    std::vector<HepMC::FourVector> vertex_position, resolved_position;
+    std::vector<int> in_begin, in_end, in_particles;
+    std::vector<unsigned char> resolved;
+    std::vector<int> chain;
+    SelectionColumns columns;
+    std::vector<unsigned char> mask;
+};
+
+// Byte offsets of the event records, the lines starting with 'E', in a
+// HepMC3 ASCII buffer. Attribute values are escaped, so no other line can
+// start with 'E'. The buffer is scanned in n_threads chunks in parallel.
+inline void ascii_event_offsets(const char* data, size_t size, int n_threads,
+                                std::vector<size_t>& offsets) {
+    offsets.clear();
+    if (size == 0) return;
+    if (n_threads < 1) n_threads = 1;
+    size_t chunk_size = (size + n_threads - 1) / n_threads;
+    std::vector<std::vector<size_t> > chunks(n_threads);
+    std::vector<std::thread> threads;
+    for (int ithread = 0; ithread < n_threads; ++ithread) {
+        threads.push_back(std::thread([=, &chunks]() {
+            size_t begin = std::min(size, ithread * chunk_size);
+            size_t end = std::min(size, begin + chunk_size);
+            std::vector<size_t>& found = chunks[ithread];
+            if (begin == 0 && data[0] == 'E') found.push_back(0);
+            // records starting in [begin, end) follow newlines in [begin - 1, end - 1)
+            const char* cursor = data + (begin == 0 ? 0 : begin - 1);
+            const char* last = data + (end == 0 ? 0 : end - 1);
+            while (cursor < last) {
+                const char* newline = (const char*) memchr(cursor, '\n', last - cursor);
+                if (newline == NULL) break;
+                if (newline[1] == 'E') found.push_back(newline + 1 - data);
+                cursor = newline + 1;
+            }
+        }));
+    }
+    for (int ithread = 0; ithread < n_threads; ++ithread) {
+        threads[ithread].join();
+        offsets.insert(offsets.end(), chunks[ithread].begin(), chunks[ithread].end());
+    }
+}
+
+
+// On-disk index of the event offsets of a HepMC3 ASCII file, stored as
+// this header followed by one uint64 offset per event. The index is only
+// valid for a file of the recorded size and modification time.
+struct AsciiIndexHeader {
+    char magic[8];
+    uint64_t version;
+    uint64_t file_size;
+    int64_t mtime_seconds;
+    int64_t mtime_nanoseconds;
+    uint64_t nevents;
+};
+
+static const char ASCII_INDEX_MAGIC[8] = {'N', 'P', 'Y', 'H', 'M', 'C', 'I', 'X'};
+static const uint64_t ASCII_INDEX_VERSION = 1;
+
+
+inline bool ascii_load_index(const std::string& path, const MappedFile& file,
+                             std::vector<size_t>& offsets) {
+    AsciiIndexHeader header;
+    FILE* stream = fopen(path.c_str(), "rb");
+    if (stream == NULL) {
+        return false;
+    }
+    bool valid = fread(&header, sizeof(header), 1, stream) == 1 &&
+                 memcmp(header.magic, ASCII_INDEX_MAGIC, sizeof(header.magic)) == 0 &&
+                 header.version == ASCII_INDEX_VERSION &&
+                 header.file_size == file.size() &&
+                 header.mtime_seconds == file.mtime_seconds() &&
+                 header.mtime_nanoseconds == file.mtime_nanoseconds();
+    if (valid) {
+        std::vector<uint64_t> stored(header.nevents);
+        valid = header.nevents == 0 || fread(&stored[0], sizeof(uint64_t), header.nevents, stream) == header.nevents;
+        offsets.assign(stored.begin(), stored.end());
+        for (size_t ievent = 0; valid && ievent < offsets.size(); ++ievent) {
+            valid = offsets[ievent] < file.size() && (ievent == 0 || offsets[ievent] > offsets[ievent - 1]);
+        }
+    }
+    fclose(stream);
+    if (!valid) {
+        offsets.clear();
+    }
+    return valid;
+}
+
+
+// Write the index to a temporary file renamed into place, so that readers
+// sharing a file never see a partial index
+inline bool ascii_save_index(const std::string& path, const MappedFile& file,
+                             const std::vector<size_t>& offsets) {
+    AsciiIndexHeader header;
+    memcpy(header.magic, ASCII_INDEX_MAGIC, sizeof(header.magic));
+    header.version = ASCII_INDEX_VERSION;
+    header.file_size = file.size();
+    header.mtime_seconds = file.mtime_seconds();
+    header.mtime_nanoseconds = file.mtime_nanoseconds();
+    header.nevents = offsets.size();
+    std::vector<uint64_t> stored(offsets.begin(), offsets.end());
+    char suffix[32];
+    snprintf(suffix, sizeof(suffix), ".%d.tmp", (int) getpid());
+    std::string temporary = path + suffix;
+    FILE* stream = fopen(temporary.c_str(), "wb");
+    if (stream == NULL) {
+        return false;
+    }
+    bool written = fwrite(&header, sizeof(header), 1, stream) == 1 &&
+                   (stored.empty() || fwrite(&stored[0], sizeof(uint64_t), stored.size(), stream) == stored.size());
+    written = fclose(stream) == 0 && written;
+    if (!written || rename(temporary.c_str(), path.c_str()) != 0) {
+        remove(temporary.c_str());
+        return false;
+    }
+    return true;
+}
+
+
+// Event offsets from the index at index_path if it is valid, or else by
+// scanning the file and saving the index there. An empty index_path
+// disables the on-disk index. Failing to save the index is not an error.
+inline void ascii_index_events(const MappedFile& file, const std::string& index_path, int n_threads,
+                               std::vector<size_t>& offsets) {
+    if (!index_path.empty() && ascii_load_index(index_path, file, offsets)) {
+        return;
+    }
+    ascii_event_offsets(file.data(), file.size(), n_threads, offsets);
+    if (!index_path.empty()) {
+        ascii_save_index(index_path, file, offsets);
+    }
+}
+
+
+// Memory mapped alternative to HepMC::ReaderAscii. The file is parsed in
+// place instead of being copied line by line through an ifstream. Events
+// can also be read by index: the event offsets are loaded from or saved to
+// an on-disk index, which a complete sequential pass also produces.
+class MappedReaderAscii {
+  public:
+    MappedReaderAscii(): cursor(NULL), indexed(false), header_parsed(false) {}
+
+    int open(const std::string& filename, const std::string& index = std::string()) {
+        int status = file.open(filename);
+        cursor = file.data();
+        index_path = index;
+        return status;
+    }
+
+    void close() {
+        file.close();
+        cursor = NULL;
+        offsets.clear();
+        pass_offsets.clear();
+        indexed = false;
+    }
+
+    // Read the next event sequentially
+    int read_event(HepMC::GenEvent& event) {
+        if (cursor == NULL) return ASCII_END;
+        if (cursor == file.data() && header_parsed) {
+            // the header was already read for random access
+            cursor = event_begin(0);
+        }
+        int status = parser.parse(cursor, file.end(), event);
+        header_parsed = true;
+        return track(status, parser.event_line);
+    }
+
+    // Read the next event sequentially as flat arrays
+    int read_record(AsciiRecord& record) {
+        if (cursor == NULL) return ASCII_END;
+        if (!header_parsed) {
+            // keep the run information for events read later
+            parse_header();
+        }
+        int status = record.parse(cursor, file.end());
+        return track(status, record.event_line);
+    }
+
+    // Byte offset of the next line to be read
+    size_t tell() const {
+        return cursor == NULL ? 0 : cursor - file.data();
+    }
+
+    // Load the on-disk index or build it if needed
+    void build_index(int n_threads) {
+        if (indexed) return;
+        ascii_index_events(file, index_path, n_threads, offsets);
+        pass_offsets.clear();
+        indexed = true;
+    }
+
+    bool has_index() const { return indexed; }
+
+    // Number of events, once indexed
+    size_t size() const { return offsets.size(); }
+
+    // Read event i of the index without moving the sequential position
+    int read_event_at(size_t ievent, HepMC::GenEvent& event) {
+        if (!indexed || ievent >= offsets.size()) return ASCII_END;
+        if (!header_parsed) {
+            parse_header();
+        }
+        const char* event_cursor = event_begin(ievent);
+        if (*event_cursor != 'E') {
+            // the file no longer matches the index
+            return ASCII_PARSE_ERROR;
+        }
+        int status = parser.parse(event_cursor, event_begin(ievent + 1), event);
+        return status == ASCII_END ? ASCII_PARSE_ERROR : status;
+    }
+
+  private:
+    const char* event_begin(size_t ievent) const {
+        return ievent < offsets.size() ? file.data() + offsets[ievent] : file.end();
+    }
+
+    // Read the run information before the first event. Without an index
+    // the first event is parsed as well and discarded.
+    void parse_header() {
+        HepMC::GenEvent header;
+        const char* header_cursor = file.data();
+        parser.parse(header_cursor, indexed ? event_begin(0) : file.end(), header);
+        header_parsed = true;
+    }
+
+    // Record the offsets of a sequential pass, which become the index once
+    // the pass reaches the end of the file
+    int track(int status, const char* event_line) {
+        if (status == ASCII_OK && !indexed) {
+            pass_offsets.push_back(event_line - file.data());
+        } else if (status == ASCII_END && !indexed) {
+            // a complete pass has seen all events
+            offsets.swap(pass_offsets);
+            indexed = true;
+            if (!index_path.empty()) {
+                ascii_save_index(index_path, file, offsets);
+            }
+        }
+        return status;
+    }
+
+    MappedFile file;
+    AsciiEventParser parser;
+    const char* cursor;
+    std::string index_path;
+    std::vector<size_t> offsets;
+    std::vector<size_t> pass_offsets;
+    bool indexed;
+    bool header_parsed;
+};
+
+
+// Memory mapped HepMC3 ASCII reader parsing events on several threads. The
+// file is indexed when opened so that every event can be parsed
+// independently. Run information (weight names, tools and run
+// attributes) is read from the header before the first event.
+class ParallelReaderAscii {
+  public:
+    ParallelReaderAscii(): n_threads(1) {}
+
+    int open(const std::string& filename, int threads, const std::string& index_path = std::string()) {
+        n_threads = threads < 1 ? 1 : threads;
+        int status = file.open(filename);
+        if (status != ASCII_OK) return status;
+        ascii_index_events(file, index_path, n_threads, offsets);
+        HepMC::GenEvent header;
+        const char* cursor = file.data();
+        status = parser.parse(cursor, event_begin(0), header);
+        return status == ASCII_END ? ASCII_OK : ASCII_PARSE_ERROR;
+    }
+
+    void close() {
+        file.close();
+        offsets.clear();
+    }
+
+    size_t size() const { return offsets.size(); }
+
+    // Parse the events [first, last) on the worker threads, into
+    // events[i - first] if events is given or else into an event reused by
+    // each thread. function(i, event) is then called for each event from the
+    // thread that parsed it. Returns the status of the first event that
+    // failed, or ASCII_OK, and its index in failed.
+    template <class Function>
+    int parse(size_t first, size_t last, const std::vector<HepMC::GenEvent*>* events,
+              Function function, size_t& failed) {
+        return run(first, last, ParserState(parser), [&](ParserState& state, size_t ievent,
+                                                         const char* begin, const char* end) {
+            HepMC::GenEvent& event = events == NULL ? state.reused : *(*events)[ievent - first];
+            int status = state.parser.parse(begin, end, event);
+            if (status == ASCII_OK) function(ievent, event);
+            return status;
+        }, failed);
+    }
+
+    // Parse the events [first, last) into an AsciiRecord of each thread and
+    // call function(i, record) like parse
+    template <class Function>
+    int parse_records(size_t first, size_t last, Function function, size_t& failed) {
+        return run(first, last, AsciiRecord(), [&](AsciiRecord& record, size_t ievent,
+                                                   const char* begin, const char* end) {
+            int status = record.parse(begin, end);
+            if (status == ASCII_OK) function(ievent, record);
+            return status;
+        }, failed);
+    }
+
+    // Read the events [first, last) into events[0], events[1], ...
+    int read_events(size_t first, size_t last, const std::vector<HepMC::GenEvent*>& events, size_t& failed) {
+        return parse(first, last, &events, [](size_t, HepMC::GenEvent&) {}, failed);
+    }
+
+  private:
+    // Start of event i or the end of the file for i == size()
+    const char* event_begin(size_t ievent) const {
+        return ievent < offsets.size() ? file.data() + offsets[ievent] : file.end();
+    }
+
+    // A copy of the header parser and an event for each thread
+    struct ParserState {
+        ParserState(const AsciiEventParser& parser_): parser(parser_) {}
+        ParserState(const ParserState& other): parser(other.parser) {}
+
+        AsciiEventParser parser;
+        HepMC::GenEvent reused;
+    };
+
+    // Call parse(state, i, begin, end) for the events [first, last) on the
+    // worker threads, each with its own copy of state, and return the status
+    // of the first event that failed and its index
+    template <class State, class Parse>
+    int run(size_t first, size_t last, const State& state, Parse parse, size_t& failed) {
+        std::atomic<size_t> next(first);
+        std::mutex error_mutex;
+        int status = ASCII_OK;
+        failed = last;
+        std::vector<std::thread> threads;
+        int nthreads = (int) std::min<size_t>(n_threads, last > first ? last - first : 0);
+        for (int ithread = 0; ithread < nthreads; ++ithread) {
+            threads.push_back(std::thread([&]() {
+                State thread_state(state);
+                size_t ievent;
+                while ((ievent = next.fetch_add(1)) < last) {
+                    const char* cursor = event_begin(ievent);
+                    int event_status = parse(thread_state, ievent, cursor, event_begin(ievent + 1));
+                    if (event_status == ASCII_END) event_status = ASCII_PARSE_ERROR;
+                    if (event_status != ASCII_OK) {
+                        std::lock_guard<std::mutex> lock(error_mutex);
+                        if (ievent < failed) {
+                            failed = ievent;
+                            status = event_status;
+                        }
+                    }
+                }
+            }));
+        }
+        for (size_t ithread = 0; ithread < threads.size(); ++ithread) {
+            threads[ithread].join();
+        }
+        return status;
+    }
+
+    MappedFile file;
+    AsciiEventParser parser;
+    std::vector<size_t> offsets;
+    int n_threads;
+};
+
+
+// HepMC::WriterAscii running on a background thread. Events are handed to
+// the thread through a queue of at most max_pending events, so that the
+// caller only waits on formatting and disk I/O once the writer falls that
+// far behind. Events must not be modified after being written.
+class AsyncWriterAscii {
+  public:
+    AsyncWriterAscii(): writer(NULL), max_pending(1), writing(false), stopping(false), failed(false) {}
+
+    ~AsyncWriterAscii() {
+        close();
+    }
+
+    // Open the file as OutputFile::open and return its StreamStatus
+    int open(const std::string& filename, size_t pending, int precision,
+             int compression, int level, int n_threads) {
+        int status = file.open(filename, compression, level, n_threads);
+        if (status != STREAM_OK) {
+            return status;
+        }
+        writer = new HepMC::WriterAscii(file.stream());
+        writer->set_precision(precision);
+        max_pending = pending < 1 ? 1 : pending;
+        stopping = false;
+        failed = false;
+        thread = std::thread(&AsyncWriterAscii::run, this);
+        return STREAM_OK;
+    }
+
+    // Queue an event, waiting while max_pending events are queued
+    int write(const HepMC::shared_ptr<HepMC::GenEvent>& event) {
+        std::unique_lock<std::mutex> lock(mutex);
+        not_full.wait(lock, [this] { return queue.size() < max_pending || failed; });
+        if (failed) return ASCII_SYSTEM_ERROR;
+        queue.push_back(event);
+        not_empty.notify_one();
+        return ASCII_OK;
+    }
+
+    // Wait until all queued events are written and flush them to the file
+    int flush() {
+        std::unique_lock<std::mutex> lock(mutex);
+        idle.wait(lock, [this] { return (queue.empty() && !writing) || failed; });
+        if (writer != NULL && !failed) {
+            failed = file.flush() != STREAM_OK;
+        }
+        return failed ? ASCII_SYSTEM_ERROR : ASCII_OK;
+    }
+
+    // Write the remaining events, stop the thread and close the file
+    int close() {
+        if (writer == NULL) {
+            return failed ? ASCII_SYSTEM_ERROR : ASCII_OK;
+        }
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            stopping = true;
+            not_empty.notify_one();
+        }
+        thread.join();
+        writer->close();
+        failed = file.close() != STREAM_OK || failed;
+        delete writer;
+        writer = NULL;
+        return failed ? ASCII_SYSTEM_ERROR : ASCII_OK;
+    }
+
+  private:
+    void run() {
+        std::unique_lock<std::mutex> lock(mutex);
+        while (true) {
+            not_empty.wait(lock, [this] { return !queue.empty() || stopping; });
+            if (queue.empty()) break;
+            HepMC::shared_ptr<HepMC::GenEvent> event;
+            event.swap(queue.front());
+            queue.pop_front();
+            writing = true;
+            bool skip = failed;
+            not_full.notify_one();
+            lock.unlock();
+            if (!skip) {
+                writer->write_event(*event);
+            }
+            // release the event outside of the lock
+            event.reset();
+            lock.lock();
+            writing = false;
+            if (file.stream().fail()) {
+                // wake up writers waiting for space that would never come
+                failed = true;
+                not_full.notify_all();
+            }
+            if (queue.empty()) {
+                idle.notify_all();
+            }
+        }
+        idle.notify_all();
+    }
+
+    OutputFile file;
+    HepMC::WriterAscii* writer;
+    std::thread thread;
+    std::mutex mutex;
+    std::condition_variable not_empty, not_full, idle;
+    std::deque<HepMC::shared_ptr<HepMC::GenEvent> > queue;
+    size_t max_pending;
+    bool writing;
+    bool stopping;
+    bool failed;
+};
+
+#endif // NUMPYTHIA_HEPMC_ASCII_H
@@ -0,0 +1,622 @@
+#ifndef NUMPYTHIA_HEPMC_BINARY_H
+#define NUMPYTHIA_HEPMC_BINARY_H
+
+#include "HepMC/GenEvent.h"
+#include "HepMC/GenRunInfo.h"
+#include "HepMC/Data/GenEventData.h"
+#include "HepMC/Data/GenRunInfoData.h"
+
+#include "hepmc_ascii.h"
+
+#include <string>
+#include <vector>
+#include <algorithm>
+#include <cstdio>
+#include <cstring>
+#include <mutex>
+#include <stdint.h>
+
+
+// Status codes of the binary event format
+enum BinaryStatus {
+    BINARY_OK = 0,
+    BINARY_END,
+    BINARY_SYSTEM_ERROR,
+    BINARY_FORMAT_ERROR
+};
+
+
+// Binary event files store HepMC::GenEventData of blocks of events as
+// column arrays in native byte order:
+//
+//   BinaryFileHeader, run information as string columns
+//   blocks of BinaryBlockHeader followed by the columns of BinaryBlock
+//   BinaryBlockIndex of every block
+//   BinaryFileFooter
+//
+// Every column starts at a multiple of 8 bytes, so that a mapped block can
+// be used in place.
+static const char BINARY_MAGIC[8] = {'N', 'P', 'Y', 'H', 'M', 'C', 'B', 'N'};
+static const uint64_t BINARY_VERSION = 1;
+
+struct BinaryFileHeader {
+    char magic[8];
+    uint64_t version;
+    uint64_t run_info_size;
+};
+
+struct BinaryBlockHeader {
+    uint64_t size;  // bytes including this header
+    uint64_t nevents;
+    uint64_t nparticles;
+    uint64_t nvertices;
+    uint64_t nlinks;
+    uint64_t nweights;
+    uint64_t nattributes;
+    uint64_t attribute_name_bytes;
+    uint64_t attribute_string_bytes;
+};
+
+struct BinaryBlockIndex {
+    uint64_t offset;
+    uint64_t first_event;
+};
+
+struct BinaryFileFooter {
+    uint64_t index_offset;
+    uint64_t nblocks;
+    uint64_t nevents;
+    char magic[8];
+};
+
+
+// Columns of one block. The offsets columns have one entry more than rows
+// and give the range of the particles, vertices, links, weights and
+// attributes of each event, and of the characters of each attribute.
+struct BinaryBlock {
+    BinaryBlockHeader header;
+    const int32_t* event_number;
+    const int32_t* momentum_unit;
+    const int32_t* length_unit;
+    const double* event_pos;          // x, y, z, t per event
+    const int64_t* particle_offsets;
+    const int64_t* vertex_offsets;
+    const int64_t* link_offsets;
+    const int64_t* weight_offsets;
+    const int64_t* attribute_offsets;
+    const int32_t* pid;
+    const int32_t* status;
+    const uint8_t* is_mass_set;
+    const double* mass;
+    const double* momentum;           // px, py, pz, e per particle
+    const int32_t* vertex_status;
+    const double* position;           // x, y, z, t per vertex
+    const int32_t* links1;
+    const int32_t* links2;
+    const double* weights;
+    const int32_t* attribute_id;
+    const int64_t* attribute_name_offsets;
+    const char* attribute_names;
+    const int64_t* attribute_string_offsets;
+    const char* attribute_strings;
+};
+
+
+inline uint64_t binary_padded(uint64_t size) {
+    return (size + 7) / 8 * 8;
+}
+
+
+// Point the columns of block into the data following its header and
+// return the size of the block, which is at most available bytes, or 0 if
+// the block does not fit.
+inline uint64_t binary_layout(const char* data, uint64_t available, BinaryBlock& block) {
+    if (available < sizeof(BinaryBlockHeader)) return 0;
+    memcpy(&block.header, data, sizeof(BinaryBlockHeader));
+    const BinaryBlockHeader& h = block.header;
+    uint64_t limit = available / 8;
+    if (h.nevents > limit || h.nparticles > limit || h.nvertices > limit || h.nlinks > limit ||
+        h.nweights > limit || h.nattributes > limit || h.attribute_name_bytes > available ||
+        h.attribute_string_bytes > available) {
+        return 0;
+    }
+    uint64_t position = sizeof(BinaryBlockHeader);
+#define NUMPYTHIA_COLUMN(name, type, count) \
+    block.name = (const type*) (data + position); \
+    position += binary_padded((count) * sizeof(type));
+    NUMPYTHIA_COLUMN(event_number, int32_t, h.nevents)
+    NUMPYTHIA_COLUMN(momentum_unit, int32_t, h.nevents)
+    NUMPYTHIA_COLUMN(length_unit, int32_t, h.nevents)
+    NUMPYTHIA_COLUMN(event_pos, double, 4 * h.nevents)
+    NUMPYTHIA_COLUMN(particle_offsets, int64_t, h.nevents + 1)
+    NUMPYTHIA_COLUMN(vertex_offsets, int64_t, h.nevents + 1)
+    NUMPYTHIA_COLUMN(link_offsets, int64_t, h.nevents + 1)
+    NUMPYTHIA_COLUMN(weight_offsets, int64_t, h.nevents + 1)
+    NUMPYTHIA_COLUMN(attribute_offsets, int64_t, h.nevents + 1)
+    NUMPYTHIA_COLUMN(pid, int32_t, h.nparticles)
+    NUMPYTHIA_COLUMN(status, int32_t, h.nparticles)
+    NUMPYTHIA_COLUMN(is_mass_set, uint8_t, h.nparticles)
+    NUMPYTHIA_COLUMN(mass, double, h.nparticles)
+    NUMPYTHIA_COLUMN(momentum, double, 4 * h.nparticles)
+    NUMPYTHIA_COLUMN(vertex_status, int32_t, h.nvertices)
+    NUMPYTHIA_COLUMN(position, double, 4 * h.nvertices)
+    NUMPYTHIA_COLUMN(links1, int32_t, h.nlinks)
+    NUMPYTHIA_COLUMN(links2, int32_t, h.nlinks)
+    NUMPYTHIA_COLUMN(weights, double, h.nweights)
+    NUMPYTHIA_COLUMN(attribute_id, int32_t, h.nattributes)
+    NUMPYTHIA_COLUMN(attribute_name_offsets, int64_t, h.nattributes + 1)
+    NUMPYTHIA_COLUMN(attribute_names, char, h.attribute_name_bytes)
+    NUMPYTHIA_COLUMN(attribute_string_offsets, int64_t, h.nattributes + 1)
+    NUMPYTHIA_COLUMN(attribute_strings, char, h.attribute_string_bytes)
+#undef NUMPYTHIA_COLUMN
+    if (position != h.size || position > available) return 0;
+    return position;
+}
+
+
+// Column of strings as its number, the offsets and the characters
+inline void binary_append_strings(const std::vector<std::string>& strings, std::vector<char>& buffer) {
+    uint64_t count = strings.size();
+    std::vector<int64_t> offsets(1, 0);
+    std::string characters;
+    for (size_t i = 0; i < strings.size(); ++i) {
+        characters += strings[i];
+        offsets.push_back(characters.size());
+    }
+    buffer.insert(buffer.end(), (const char*) &count, (const char*) (&count + 1));
+    buffer.insert(buffer.end(), (const char*) &offsets[0], (const char*) (&offsets[0] + offsets.size()));
+    buffer.insert(buffer.end(), characters.begin(), characters.end());
+    buffer.resize(binary_padded(buffer.size()));
+}
+
+
+inline bool binary_read_strings(const char*& cursor, const char* end, std::vector<std::string>& strings) {
+    uint64_t count;
+    if (end - cursor < 8) return false;
+    memcpy(&count, cursor, 8);
+    if (count + 2 > (uint64_t) (end - cursor) / 8) return false;
+    const int64_t* offsets = (const int64_t*) (cursor + 8);
+    const char* characters = cursor + 8 * (count + 2);
+    if (characters > end || offsets[count] < 0 || offsets[count] > end - characters) return false;
+    strings.clear();
+    for (uint64_t i = 0; i < count; ++i) {
+        if (offsets[i] < 0 || offsets[i] > offsets[i + 1]) return false;
+        strings.push_back(std::string(characters + offsets[i], offsets[i + 1] - offsets[i]));
+    }
+    cursor = characters + binary_padded(offsets[count]);
+    return true;
+}
+
+
+// Writer of binary event files. Events are collected into the columns of a
+// block that is written once it holds block_size events. Events may be
+// written from several threads.
+class WriterBinary {
+  public:
+    WriterBinary(): file(NULL), block_size(1000), offset(0), nevents(0), header_written(false), failed(false) {}
+
+    ~WriterBinary() {
+        close();
+    }
+
+    int open(const std::string& filename, size_t block_size_) {
+        file = fopen(filename.c_str(), "wb");
+        if (file == NULL) {
+            return BINARY_SYSTEM_ERROR;
+        }
+        block_size = block_size_ < 1 ? 1 : block_size_;
+        offset = 0;
+        nevents = 0;
+        header_written = false;
+        failed = false;
+        clear_block();
+        return BINARY_OK;
+    }
+
+    int write_event(const HepMC::GenEvent& event) {
+        std::lock_guard<std::mutex> lock(mutex);
+        if (file == NULL || failed) return BINARY_SYSTEM_ERROR;
+        if (!header_written) {
+            // the run information of the first event is written, as by
+            // HepMC::WriterAscii
+            write_header(event.run_info());
+        }
+        data.particles.clear();
+        data.vertices.clear();
+        data.weights.clear();
+        data.links1.clear();
+        data.links2.clear();
+        data.attribute_id.clear();
+        data.attribute_name.clear();
+        data.attribute_string.clear();
+        event.write_data(data);
+        append(data);
+        if (event_number.size() >= block_size) {
+            write_block();
+        }
+        return failed ? BINARY_SYSTEM_ERROR : BINARY_OK;
+    }
+
+    int close() {
+        std::lock_guard<std::mutex> lock(mutex);
+        if (file == NULL) return failed ? BINARY_SYSTEM_ERROR : BINARY_OK;
+        if (!header_written) {
+            write_header(HepMC::shared_ptr<HepMC::GenRunInfo>());
+        }
+        if (!event_number.empty()) {
+            write_block();
+        }
+        BinaryFileFooter footer;
+        footer.index_offset = offset;
+        footer.nblocks = index.size();
+        footer.nevents = nevents;
+        memcpy(footer.magic, BINARY_MAGIC, sizeof(footer.magic));
+        if (!index.empty()) {
+            write(&index[0], index.size() * sizeof(BinaryBlockIndex));
+        }
+        write(&footer, sizeof(footer));
+        if (fclose(file) != 0) {
+            failed = true;
+        }
+        file = NULL;
+        return failed ? BINARY_SYSTEM_ERROR : BINARY_OK;
+    }
+
+  private:
+    void write(const void* buffer, size_t size) {
+        if (size > 0 && fwrite(buffer, 1, size, file) != size) {
+            failed = true;
+        }
+        offset += size;
+    }
+
+    template <class T>
+    void write_column(const std::vector<T>& column) {
+        static const char padding[8] = {0, 0, 0, 0, 0, 0, 0, 0};
+        size_t size = column.size() * sizeof(T);
+        if (size > 0) {
+            write(&column[0], size);
+        }
+        write(padding, binary_padded(size) - size);
+    }
+
+    void write_header(const HepMC::shared_ptr<HepMC::GenRunInfo>& run_info) {
+        HepMC::GenRunInfoData run_data;
+        if (run_info) {
+            (*run_info).write_data(run_data);
+        }
+        std::vector<char> run_buffer;
+        binary_append_strings(run_data.weight_names, run_buffer);
+        binary_append_strings(run_data.tool_name, run_buffer);
+        binary_append_strings(run_data.tool_version, run_buffer);
+        binary_append_strings(run_data.tool_description, run_buffer);
+        binary_append_strings(run_data.attribute_name, run_buffer);
+        binary_append_strings(run_data.attribute_string, run_buffer);
+        BinaryFileHeader header;
+        memcpy(header.magic, BINARY_MAGIC, sizeof(header.magic));
+        header.version = BINARY_VERSION;
+        header.run_info_size = run_buffer.size();
+        write(&header, sizeof(header));
+        write(&run_buffer[0], run_buffer.size());
+        header_written = true;
+    }
+
+    void append(const HepMC::GenEventData& event) {
+        event_number.push_back(event.event_number);
+        momentum_unit.push_back(event.momentum_unit);
+        length_unit.push_back(event.length_unit);
+        push_four_vector(event_pos, event.event_pos);
+        for (size_t i = 0; i < event.particles.size(); ++i) {
+            const HepMC::GenParticleData& particle = event.particles[i];
+            pid.push_back(particle.pid);
+            status.push_back(particle.status);
+            is_mass_set.push_back(particle.is_mass_set);
+            mass.push_back(particle.mass);
+            momentum.push_back(particle.momentum.px());
+            momentum.push_back(particle.momentum.py());
+            momentum.push_back(particle.momentum.pz());
+            momentum.push_back(particle.momentum.e());
+        }
+        for (size_t i = 0; i < event.vertices.size(); ++i) {
+            vertex_status.push_back(event.vertices[i].status);
+            push_four_vector(position, event.vertices[i].position);
+        }
+        links1.insert(links1.end(), event.links1.begin(), event.links1.end());
+        links2.insert(links2.end(), event.links2.begin(), event.links2.end());
+        weights.insert(weights.end(), event.weights.begin(), event.weights.end());
+        for (size_t i = 0; i < event.attribute_id.size(); ++i) {
+            attribute_id.push_back(event.attribute_id[i]);
+            attribute_names.insert(attribute_names.end(), event.attribute_name[i].begin(),
+                                   event.attribute_name[i].end());
+            attribute_name_offsets.push_back(attribute_names.size());
+            attribute_strings.insert(attribute_strings.end(), event.attribute_string[i].begin(),
+                                     event.attribute_string[i].end());
+            attribute_string_offsets.push_back(attribute_strings.size());
+        }
+        particle_offsets.push_back(pid.size());
+        vertex_offsets.push_back(vertex_status.size());
+        link_offsets.push_back(links1.size());
+        weight_offsets.push_back(weights.size());
+        attribute_offsets.push_back(attribute_id.size());
+    }
+
+    static void push_four_vector(std::vector<double>& column, const HepMC::FourVector& vector) {
+        column.push_back(vector.x());
+        column.push_back(vector.y());
+        column.push_back(vector.z());
+        column.push_back(vector.t());
+    }
+
+    void write_block() {
+        BinaryBlockIndex entry = {offset, nevents};
+        index.push_back(entry);
+        BinaryBlockHeader header;
+        header.nevents = event_number.size();
+        header.nparticles = pid.size();
+        header.nvertices = vertex_status.size();
+        header.nlinks = links1.size();
+        header.nweights = weights.size();
+        header.nattributes = attribute_id.size();
+        header.attribute_name_bytes = attribute_names.size();
+        header.attribute_string_bytes = attribute_strings.size();
+        header.size = 0;
+        write(&header, sizeof(header));
+        write_column(event_number);
+        write_column(momentum_unit);
+        write_column(length_unit);
+        write_column(event_pos);
+        write_column(particle_offsets);
+        write_column(vertex_offsets);
+        write_column(link_offsets);
+        write_column(weight_offsets);
+        write_column(attribute_offsets);
+        write_column(pid);
+        write_column(status);
+        write_column(is_mass_set);
+        write_column(mass);
+        write_column(momentum);
+        write_column(vertex_status);
+        write_column(position);
+        write_column(links1);
+        write_column(links2);
+        write_column(weights);
+        write_column(attribute_id);
+        write_column(attribute_name_offsets);
+        write_column(attribute_names);
+        write_column(attribute_string_offsets);
+        write_column(attribute_strings);
+        // the size is only known now
+        header.size = offset - entry.offset;
+        if (fseek(file, entry.offset, SEEK_SET) != 0 ||
+            fwrite(&header.size, sizeof(header.size), 1, file) != 1 ||
+            fseek(file, offset, SEEK_SET) != 0) {
+            failed = true;
+        }
+        nevents += header.nevents;
+        clear_block();
+    }
+
+    void clear_block() {
+        event_number.clear();
+        momentum_unit.clear();
+        length_unit.clear();
+        event_pos.clear();
+        pid.clear();
+        status.clear();
+        is_mass_set.clear();
+        mass.clear();
+        momentum.clear();
+        vertex_status.clear();
+        position.clear();
+        links1.clear();
+        links2.clear();
+        weights.clear();
+        attribute_id.clear();
+        attribute_names.clear();
+        attribute_strings.clear();
+        particle_offsets.assign(1, 0);
+        vertex_offsets.assign(1, 0);
+        link_offsets.assign(1, 0);
+        weight_offsets.assign(1, 0);
+        attribute_offsets.assign(1, 0);
+        attribute_name_offsets.assign(1, 0);
+        attribute_string_offsets.assign(1, 0);
+    }
+
+    FILE* file;
+    size_t block_size;
+    uint64_t offset;
+    uint64_t nevents;
+    bool header_written;
+    bool failed;
+    // guards everything below and the state above
+    std::mutex mutex;
+    // reused for the GenEventData of each event
+    HepMC::GenEventData data;
+    std::vector<BinaryBlockIndex> index;
+    std::vector<int32_t> event_number, momentum_unit, length_unit;
+    std::vector<double> event_pos;
+    std::vector<int64_t> particle_offsets, vertex_offsets, link_offsets, weight_offsets, attribute_offsets;
+    std::vector<int32_t> pid, status;
+    std::vector<uint8_t> is_mass_set;
+    std::vector<double> mass, momentum;
+    std::vector<int32_t> vertex_status;
+    std::vector<double> position;
+    std::vector<int32_t> links1, links2;
+    std::vector<double> weights;
+    std::vector<int32_t> attribute_id;
+    std::vector<int64_t> attribute_name_offsets, attribute_string_offsets;
+    std::vector<char> attribute_names, attribute_strings;
+};
+
+
+// Memory mapped reader of binary event files. The columns of a block are
+// read in place and events are rebuilt with HepMC::GenEvent::read_data.
+// Once opened, events may be read from several threads at the same time.
+class ReaderBinary {
+  public:
+    ReaderBinary(): run_info(HepMC::make_shared<HepMC::GenRunInfo>()), nevents(0) {}
+
+    int open(const std::string& filename) {
+        if (file.open(filename) != ASCII_OK) {
+            return BINARY_SYSTEM_ERROR;
+        }
+        BinaryFileHeader header;
+        BinaryFileFooter footer;
+        if (file.size() < sizeof(header) + sizeof(footer)) {
+            return BINARY_FORMAT_ERROR;
+        }
+        memcpy(&header, file.data(), sizeof(header));
+        memcpy(&footer, file.end() - sizeof(footer), sizeof(footer));
+        uint64_t index_end = file.size() - sizeof(footer);
+        if (memcmp(header.magic, BINARY_MAGIC, sizeof(header.magic)) != 0 || header.version != BINARY_VERSION ||
+            memcmp(footer.magic, BINARY_MAGIC, sizeof(footer.magic)) != 0 ||
+            header.run_info_size > index_end - sizeof(header) ||
+            footer.index_offset > index_end ||
+            footer.nblocks * sizeof(BinaryBlockIndex) != index_end - footer.index_offset) {
+            return BINARY_FORMAT_ERROR;
+        }
+        // run information
+        HepMC::GenRunInfoData run_data;
+        const char* cursor = file.data() + sizeof(header);
+        const char* run_end = cursor + header.run_info_size;
+        if (!binary_read_strings(cursor, run_end, run_data.weight_names) ||
+            !binary_read_strings(cursor, run_end, run_data.tool_name) ||
+            !binary_read_strings(cursor, run_end, run_data.tool_version) ||
+            !binary_read_strings(cursor, run_end, run_data.tool_description) ||
+            !binary_read_strings(cursor, run_end, run_data.attribute_name) ||
+            !binary_read_strings(cursor, run_end, run_data.attribute_string)) {
+            return BINARY_FORMAT_ERROR;
+        }
+        (*run_info).read_data(run_data);
+        // block index
+        index.resize(footer.nblocks);
+        if (footer.nblocks > 0) {
+            memcpy(&index[0], file.data() + footer.index_offset, footer.nblocks * sizeof(BinaryBlockIndex));
+        }
+        blocks.resize(footer.nblocks);
+        for (size_t iblock = 0; iblock < index.size(); ++iblock) {
+            if (index[iblock].offset > footer.index_offset ||
+                binary_layout(file.data() + index[iblock].offset, footer.index_offset - index[iblock].offset,
+                              blocks[iblock]) == 0 ||
+                index[iblock].first_event != (iblock == 0 ? 0 : index[iblock - 1].first_event +
+                                              blocks[iblock - 1].header.nevents)) {
+                return BINARY_FORMAT_ERROR;
+            }
+        }
+        nevents = footer.nevents;
+        if (nevents != (index.empty() ? 0 : index.back().first_event + blocks.back().header.nevents)) {
+            return BINARY_FORMAT_ERROR;
+        }
+        return BINARY_OK;
+    }
+
+    size_t size() const { return nevents; }
+
+    size_t num_blocks() const { return blocks.size(); }
+
+    const BinaryBlock& block(size_t iblock) const { return blocks[iblock]; }
+
+    // Index of the first event of a block
+    size_t first_event(size_t iblock) const { return index[iblock].first_event; }
+
+    int read_event(size_t ievent, HepMC::GenEvent& event) {
+        if (ievent >= nevents) return BINARY_END;
+        size_t iblock = std::upper_bound(index.begin(), index.end(), ievent, compare_first_event) - index.begin() - 1;
+        const BinaryBlock& block = blocks[iblock];
+        size_t i = ievent - index[iblock].first_event;
+        HepMC::GenEventData data;
+        if (!fill_data(block, i, data)) return BINARY_FORMAT_ERROR;
+        event.read_data(data);
+        event.set_run_info(run_info);
+        return BINARY_OK;
+    }
+
+    HepMC::shared_ptr<HepMC::GenRunInfo> run_info;
+
+  private:
+    static bool compare_first_event(size_t ievent, const BinaryBlockIndex& entry) {
+        return ievent < entry.first_event;
+    }
+
+    static bool valid_range(const int64_t* offsets, size_t i, uint64_t size) {
+        return offsets[i] >= 0 && offsets[i] <= offsets[i + 1] && (uint64_t) offsets[i + 1] <= size;
+    }
+
+    // GenEventData of event i of a block
+    static bool fill_data(const BinaryBlock& block, size_t i, HepMC::GenEventData& data) {
+        const BinaryBlockHeader& h = block.header;
+        if (!valid_range(block.particle_offsets, i, h.nparticles) ||
+            !valid_range(block.vertex_offsets, i, h.nvertices) ||
+            !valid_range(block.link_offsets, i, h.nlinks) ||
+            !valid_range(block.weight_offsets, i, h.nweights) ||
+            !valid_range(block.attribute_offsets, i, h.nattributes)) {
+            return false;
+        }
+        data.event_number = block.event_number[i];
+        data.momentum_unit = (HepMC::Units::MomentumUnit) block.momentum_unit[i];
+        data.length_unit = (HepMC::Units::LengthUnit) block.length_unit[i];
+        data.event_pos = four_vector(block.event_pos + 4 * i);
+        int64_t first = block.particle_offsets[i];
+        int64_t last = block.particle_offsets[i + 1];
+        data.particles.resize(last - first);
+        for (int64_t j = first; j < last; ++j) {
+            HepMC::GenParticleData& particle = data.particles[j - first];
+            particle.pid = block.pid[j];
+            particle.status = block.status[j];
+            particle.is_mass_set = block.is_mass_set[j];
+            particle.mass = block.mass[j];
+            particle.momentum = four_vector(block.momentum + 4 * j);
+        }
+        first = block.vertex_offsets[i];
+        last = block.vertex_offsets[i + 1];
+        int nparticles = data.particles.size();
+        int nvertices = last - first;
+        data.vertices.resize(nvertices);
+        for (int64_t j = first; j < last; ++j) {
+            data.vertices[j - first].status = block.vertex_status[j];
+            data.vertices[j - first].position = four_vector(block.position + 4 * j);
+        }
+        first = block.link_offsets[i];
+        last = block.link_offsets[i + 1];
+        data.links1.assign(block.links1 + first, block.links1 + last);
+        data.links2.assign(block.links2 + first, block.links2 + last);
+        for (size_t j = 0; j < data.links1.size(); ++j) {
+            // GenEvent::read_data does not check the links
+            int id1 = data.links1[j], id2 = data.links2[j];
+            int particle = id1 > 0 ? id1 : id2;
+            int vertex = id1 > 0 ? id2 : id1;
+            if (particle < 1 || particle > nparticles || vertex > -1 || vertex < -nvertices) return false;
+        }
+        data.weights.assign(block.weights + block.weight_offsets[i], block.weights + block.weight_offsets[i + 1]);
+        first = block.attribute_offsets[i];
+        last = block.attribute_offsets[i + 1];
+        data.attribute_id.assign(block.attribute_id + first, block.attribute_id + last);
+        data.attribute_name.clear();
+        data.attribute_string.clear();
+        for (int64_t j = first; j < last; ++j) {
+            if (!valid_range(block.attribute_name_offsets, j, h.attribute_name_bytes) ||
+                !valid_range(block.attribute_string_offsets, j, h.attribute_string_bytes)) {
+                return false;
+            }
+            data.attribute_name.push_back(std::string(
+                block.attribute_names + block.attribute_name_offsets[j],
+                block.attribute_name_offsets[j + 1] - block.attribute_name_offsets[j]));
+            data.attribute_string.push_back(std::string(
+                block.attribute_strings + block.attribute_string_offsets[j],
+                block.attribute_string_offsets[j + 1] - block.attribute_string_offsets[j]));
+        }
+        return true;
+    }
+
+    static HepMC::FourVector four_vector(const double* values) {
+        return HepMC::FourVector(values[0], values[1], values[2], values[3]);
+    }
+
+    MappedFile file;
+    std::vector<BinaryBlockIndex> index;
+    std::vector<BinaryBlock> blocks;
+    size_t nevents;
+};
+
+#endif // NUMPYTHIA_HEPMC_BINARY_H
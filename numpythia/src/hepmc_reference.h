@@ -0,0 +1,87 @@
+#ifndef NUMPYTHIA_HEPMC_REFERENCE_H
+#define NUMPYTHIA_HEPMC_REFERENCE_H
+
+#include <sstream>
+#include <string>
+#include <vector>
+
+#include "Pythia8/Pythia.h"
+
+#include "HepMC/GenEvent.h"
+#include "HepMC/GenParticle.h"
+#include "HepMC/GenVertex.h"
+#include "HepMC/WriterAscii.h"
+#include "HepMC/Pythia8ToHepMC3.h"
+
+
+// The conversion of upstream Pythia8ToHepMC3::fill_next_event without the
+// event information: every particle of the record is created and linked to
+// its vertices one at a time, and GenEvent::add_tree then sorts the event
+// starting from the system entry and both beams. Only used by the tests to
+// check the conversion on record indices against it.
+inline void pythia_to_hepmc_reference(const Pythia8::Event& pyev, HepMC::GenEvent* evt) {
+    evt->set_units(HepMC::Units::GEV, HepMC::Units::MM);
+
+    std::vector<HepMC::GenParticlePtr> hepevt_particles;
+    hepevt_particles.reserve(pyev.size());
+    for (int i = 0; i < pyev.size(); ++i) {
+        hepevt_particles.push_back(HepMC::make_shared<HepMC::GenParticle>(
+            HepMC::FourVector(pyev[i].px(), pyev[i].py(), pyev[i].pz(), pyev[i].e()),
+            pyev[i].id(), pyev[i].statusHepMC()));
+        hepevt_particles[i]->set_generated_mass(pyev[i].m());
+    }
+
+    // particles only hold weak references to their end vertex
+    std::vector<HepMC::GenVertexPtr> vertex_cache;
+    for (int i = 1; i < pyev.size(); ++i) {
+        std::vector<int> mothers = pyev[i].motherList();
+        if (mothers.empty()) continue;
+        HepMC::GenVertexPtr prod_vtx = hepevt_particles[mothers[0]]->end_vertex();
+        if (!prod_vtx) {
+            prod_vtx = HepMC::make_shared<HepMC::GenVertex>();
+            vertex_cache.push_back(prod_vtx);
+            for (size_t j = 0; j < mothers.size(); ++j) {
+                prod_vtx->add_particle_in(hepevt_particles[mothers[j]]);
+            }
+        }
+        HepMC::FourVector prod_pos(pyev[i].xProd(), pyev[i].yProd(),
+                                   pyev[i].zProd(), pyev[i].tProd());
+        if (!prod_pos.is_zero() && prod_vtx->position().is_zero()) prod_vtx->set_position(prod_pos);
+        prod_vtx->add_particle_out(hepevt_particles[i]);
+    }
+
+    evt->reserve(hepevt_particles.size(), vertex_cache.size());
+    std::vector<HepMC::GenParticlePtr> beam_particles;
+    for (int i = 0; i < 3 && i < pyev.size(); ++i) {
+        beam_particles.push_back(hepevt_particles[i]);
+    }
+    evt->add_tree(beam_particles);
+}
+
+
+// The current PYTHIA event converted by Pythia8ToHepMC3 and by
+// pythia_to_hepmc_reference, both written as HepMC3 ASCII
+inline void pythia_hepmc_reference(Pythia8::Pythia& pythia, std::string& converted, std::string& reference) {
+    HepMC::Pythia8ToHepMC3 py2hepmc;
+    py2hepmc.set_print_inconsistency(false);
+    py2hepmc.set_free_parton_warnings(false);
+    HepMC::GenEvent event;
+    py2hepmc.fill_next_event(pythia.event, &event, 0);
+    HepMC::GenEvent reference_event;
+    pythia_to_hepmc_reference(pythia.event, &reference_event);
+    reference_event.set_event_number(0);
+
+    std::ostringstream converted_stream, reference_stream;
+    {
+        HepMC::WriterAscii writer(converted_stream);
+        writer.write_event(event);
+    }
+    {
+        HepMC::WriterAscii writer(reference_stream);
+        writer.write_event(reference_event);
+    }
+    converted = converted_stream.str();
+    reference = reference_stream.str();
+}
+
+#endif
@@ -5,6 +5,13 @@
 #include "HepMC/GenEvent.h"
 #include "HepMC/WriterAscii.h"
 #include "HepMC/ReaderAscii.h"
+#include "HepMC/Pythia8ToHepMC3.h"
+#include "HepMC/Search/FindParticles.h"
+
+#include "kinematics.h"
+#include "selection.h"
+#include "hepmc_ascii.h"
+#include "event_pool.h"
 
 //#include "fastjet/ClusterSequence.hh"
 
@@ -23,18 +30,95 @@
 //#include <algorithm>
 //#include <math.h>
 #include <vector>
+#include <algorithm>
+#include <cstring>
 
 
-void hepmc_to_array(std::vector<HepMC::SmartPointer<HepMC::GenParticle> >& particles,
-                    char* array, unsigned int rowbytes) {
+// Status codes of the generation path that runs without the GIL.
+// Errors are reported through the return value instead of raising
+// Python exceptions so that the caller can translate them afterwards.
+enum NextStatus {
+    NEXT_OK = 0,
+    NEXT_ABORTED,
+    NEXT_CONVERSION_FAILED
+};
+
+
+int pythia_next(Pythia8::Pythia& pythia) {
+    // generate event and report failure
+    if (!pythia.next()) {
+        return NEXT_ABORTED;
+    }
+    return NEXT_OK;
+}
+
+
+// Convert the current PYTHIA event. With arenas the particles and vertices
+// are allocated in an arena of the pool that no earlier event uses anymore.
+int pythia_to_hepmc(Pythia8::Pythia& pythia, HepMC::GenEvent* event,
+                    HepMC::EventArenaPool* arenas = NULL) {
+    HepMC::Pythia8ToHepMC3 py2hepmc;
+    // Suppress warnings
+    py2hepmc.set_print_inconsistency(false);
+    if (arenas != NULL) {
+        py2hepmc.set_arena(arenas->acquire());
+    }
+    if (!py2hepmc.fill_next_event(pythia, event)) {
+        return NEXT_CONVERSION_FAILED;
+    }
+    return NEXT_OK;
+}
+
+
+int pythia_next_hepmc(Pythia8::Pythia& pythia, HepMC::GenEvent* event,
+                      HepMC::EventArenaPool* arenas = NULL) {
+    int status = pythia_next(pythia);
+    if (status != NEXT_OK) {
+        return status;
+    }
+    return pythia_to_hepmc(pythia, event, arenas);
+}
+
+
+// Position of the production vertex, or zero for particles without one such
+// as incoming beams or particles read from files without vertex information.
+inline HepMC::FourVector production_position(const HepMC::GenParticle& particle) {
+    const HepMC::GenVertexPtr vertex = particle.production_vertex();
+    return vertex ? vertex->position() : HepMC::FourVector::ZERO_VECTOR();
+}
+
+
+// Particles of a HepMC event as a source of rows for the fill functions
+// below. Particles are accessed through references since
+// SmartPointer::operator-> copies the underlying shared_ptr and touches its
+// atomic reference count.
+class HepMCParticles {
+  public:
+    HepMCParticles(const std::vector<HepMC::SmartPointer<HepMC::GenParticle> >& particles):
+        particles(particles) {}
+
+    size_t size() const { return particles.size(); }
+    const HepMC::FourVector& momentum(size_t i) const { return (*particles[i]).momentum(); }
+    HepMC::FourVector position(size_t i) const { return production_position(*particles[i]); }
+    int pid(size_t i) const { return (*particles[i]).pid(); }
+    int status(size_t i) const { return (*particles[i]).status(); }
+
+  private:
+    const std::vector<HepMC::SmartPointer<HepMC::GenParticle> >& particles;
+};
+
+
+template <bool Vertex, class Particles>
+void fill_array_rows(const Particles& particles, char* array, unsigned int rowbytes) {
     HepMC::FourVector momentum, prod_vertex;
     char* row;
     double* double_fields;
     int* int_fields;
-    unsigned int i = 0;
-    FOREACH (const HepMC::SmartPointer<HepMC::GenParticle>& particle, particles) {
-        momentum = particle->momentum();
-        prod_vertex = particle->production_vertex()->position();
+    for (size_t i = 0; i < particles.size(); ++i) {
+        momentum = particles.momentum(i);
+        if (Vertex) {
+            prod_vertex = particles.position(i);
+        }
         row = &array[i * rowbytes];
         // doubles
         double_fields = (double*) row;
@@ -54,12 +138,494 @@ void hepmc_to_array(std::vector<HepMC::SmartPointer<HepMC::GenParticle> >& parti
         double_fields[13] = prod_vertex.t();
         // integers
         int_fields = (int*)&row[14 * sizeof(double)];
-        int_fields[0] = particle->pid();
-        int_fields[1] = particle->status();
-        ++i;
+        int_fields[0] = particles.pid(i);
+        int_fields[1] = particles.status(i);
+    }
+}
+
+
+// Fill rows of DTYPE_PARTICLE. Without vertices the production vertex of
+// each particle is not looked up and the prod* fields are set to zero.
+template <class Particles>
+void fill_array(const Particles& particles, char* array, unsigned int rowbytes, bool vertices) {
+    if (vertices) {
+        fill_array_rows<true>(particles, array, rowbytes);
+    } else {
+        fill_array_rows<false>(particles, array, rowbytes);
+    }
+}
+
+// Columns of DTYPE_PARTICLE in order
+enum ParticleField {
+    FIELD_E = 0, FIELD_PX, FIELD_PY, FIELD_PZ,
+    FIELD_PT, FIELD_MASS, FIELD_RAP, FIELD_ETA, FIELD_THETA, FIELD_PHI,
+    FIELD_PRODX, FIELD_PRODY, FIELD_PRODZ, FIELD_PRODT,
+    FIELD_PDGID, FIELD_STATUS,
+    NUM_FIELDS
+};
+
+
+template <typename T>
+inline void store_field(char* row, int offset, T value) {
+    // fields of a reduced dtype are packed and need not be aligned
+    if (offset >= 0) {
+        std::memcpy(row + offset, &value, sizeof(T));
+    }
+}
+
+
+// Fill only the requested columns. offsets holds the byte offset of each
+// ParticleField in a row, or -1 if the column is not requested. The derived
+// kinematics and the production vertex are compiled out entirely unless one
+// of their columns is requested. Without Vertex requested prod* columns are
+// set to zero.
+template <bool Derived, bool Vertex, class Particles>
+void fill_fields(const Particles& particles, char* array, unsigned int rowbytes, const int* offsets) {
+    char* row = array;
+    for (size_t i = 0; i < particles.size(); ++i) {
+        const HepMC::FourVector& momentum = particles.momentum(i);
+        store_field(row, offsets[FIELD_E], momentum.e());
+        store_field(row, offsets[FIELD_PX], momentum.px());
+        store_field(row, offsets[FIELD_PY], momentum.py());
+        store_field(row, offsets[FIELD_PZ], momentum.pz());
+        if (Derived) {
+            if (offsets[FIELD_PT] >= 0) store_field(row, offsets[FIELD_PT], momentum.pt());
+            if (offsets[FIELD_MASS] >= 0) store_field(row, offsets[FIELD_MASS], momentum.m());
+            if (offsets[FIELD_RAP] >= 0) store_field(row, offsets[FIELD_RAP], momentum.rap());
+            if (offsets[FIELD_ETA] >= 0) store_field(row, offsets[FIELD_ETA], momentum.eta());
+            if (offsets[FIELD_THETA] >= 0) store_field(row, offsets[FIELD_THETA], momentum.theta());
+            if (offsets[FIELD_PHI] >= 0) store_field(row, offsets[FIELD_PHI], momentum.phi());
+        }
+        if (Vertex) {
+            HepMC::FourVector prod_vertex = particles.position(i);
+            store_field(row, offsets[FIELD_PRODX], prod_vertex.x());
+            store_field(row, offsets[FIELD_PRODY], prod_vertex.y());
+            store_field(row, offsets[FIELD_PRODZ], prod_vertex.z());
+            store_field(row, offsets[FIELD_PRODT], prod_vertex.t());
+        } else {
+            store_field(row, offsets[FIELD_PRODX], 0.);
+            store_field(row, offsets[FIELD_PRODY], 0.);
+            store_field(row, offsets[FIELD_PRODZ], 0.);
+            store_field(row, offsets[FIELD_PRODT], 0.);
+        }
+        store_field(row, offsets[FIELD_PDGID], particles.pid(i));
+        store_field(row, offsets[FIELD_STATUS], particles.status(i));
+        row += rowbytes;
     }
 }
 
+
+template <class Particles>
+void fill_array_fields(const Particles& particles, char* array, unsigned int rowbytes,
+                       const std::vector<int>& offsets, bool vertices) {
+    bool derived = false, vertex = false;
+    for (int field = FIELD_PT; field <= FIELD_PHI; ++field) {
+        derived = derived || offsets[field] >= 0;
+    }
+    for (int field = FIELD_PRODX; field <= FIELD_PRODT; ++field) {
+        vertex = vertex || (vertices && offsets[field] >= 0);
+    }
+    if (derived && vertex) {
+        fill_fields<true, true>(particles, array, rowbytes, &offsets[0]);
+    } else if (derived) {
+        fill_fields<true, false>(particles, array, rowbytes, &offsets[0]);
+    } else if (vertex) {
+        fill_fields<false, true>(particles, array, rowbytes, &offsets[0]);
+    } else {
+        fill_fields<false, false>(particles, array, rowbytes, &offsets[0]);
+    }
+}
+
+// Fill one contiguous column per field. columns[field] points to an array of
+// doubles, or ints for pdgid and status, with room for all particles, or is
+// NULL if the column is not requested. The derived kinematics are computed in
+// a second pass over the momentum columns with the kernels of kinematics.h.
+// Without vertices the prod* columns are set to zero.
+template <class Particles>
+void fill_columns(const Particles& particles, const std::vector<char*>& columns, bool vertices) {
+    size_t n = particles.size();
+    bool derived = false, vertex = false;
+    for (int field = FIELD_PT; field <= FIELD_PHI; ++field) {
+        derived = derived || columns[field] != NULL;
+    }
+    for (int field = FIELD_PRODX; field <= FIELD_PRODT; ++field) {
+        vertex = vertex || columns[field] != NULL;
+    }
+    // momentum columns needed by the derived kinematics but not requested
+    std::vector<double> scratch;
+    double* momentum[4];
+    for (int field = FIELD_E; field <= FIELD_PZ; ++field) {
+        momentum[field] = (double*) columns[field];
+        if (derived && momentum[field] == NULL) {
+            scratch.resize(scratch.size() + n);
+        }
+    }
+    double* next_scratch = scratch.empty() ? NULL : &scratch[0];
+    for (int field = FIELD_E; field <= FIELD_PZ; ++field) {
+        if (derived && momentum[field] == NULL) {
+            momentum[field] = next_scratch;
+            next_scratch += n;
+        }
+    }
+    double* prod[4];
+    for (int field = FIELD_PRODX; field <= FIELD_PRODT; ++field) {
+        prod[field - FIELD_PRODX] = (double*) columns[field];
+    }
+    int* pdgid = (int*) columns[FIELD_PDGID];
+    int* status = (int*) columns[FIELD_STATUS];
+    if (!vertices) {
+        for (int field = 0; field < 4; ++field) {
+            if (prod[field] != NULL) std::fill(prod[field], prod[field] + n, 0.);
+        }
+        vertex = false;
+    }
+
+    // first pass: gather the stored quantities
+    for (size_t i = 0; i < n; ++i) {
+        const HepMC::FourVector& p = particles.momentum(i);
+        if (momentum[FIELD_E] != NULL) momentum[FIELD_E][i] = p.e();
+        if (momentum[FIELD_PX] != NULL) momentum[FIELD_PX][i] = p.px();
+        if (momentum[FIELD_PY] != NULL) momentum[FIELD_PY][i] = p.py();
+        if (momentum[FIELD_PZ] != NULL) momentum[FIELD_PZ][i] = p.pz();
+        if (vertex) {
+            HepMC::FourVector position = particles.position(i);
+            if (prod[0] != NULL) prod[0][i] = position.x();
+            if (prod[1] != NULL) prod[1][i] = position.y();
+            if (prod[2] != NULL) prod[2][i] = position.z();
+            if (prod[3] != NULL) prod[3][i] = position.t();
+        }
+        if (pdgid != NULL) pdgid[i] = particles.pid(i);
+        if (status != NULL) status[i] = particles.status(i);
+    }
+    if (!derived || n == 0) {
+        return;
+    }
+
+    // second pass: derived kinematics column by column
+    const double* e = momentum[FIELD_E];
+    const double* px = momentum[FIELD_PX];
+    const double* py = momentum[FIELD_PY];
+    const double* pz = momentum[FIELD_PZ];
+    double* pt = (double*) columns[FIELD_PT];
+    std::vector<double> pt_scratch;
+    if (pt == NULL && columns[FIELD_THETA] != NULL) {
+        pt_scratch.resize(n);
+        pt = &pt_scratch[0];
+    }
+    if (pt != NULL) {
+        kinematics_pt(n, px, py, pt);
+    }
+    if (columns[FIELD_MASS] != NULL) {
+        kinematics_mass(n, px, py, pz, e, (double*) columns[FIELD_MASS]);
+    }
+    if (columns[FIELD_RAP] != NULL) {
+        kinematics_rap_ratio(n, pz, e, (double*) columns[FIELD_RAP]);
+        kinematics_half_log(n, (double*) columns[FIELD_RAP]);
+    }
+    if (columns[FIELD_ETA] != NULL) {
+        kinematics_eta_ratio(n, px, py, pz, (double*) columns[FIELD_ETA]);
+        kinematics_half_log(n, (double*) columns[FIELD_ETA]);
+    }
+    if (columns[FIELD_THETA] != NULL) {
+        kinematics_atan2(n, pt, pz, (double*) columns[FIELD_THETA]);
+    }
+    if (columns[FIELD_PHI] != NULL) {
+        kinematics_atan2(n, py, px, (double*) columns[FIELD_PHI]);
+    }
+}
+
+
+void hepmc_to_array(std::vector<HepMC::SmartPointer<HepMC::GenParticle> >& particles,
+                    char* array, unsigned int rowbytes, bool vertices = true) {
+    fill_array(HepMCParticles(particles), array, rowbytes, vertices);
+}
+
+
+void hepmc_to_array_fields(std::vector<HepMC::SmartPointer<HepMC::GenParticle> >& particles,
+                           char* array, unsigned int rowbytes, const std::vector<int>& offsets,
+                           bool vertices = true) {
+    fill_array_fields(HepMCParticles(particles), array, rowbytes, offsets, vertices);
+}
+
+
+void hepmc_to_columns(std::vector<HepMC::SmartPointer<HepMC::GenParticle> >& particles,
+                      const std::vector<char*>& columns, bool vertices = true) {
+    fill_columns(HepMCParticles(particles), columns, vertices);
+}
+
+// The PYTHIA event record seen as the HepMC graph Pythia8ToHepMC3 would build
+// from it. Only the vertex indices are computed, no GenParticle or GenVertex is
+// allocated, and particle arrays are filled directly from the PYTHIA record.
+// Particles are in the order of the record, or in the order of the HepMC
+// event if hepmc_order is true.
+class PythiaRecord {
+  public:
+    PythiaRecord(const Pythia8::Event& event, bool hepmc_order = false):
+        event(event),
+        graph(event),
+        vertex_position(graph.position),
+        same_pdg_id_daughter(event.size(), false) {
+        if (hepmc_order) {
+            // as added to a new GenEvent, whose root vertex is not in the event
+            graph.sort(false);
+            particles.swap(graph.particle_order);
+        } else {
+            // The system entry 0 only belongs to the HepMC event if it decays
+            particles.reserve(event.size());
+            for (int i = 0; i < event.size(); ++i) {
+                if (i > 0 || graph.end_vertex[0] >= 0) {
+                    particles.push_back(i);
+                }
+            }
+        }
+        // Vertices without a position inherit it from the production vertex
+        // of their first incoming particle as in GenVertex::position()
+        std::vector<int> chain;
+        std::vector<bool> resolved(vertex_position.size(), false);
+        for (unsigned int vertex = 0; vertex < vertex_position.size(); ++vertex) {
+            int current = vertex;
+            HepMC::FourVector position;
+            while (current >= 0 && !resolved[current]) {
+                if (!vertex_position[current].is_zero()) break;
+                chain.push_back(current);
+                current = first_production_vertex(current);
+            }
+            if (current >= 0) position = vertex_position[current];
+            FOREACH (int link, chain) {
+                vertex_position[link] = position;
+                resolved[link] = true;
+            }
+            chain.clear();
+            resolved[vertex] = true;
+        }
+        // Flag incoming particles with an outgoing particle of the same pdg id
+        for (int i = 1; i < event.size(); ++i) {
+            int vertex = graph.production_vertex[i];
+            if (vertex < 0) continue;
+            HepMC::Pythia8Mothers mothers = graph.mothers(vertex);
+            for (int j = mothers.first; j <= mothers.last; j += mothers.step) {
+                if (graph.end_vertex[j] == vertex && event[j].id() == event[i].id()) {
+                    same_pdg_id_daughter[j] = true;
+                }
+            }
+        }
+    }
+
+    // Select particles like SelectionProgram::select with FIND_ALL (mode 0),
+    // FIND_FIRST (1) or FIND_LAST (2)
+    void select(const SelectionProgram& selection, std::vector<int>& indices, int mode = 0) const {
+        indices.clear();
+        if (selection.empty()) {
+            if (mode == 0) {
+                indices = particles;
+            } else if (!particles.empty()) {
+                indices.push_back(mode == 2 ? particles.back() : particles.front());
+            }
+            return;
+        }
+        SelectionColumns columns;
+        std::vector<unsigned char> mask;
+        fill_columns(selection, columns);
+        selection.evaluate(columns, mask);
+        size_t n = particles.size();
+        for (size_t i = 0; i < n; ++i) {
+            size_t j = mode == 2 ? n - 1 - i : i;
+            if (mask[j]) {
+                indices.push_back(particles[j]);
+                if (mode != 0) return;
+            }
+        }
+    }
+
+    // The particles at indices as by hepmc_to_array, hepmc_to_array_fields
+    // and hepmc_to_columns
+    void to_array(const std::vector<int>& indices, char* array, unsigned int rowbytes,
+                  bool vertices = true) const {
+        fill_array(Particles(*this, indices), array, rowbytes, vertices);
+    }
+
+    void to_array_fields(const std::vector<int>& indices, char* array, unsigned int rowbytes,
+                         const std::vector<int>& offsets, bool vertices = true) const {
+        fill_array_fields(Particles(*this, indices), array, rowbytes, offsets, vertices);
+    }
+
+    void to_columns(const std::vector<int>& indices, const std::vector<char*>& columns,
+                    bool vertices = true) const {
+        ::fill_columns(Particles(*this, indices), columns, vertices);
+    }
+
+  private:
+    // Source of rows for the fill functions
+    class Particles {
+      public:
+        Particles(const PythiaRecord& record, const std::vector<int>& indices):
+            record(record), indices(indices) {}
+
+        size_t size() const { return indices.size(); }
+
+        HepMC::FourVector momentum(size_t i) const {
+            const Pythia8::Particle& particle = record.event[indices[i]];
+            return HepMC::FourVector(particle.px(), particle.py(), particle.pz(), particle.e());
+        }
+
+        HepMC::FourVector position(size_t i) const {
+            int vertex = record.graph.production_vertex[indices[i]];
+            return vertex < 0 ? HepMC::FourVector() : record.vertex_position[vertex];
+        }
+
+        int pid(size_t i) const { return record.event[indices[i]].id(); }
+        int status(size_t i) const { return record.event[indices[i]].statusHepMC(); }
+
+      private:
+        const PythiaRecord& record;
+        const std::vector<int>& indices;
+    };
+
+    // Particles without a production vertex are attached to the root vertex
+    void fill_columns(const SelectionProgram& selection, SelectionColumns& columns) const {
+        size_t n = particles.size();
+        columns.size = n;
+        if (selection.needs(SEL_STATUS)) {
+            columns.status.resize(n);
+            for (size_t i = 0; i < n; ++i) columns.status[i] = event[particles[i]].statusHepMC();
+        }
+        if (selection.needs(SEL_PDG_ID)) {
+            columns.pdg_id.resize(n);
+            for (size_t i = 0; i < n; ++i) columns.pdg_id[i] = event[particles[i]].id();
+        }
+        if (selection.needs(SEL_HAS_END_VERTEX)) {
+            columns.has_end_vertex.resize(n);
+            for (size_t i = 0; i < n; ++i) columns.has_end_vertex[i] = graph.end_vertex[particles[i]] >= 0;
+        }
+        if (selection.needs(SEL_HAS_PRODUCTION_VERTEX)) {
+            columns.has_production_vertex.assign(n, 1);
+        }
+        if (selection.needs(SEL_HAS_SAME_PDG_ID_DAUGHTER)) {
+            columns.has_same_pdg_id_daughter.resize(n);
+            for (size_t i = 0; i < n; ++i) columns.has_same_pdg_id_daughter[i] = same_pdg_id_daughter[particles[i]];
+        }
+    }
+
+    // Production vertex of the first particle still incoming to a vertex
+    int first_production_vertex(int vertex) const {
+        HepMC::Pythia8Mothers mothers = graph.mothers(vertex);
+        for (int j = mothers.first; j <= mothers.last; j += mothers.step) {
+            if (graph.end_vertex[j] == vertex) return graph.production_vertex[j];
+        }
+        return -1;
+    }
+
+    const Pythia8::Event& event;
+    HepMC::Pythia8Graph graph;
+    std::vector<int> particles;
+    std::vector<HepMC::FourVector> vertex_position;
+    std::vector<bool> same_pdg_id_daughter;
+};
+
+
+// A copy of the current PYTHIA event and of the information that
+// Pythia8ToHepMC3 stores with it, so that the HepMC event can be built
+// later, after the generator has moved on. Until then particle arrays are
+// filled from the record in the order of the HepMC event.
+class PythiaSnapshot {
+  public:
+    PythiaSnapshot(Pythia8::Pythia& pythia):
+        event(pythia.event),
+        hepmc_record(NULL),
+        id1pdf(pythia.info.id1pdf()), id2pdf(pythia.info.id2pdf()),
+        x1pdf(pythia.info.x1pdf()), x2pdf(pythia.info.x2pdf()),
+        scale(pythia.info.QFac()), pdf1(pythia.info.pdf1()), pdf2(pythia.info.pdf2()),
+        sigma(pythia.info.sigmaGen() * 1e9), sigma_error(pythia.info.sigmaErr() * 1e9),
+        hadronize(pythia.settings.flag("HadronLevel:all") && pythia.settings.flag("HadronLevel:Hadronize")) {
+        for (int iweight = 0; iweight < pythia.info.nWeights(); ++iweight) {
+            weights.push_back(pythia.info.weight(iweight));
+        }
+    }
+
+    ~PythiaSnapshot() {
+        delete hepmc_record;
+    }
+
+    // The record in the order of the HepMC event, built on first use
+    PythiaRecord* record() {
+        if (hepmc_record == NULL) {
+            hepmc_record = new PythiaRecord(event, true);
+        }
+        return hepmc_record;
+    }
+
+    // The same event as pythia_to_hepmc at the time of the snapshot
+    int to_hepmc(HepMC::GenEvent* hepmc, HepMC::EventArenaPool* arenas = NULL) {
+        HepMC::Pythia8ToHepMC3 py2hepmc;
+        // Suppress warnings
+        py2hepmc.set_print_inconsistency(false);
+        py2hepmc.set_free_parton_warnings(hadronize);
+        if (arenas != NULL) {
+            py2hepmc.set_arena(arenas->acquire());
+        }
+        if (!py2hepmc.fill_next_event(event, hepmc)) {
+            return NEXT_CONVERSION_FAILED;
+        }
+        HepMC::GenPdfInfoPtr pdf_info = HepMC::make_shared<HepMC::GenPdfInfo>();
+        pdf_info->set(id1pdf, id2pdf, x1pdf, x2pdf, scale, pdf1, pdf2);
+        hepmc->set_pdf_info(pdf_info);
+        HepMC::GenCrossSectionPtr cross_section = HepMC::make_shared<HepMC::GenCrossSection>();
+        cross_section->set_cross_section(sigma, sigma_error);
+        hepmc->set_cross_section(cross_section);
+        hepmc->weights().insert(hepmc->weights().end(), weights.begin(), weights.end());
+        return NEXT_OK;
+    }
+
+    std::vector<double> weights;
+
+  private:
+    PythiaSnapshot(const PythiaSnapshot&);
+    PythiaSnapshot& operator=(const PythiaSnapshot&);
+
+    Pythia8::Event event;
+    PythiaRecord* hepmc_record;
+    int id1pdf, id2pdf;
+    double x1pdf, x2pdf, scale, pdf1, pdf2;
+    double sigma, sigma_error;
+    bool hadronize;
+};
+
+
+// Generate a batch of events and append the selected particles of all events
+// to one buffer of rows. offsets starts with 0 and receives the end row of
+// each successfully generated event, so event i spans rows
+// [offsets[i], offsets[i + 1]). Generation stops at the first event that
+// fails, and its status is returned.
+int pythia_generate_batch(Pythia8::Pythia& pythia, int nevents,
+                          const SelectionProgram& selection, unsigned int rowbytes,
+                          std::vector<char>& buffer, std::vector<long long>& offsets) {
+    std::vector<int> indices;
+    size_t nrows = 0, nbytes;
+    int status;
+    buffer.clear();
+    offsets.assign(1, 0);
+    offsets.reserve(nevents + 1);
+    for (int ievent = 0; ievent < nevents; ++ievent) {
+        status = pythia_next(pythia);
+        if (status != NEXT_OK) {
+            return status;
+        }
+        PythiaRecord record(pythia.event);
+        record.select(selection, indices);
+        if (!indices.empty()) {
+            nbytes = (nrows + indices.size()) * rowbytes;
+            if (buffer.size() < nbytes) {
+                // grow geometrically to amortize reallocations over the batch
+                buffer.resize(std::max(2 * buffer.size(), nbytes));
+            }
+            record.to_array(indices, &buffer[nrows * rowbytes], rowbytes);
+            nrows += indices.size();
+        }
+        offsets.push_back(nrows);
+    }
+    return NEXT_OK;
+}
+
 /*void hepmc_to_pseudojet(HepMC::GenEvent& evt, std::vector<fastjet::PseudoJet>& output, double eta_max) {*/
   //int pdgid;
   //HepMC_IsStateFinal isfinal;
@@ -220,3 +786,76 @@ void hepmc_to_array(std::vector<HepMC::SmartPointer<HepMC::GenParticle> >& parti
         //++icand;
     //}
 /*}*/
+
+
+// Particle arrays of the events [first, last) of a HepMC file. Events are
+// parsed into an AsciiRecord, selected and converted on the reader threads,
+// and the rows are concatenated in file order as in pythia_generate_batch.
+int hepmc_read_batch(ParallelReaderAscii& reader, size_t first, size_t last,
+                     const SelectionProgram& selection, unsigned int rowbytes,
+                     std::vector<char>& buffer, std::vector<long long>& offsets, size_t& failed) {
+    std::vector<std::vector<char> > rows(last > first ? last - first : 0);
+    int status = reader.parse_records(first, last, [&](size_t ievent, AsciiRecord& record) {
+        std::vector<int> indices;
+        record.select(selection, indices);
+        std::vector<char>& event_rows = rows[ievent - first];
+        event_rows.resize(indices.size() * rowbytes);
+        if (!indices.empty()) {
+            record.to_array(indices, &event_rows[0], rowbytes);
+        }
+    }, failed);
+    if (status != ASCII_OK) {
+        return status;
+    }
+    size_t nbytes = 0;
+    offsets.assign(1, 0);
+    offsets.reserve(rows.size() + 1);
+    for (size_t ievent = 0; ievent < rows.size(); ++ievent) {
+        nbytes += rows[ievent].size();
+        offsets.push_back(nbytes / rowbytes);
+    }
+    buffer.resize(nbytes);
+    nbytes = 0;
+    for (size_t ievent = 0; ievent < rows.size(); ++ievent) {
+        if (!rows[ievent].empty()) {
+            memcpy(&buffer[nbytes], &rows[ievent][0], rows[ievent].size());
+            nbytes += rows[ievent].size();
+        }
+    }
+    return ASCII_OK;
+}
+
+
+// Particle arrays of the next nevents events read sequentially from a
+// memory mapped HepMC file, concatenated as in pythia_generate_batch. Fewer
+// events are returned at the end of the file and ASCII_END once there are
+// none left.
+int hepmc_read_arrays(MappedReaderAscii& reader, AsciiRecord& record, int nevents,
+                      const SelectionProgram& selection, unsigned int rowbytes,
+                      std::vector<char>& buffer, std::vector<long long>& offsets) {
+    std::vector<int> indices;
+    size_t nrows = 0, nbytes;
+    int status;
+    buffer.clear();
+    offsets.assign(1, 0);
+    for (int ievent = 0; ievent < nevents; ++ievent) {
+        status = reader.read_record(record);
+        if (status == ASCII_END) {
+            break;
+        } else if (status != ASCII_OK) {
+            return status;
+        }
+        record.select(selection, indices);
+        if (!indices.empty()) {
+            nbytes = (nrows + indices.size()) * rowbytes;
+            if (buffer.size() < nbytes) {
+                // grow geometrically to amortize reallocations over the batch
+                buffer.resize(std::max(2 * buffer.size(), nbytes));
+            }
+            record.to_array(indices, &buffer[nrows * rowbytes], rowbytes);
+            nrows += indices.size();
+        }
+        offsets.push_back(nrows);
+    }
+    return offsets.size() > 1 ? ASCII_OK : ASCII_END;
+}
@@ -1,13 +1,270 @@
 from libcpp.vector cimport vector
 from libcpp.string cimport string
+from libcpp.memory cimport shared_ptr
+from libc.stdint cimport int32_t, int64_t, uint8_t, uint64_t
+from libcpp cimport bool
 
 cimport hepmc as HepMC
 cimport pythia as Pythia
 
+cdef extern from "selection.h":
+    cdef enum SelectionColumn:
+        SEL_STATUS,
+        SEL_PDG_ID,
+        SEL_HAS_END_VERTEX,
+        SEL_HAS_PRODUCTION_VERTEX,
+        SEL_HAS_SAME_PDG_ID_DAUGHTER
+
+    cdef enum SelectionOp:
+        SEL_COMPARE,
+        SEL_COMPARE_ABS,
+        SEL_TEST,
+        SEL_AND,
+        SEL_OR,
+        SEL_NOT
+
+    cdef enum SelectionCompare:
+        SEL_LESS,
+        SEL_LESS_OR_EQUAL,
+        SEL_EQUAL,
+        SEL_NOT_EQUAL,
+        SEL_GREATER,
+        SEL_GREATER_OR_EQUAL
+
+    cdef cppclass SelectionProgram:
+        SelectionProgram()
+        void push(int, int, int, int)
+        bool empty()
+        void select(const vector[HepMC.SmartPointer[HepMC.GenParticle]]&, int,
+                    vector[HepMC.SmartPointer[HepMC.GenParticle]]&)
+
+cdef extern from "relatives.h":
+    void hepmc_find_relatives(const HepMC.GenEvent&, const vector[int]&, bool, const SelectionProgram&,
+                              vector[int]&, vector[long long]&) nogil
+
 cdef extern from "numpythia.h":
     #void hepmc_to_pseudojet(GenEvent&, vector[PseudoJet]&, double)
     #void pythia_to_pseudojet(Event&, vector[PseudoJet]&, double)
-    void hepmc_to_array(vector[HepMC.SmartPointer[HepMC.GenParticle]]&, char*, unsigned int)
+    cdef enum NextStatus:
+        NEXT_OK,
+        NEXT_ABORTED,
+        NEXT_CONVERSION_FAILED
+
+    int pythia_next(Pythia.Pythia&) nogil
+    int pythia_to_hepmc(Pythia.Pythia&, HepMC.GenEvent*, HepMC.EventArenaPool*) nogil
+    int pythia_next_hepmc(Pythia.Pythia&, HepMC.GenEvent*, HepMC.EventArenaPool*) nogil
+    cdef cppclass PythiaRecord:
+        PythiaRecord(const Pythia.Event&) nogil
+        void select(const SelectionProgram&, vector[int]&) nogil
+        void select(const SelectionProgram&, vector[int]&, int) nogil
+        void to_array(const vector[int]&, char*, unsigned int) nogil
+        void to_array(const vector[int]&, char*, unsigned int, bool) nogil
+        void to_array_fields(const vector[int]&, char*, unsigned int, const vector[int]&, bool) nogil
+        void to_columns(const vector[int]&, const vector[char*]&, bool) nogil
+    cdef cppclass PythiaSnapshot:
+        PythiaSnapshot(Pythia.Pythia&) nogil
+        PythiaRecord* record() nogil
+        int to_hepmc(HepMC.GenEvent*, HepMC.EventArenaPool*) nogil
+        vector[double] weights
+    int pythia_generate_batch(Pythia.Pythia&, int, const SelectionProgram&, unsigned int,
+                              vector[char]&, vector[long long]&) nogil
+    int hepmc_read_batch(ParallelReaderAscii&, size_t, size_t, const SelectionProgram&, unsigned int,
+                         vector[char]&, vector[long long]&, size_t&) nogil
+    int hepmc_read_arrays(MappedReaderAscii&, AsciiRecord&, int, const SelectionProgram&, unsigned int,
+                          vector[char]&, vector[long long]&) nogil
+
+    void hepmc_to_array(vector[HepMC.SmartPointer[HepMC.GenParticle]]&, char*, unsigned int, bool)
+    void hepmc_to_array_fields(vector[HepMC.SmartPointer[HepMC.GenParticle]]&, char*, unsigned int,
+                               const vector[int]&, bool)
+    void hepmc_to_columns(vector[HepMC.SmartPointer[HepMC.GenParticle]]&, const vector[char*]&, bool)
+    cdef enum ParticleField:
+        NUM_FIELDS
+
+cdef extern from "hepmc_ascii.h":
+    cdef enum AsciiStatus:
+        ASCII_OK,
+        ASCII_END,
+        ASCII_SYSTEM_ERROR,
+        ASCII_PARSE_ERROR
+
+    cdef cppclass AsciiRecord:
+        AsciiRecord()
+
+    cdef cppclass MappedReaderAscii:
+        MappedReaderAscii()
+        int open(const string&, const string&)
+        void close()
+        int read_event(HepMC.GenEvent&) nogil
+        size_t tell()
+        void build_index(int) nogil
+        bool has_index()
+        size_t size()
+        int read_event_at(size_t, HepMC.GenEvent&) nogil
+
+    cdef cppclass ParallelReaderAscii:
+        ParallelReaderAscii()
+        int open(const string&, int, const string&) nogil
+        void close()
+        size_t size()
+        int read_events(size_t, size_t, const vector[HepMC.GenEvent*]&, size_t&) nogil
+
+    cdef cppclass AsyncWriterAscii:
+        AsyncWriterAscii()
+        int open(const string&, size_t, int, int, int, int)
+        int write(const shared_ptr[HepMC.GenEvent]&) nogil
+        int flush() nogil
+        int close() nogil
+
+cdef extern from "compressed_stream.h":
+    cdef enum StreamStatus:
+        STREAM_OK,
+        STREAM_SYSTEM_ERROR,
+        STREAM_UNSUPPORTED
+
+    cdef enum Compression:
+        COMPRESSION_NONE,
+        COMPRESSION_GZIP,
+        COMPRESSION_ZSTD
+
+    bool compression_supported(int)
+    int min_compression_level(int)
+    int max_compression_level(int)
+    int detect_compression(const string&)
+    int compression_from_extension(const string&)
+
+    cdef cppclass OutputFile:
+        OutputFile()
+        int open(const string&, int, int, int)
+        HepMC.ostream& stream()
+        int flush() nogil
+        int close() nogil
+
+    cdef cppclass InputFile:
+        InputFile()
+        int open(const string&)
+        HepMC.istream& stream()
+        bool has_failed()
+
+cdef extern from "hepmc_binary.h":
+    cdef enum BinaryStatus:
+        BINARY_OK,
+        BINARY_END,
+        BINARY_SYSTEM_ERROR,
+        BINARY_FORMAT_ERROR
+
+    cdef struct BinaryBlockHeader:
+        uint64_t nevents
+        uint64_t nparticles
+        uint64_t nvertices
+        uint64_t nlinks
+        uint64_t nweights
+        uint64_t nattributes
+        uint64_t attribute_name_bytes
+        uint64_t attribute_string_bytes
+
+    cdef struct BinaryBlock:
+        BinaryBlockHeader header
+        const int32_t* event_number
+        const int32_t* momentum_unit
+        const int32_t* length_unit
+        const double* event_pos
+        const int64_t* particle_offsets
+        const int64_t* vertex_offsets
+        const int64_t* link_offsets
+        const int64_t* weight_offsets
+        const int64_t* attribute_offsets
+        const int32_t* pid
+        const int32_t* status
+        const uint8_t* is_mass_set
+        const double* mass
+        const double* momentum
+        const int32_t* vertex_status
+        const double* position
+        const int32_t* links1
+        const int32_t* links2
+        const double* weights
+        const int32_t* attribute_id
+        const int64_t* attribute_name_offsets
+        const char* attribute_names
+        const int64_t* attribute_string_offsets
+        const char* attribute_strings
+
+    cdef cppclass WriterBinary:
+        WriterBinary()
+        int open(const string&, size_t)
+        int write_event(const HepMC.GenEvent&) nogil
+        int close() nogil
+
+    cdef cppclass ReaderBinary:
+        ReaderBinary()
+        int open(const string&) nogil
+        size_t size()
+        size_t num_blocks()
+        const BinaryBlock& block(size_t)
+        size_t first_event(size_t)
+        int read_event(size_t, HepMC.GenEvent&) nogil
+
+cdef extern from "event_pool.h":
+    cdef cppclass GenEventPool:
+        GenEventPool(size_t)
+        shared_ptr[HepMC.GenEvent] acquire() nogil
+        size_t size()
+
+cdef extern from "hepmc_reference.h":
+    void pythia_hepmc_reference(Pythia.Pythia&, string&, string&)
+
+cdef extern from "hdf5_writer.h":
+    cdef enum Hdf5Status:
+        HDF5_OK,
+        HDF5_SYSTEM_ERROR,
+        HDF5_UNSUPPORTED,
+        HDF5_SHAPE_ERROR
+
+    bool hdf5_supported()
+
+    const char* HDF5_PARTICLE_FIELDS[]
+    unsigned int HDF5_PARTICLE_NFIELDS
+    unsigned int HDF5_PARTICLE_DOUBLES
+    unsigned int HDF5_PARTICLE_ROWBYTES
+    size_t hdf5_particle_offset(unsigned int)
+
+    cdef cppclass WriterHDF5:
+        WriterHDF5()
+        int open(const string&, size_t, int, size_t)
+        int write_event(const char*, size_t, const double*, size_t) nogil
+        int write_batch(const char*, const long long*, size_t, const double*, size_t) nogil
+        int flush() nogil
+        int close() nogil
+        size_t size()
+
+cdef extern from "shared_ring.h":
+    cdef enum RingStatus:
+        RING_OK,
+        RING_EMPTY,
+        RING_FULL,
+        RING_TOO_LARGE,
+        RING_SYSTEM_ERROR,
+        RING_BAD_FORMAT
+
+    cdef enum RingKind:
+        RING_PADDING,
+        RING_BATCH,
+        RING_DONE,
+        RING_ERROR
+
+    cdef cppclass SharedRing:
+        SharedRing()
+        int create(const string&, size_t)
+        int open(const string&)
+        void close()
+        bool is_open()
+        size_t capacity()
+        int reserve(size_t, unsigned int, char*&) nogil
+        void commit() nogil
+        int peek(unsigned int&, char*&, size_t&) nogil
+        void release() nogil
+
+    int shared_ring_unlink "SharedRing::unlink"(const string&)
 
     # Delphes (optional)
     #void array_to_delphes(int num_particles, double* particles, TDatabasePDG* pdg,
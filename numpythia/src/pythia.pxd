@@ -3,7 +3,10 @@ from libcpp.string cimport string
 
 cdef extern from "Pythia8/Pythia.h" namespace "Pythia8":
     cdef cppclass Event:
-        pass
+        Event()
+        Event(const Event&) nogil
+        Event& operator=(const Event&) nogil
+        int size()
 
     cdef cppclass Info:
         int nWeights()
@@ -53,7 +56,7 @@ cdef extern from "Pythia8/Pythia.h" namespace "Pythia8":
         bool readString(string)
         bool readFile(string)
         bool init()
-        bool next()
+        bool next() nogil
         void stat()
         bool setShowerPtr(TimeShower*, TimeShower*, SpaceShower*)
         bool setUserHooksPtr(UserHooks*)
@@ -0,0 +1,126 @@
+#ifndef NUMPYTHIA_RELATIVES_H
+#define NUMPYTHIA_RELATIVES_H
+
+#include "HepMC/GenEvent.h"
+#include "HepMC/GenParticle.h"
+#include "HepMC/GenVertex.h"
+#include "HepMC/Data/SmartPointer.h"
+
+#include "selection.h"
+
+#include <vector>
+#include <utility>
+
+
+// Ancestors and descendants of many particles of one event. The particle
+// graph is flattened once into index arrays and the selection is evaluated
+// once for all particles of the event, so each search is a traversal over
+// integers only. Particles are referred to by their index in
+// GenEvent::particles(), which is id() - 1, and vertices by -id() - 1.
+class EventGraph {
+  public:
+    EventGraph(const HepMC::GenEvent& event, const SelectionProgram& program): epoch(0) {
+        const std::vector<HepMC::GenParticlePtr>& particles = event.particles();
+        const std::vector<HepMC::GenVertexPtr>& vertices = event.vertices();
+        size_t nvertices = vertices.size();
+        production_vertex.assign(particles.size(), -1);
+        end_vertex.assign(particles.size(), -1);
+        in_offsets.resize(nvertices + 1);
+        out_offsets.resize(nvertices + 1);
+        in_offsets[0] = out_offsets[0] = 0;
+        for (size_t ivertex = 0; ivertex < nvertices; ++ivertex) {
+            const HepMC::GenVertex& vertex = *vertices[ivertex];
+            FOREACH (const HepMC::GenParticlePtr& particle, vertex.particles_in()) {
+                int index = (*particle).id() - 1;
+                in_particles.push_back(index);
+                end_vertex[index] = ivertex;
+            }
+            FOREACH (const HepMC::GenParticlePtr& particle, vertex.particles_out()) {
+                int index = (*particle).id() - 1;
+                out_particles.push_back(index);
+                production_vertex[index] = ivertex;
+            }
+            in_offsets[ivertex + 1] = in_particles.size();
+            out_offsets[ivertex + 1] = out_particles.size();
+        }
+        visited.assign(nvertices, 0);
+        SelectionColumns columns;
+        program.fill_columns(particles, columns);
+        program.evaluate(columns, selected);
+    }
+
+    size_t size() const { return production_vertex.size(); }
+
+    // Append the selected ancestors of a particle to results in the order of
+    // GenParticle.ancestors()
+    void ancestors(int particle, std::vector<int>& results) {
+        traverse(production_vertex[particle], in_offsets, in_particles, production_vertex, results);
+    }
+
+    // Append the selected descendants of a particle to results in the order
+    // of GenParticle.descendants()
+    void descendants(int particle, std::vector<int>& results) {
+        traverse(end_vertex[particle], out_offsets, out_particles, end_vertex, results);
+    }
+
+  private:
+    // Depth-first traversal starting at a vertex, following the particles
+    // of each vertex listed in offsets/particles to their next vertex.
+    // Vertices are marked with the current epoch so that the visited flags
+    // need not be cleared between searches.
+    void traverse(int start, const std::vector<int>& offsets, const std::vector<int>& particles,
+                  const std::vector<int>& next_vertex, std::vector<int>& results) {
+        if (start < 0) return;
+        if (++epoch == 0) {
+            visited.assign(visited.size(), 0);
+            epoch = 1;
+        }
+        visited[start] = epoch;
+        stack.clear();
+        stack.push_back(std::make_pair(start, offsets[start]));
+        while (!stack.empty()) {
+            std::pair<int, int>& top = stack.back();
+            if (top.second == offsets[top.first + 1]) {
+                stack.pop_back();
+                continue;
+            }
+            int particle = particles[top.second++];
+            if (selected[particle]) results.push_back(particle);
+            int vertex = next_vertex[particle];
+            if (vertex >= 0 && visited[vertex] != epoch) {
+                visited[vertex] = epoch;
+                stack.push_back(std::make_pair(vertex, offsets[vertex]));
+            }
+        }
+    }
+
+    std::vector<int> in_offsets, in_particles;
+    std::vector<int> out_offsets, out_particles;
+    std::vector<int> production_vertex, end_vertex;
+    std::vector<unsigned char> selected;
+    std::vector<unsigned int> visited;
+    unsigned int epoch;
+    std::vector<std::pair<int, int> > stack;
+};
+
+
+// Ancestors (or descendants) of each of the given particles of an event.
+// The relatives of particles[i] are results[offsets[i]:offsets[i + 1]].
+void hepmc_find_relatives(const HepMC::GenEvent& event, const std::vector<int>& particles,
+                          bool ancestors, const SelectionProgram& program,
+                          std::vector<int>& results, std::vector<long long>& offsets) {
+    EventGraph graph(event, program);
+    results.clear();
+    offsets.resize(particles.size() + 1);
+    offsets[0] = 0;
+    for (size_t i = 0; i < particles.size(); ++i) {
+        if (ancestors) {
+            graph.ancestors(particles[i], results);
+        } else {
+            graph.descendants(particles[i], results);
+        }
+        offsets[i + 1] = results.size();
+    }
+}
+
+#endif // NUMPYTHIA_RELATIVES_H
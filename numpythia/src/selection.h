@@ -0,0 +1,229 @@
+#ifndef NUMPYTHIA_SELECTION_H
+#define NUMPYTHIA_SELECTION_H
+
+#include "HepMC/GenParticle.h"
+#include "HepMC/GenVertex.h"
+#include "HepMC/Data/SmartPointer.h"
+
+#include <vector>
+#include <cstdlib>
+
+
+// Particle properties a selection can test
+enum SelectionColumn {
+    SEL_STATUS = 0,
+    SEL_PDG_ID,
+    SEL_HAS_END_VERTEX,
+    SEL_HAS_PRODUCTION_VERTEX,
+    SEL_HAS_SAME_PDG_ID_DAUGHTER,
+    NUM_SEL_COLUMNS
+};
+
+enum SelectionOp {
+    SEL_COMPARE = 0,   // push column <compare> value
+    SEL_COMPARE_ABS,   // push abs(column) <compare> value
+    SEL_TEST,          // push boolean column
+    SEL_AND,           // pop two, push and
+    SEL_OR,            // pop two, push or
+    SEL_NOT            // negate top
+};
+
+enum SelectionCompare {
+    SEL_LESS = 0,
+    SEL_LESS_OR_EQUAL,
+    SEL_EQUAL,
+    SEL_NOT_EQUAL,
+    SEL_GREATER,
+    SEL_GREATER_OR_EQUAL
+};
+
+struct SelectionInstruction {
+    int op;
+    int column;
+    int compare;
+    int value;
+};
+
+
+// Selection columns of a set of particles. Only the columns used by a
+// program are filled; the others stay empty.
+struct SelectionColumns {
+    std::vector<int> status;
+    std::vector<int> pdg_id;
+    std::vector<unsigned char> has_end_vertex;
+    std::vector<unsigned char> has_production_vertex;
+    std::vector<unsigned char> has_same_pdg_id_daughter;
+    size_t size;
+
+    SelectionColumns(): size(0) {}
+};
+
+
+template <int Compare>
+inline unsigned char compare_values(int a, int b) {
+    switch (Compare) {
+        case SEL_LESS: return a < b;
+        case SEL_LESS_OR_EQUAL: return a <= b;
+        case SEL_EQUAL: return a == b;
+        case SEL_NOT_EQUAL: return a != b;
+        case SEL_GREATER: return a > b;
+        default: return a >= b;
+    }
+}
+
+
+template <int Compare, bool Abs>
+void compare_column(size_t n, const int* column, int value, unsigned char* mask) {
+    for (size_t i = 0; i < n; ++i) {
+        mask[i] = compare_values<Compare>(Abs ? std::abs(column[i]) : column[i], value);
+    }
+}
+
+
+template <bool Abs>
+void compare_column(int compare, size_t n, const int* column, int value, unsigned char* mask) {
+    switch (compare) {
+        case SEL_LESS: compare_column<SEL_LESS, Abs>(n, column, value, mask); break;
+        case SEL_LESS_OR_EQUAL: compare_column<SEL_LESS_OR_EQUAL, Abs>(n, column, value, mask); break;
+        case SEL_EQUAL: compare_column<SEL_EQUAL, Abs>(n, column, value, mask); break;
+        case SEL_NOT_EQUAL: compare_column<SEL_NOT_EQUAL, Abs>(n, column, value, mask); break;
+        case SEL_GREATER: compare_column<SEL_GREATER, Abs>(n, column, value, mask); break;
+        default: compare_column<SEL_GREATER_OR_EQUAL, Abs>(n, column, value, mask); break;
+    }
+}
+
+
+// A selection compiled into a postfix program. Instead of dispatching over
+// a list of filters for every particle, each instruction is applied to a
+// whole column of particles at once, so the inner loops are simple and
+// vectorizable. An empty program selects every particle.
+class SelectionProgram {
+  public:
+    void push(int op, int column = 0, int compare = 0, int value = 0) {
+        SelectionInstruction instruction = {op, column, compare, value};
+        code.push_back(instruction);
+    }
+
+    bool empty() const { return code.empty(); }
+
+    bool needs(int column) const {
+        for (size_t i = 0; i < code.size(); ++i) {
+            if (code[i].op <= SEL_TEST && code[i].column == column) return true;
+        }
+        return false;
+    }
+
+    // Columns of HepMC particles needed by this program
+    void fill_columns(const std::vector<HepMC::SmartPointer<HepMC::GenParticle> >& particles,
+                      SelectionColumns& columns) const {
+        size_t n = particles.size();
+        columns.size = n;
+        bool status = needs(SEL_STATUS);
+        bool pdg_id = needs(SEL_PDG_ID);
+        bool end_vertex = needs(SEL_HAS_END_VERTEX);
+        bool production_vertex = needs(SEL_HAS_PRODUCTION_VERTEX);
+        bool same_pdg_id_daughter = needs(SEL_HAS_SAME_PDG_ID_DAUGHTER);
+        if (status) columns.status.resize(n);
+        if (pdg_id) columns.pdg_id.resize(n);
+        if (end_vertex) columns.has_end_vertex.resize(n);
+        if (production_vertex) columns.has_production_vertex.resize(n);
+        if (same_pdg_id_daughter) columns.has_same_pdg_id_daughter.resize(n);
+        for (size_t i = 0; i < n; ++i) {
+            const HepMC::GenParticle& particle = *particles[i];
+            if (status) columns.status[i] = particle.status();
+            if (pdg_id) columns.pdg_id[i] = particle.pid();
+            if (production_vertex) columns.has_production_vertex[i] = particle.has_production_vertex();
+            if (end_vertex) columns.has_end_vertex[i] = particle.has_end_vertex();
+            if (same_pdg_id_daughter) {
+                bool same = false;
+                if (particle.has_end_vertex()) {
+                    const HepMC::GenVertexPtr vertex = particle.end_vertex();
+                    FOREACH (const HepMC::GenParticlePtr& child, vertex->particles_out()) {
+                        if ((*child).pid() == particle.pid()) {
+                            same = true;
+                            break;
+                        }
+                    }
+                }
+                columns.has_same_pdg_id_daughter[i] = same;
+            }
+        }
+    }
+
+    // mask[i] is set to 1 for every selected particle
+    void evaluate(const SelectionColumns& columns, std::vector<unsigned char>& mask) const {
+        size_t n = columns.size;
+        if (code.empty()) {
+            mask.assign(n, 1);
+            return;
+        }
+        std::vector<std::vector<unsigned char> > stack;
+        size_t depth = 0;
+        for (size_t ip = 0; ip < code.size(); ++ip) {
+            const SelectionInstruction& instruction = code[ip];
+            if (instruction.op <= SEL_TEST) {
+                if (stack.size() <= depth) stack.resize(depth + 1);
+                std::vector<unsigned char>& top = stack[depth++];
+                top.resize(n);
+                if (n == 0) continue;
+                if (instruction.op == SEL_TEST) {
+                    const std::vector<unsigned char>& column = bool_column(columns, instruction.column);
+                    for (size_t i = 0; i < n; ++i) top[i] = column[i];
+                } else if (instruction.op == SEL_COMPARE_ABS) {
+                    compare_column<true>(instruction.compare, n, &int_column(columns, instruction.column)[0],
+                                         instruction.value, &top[0]);
+                } else {
+                    compare_column<false>(instruction.compare, n, &int_column(columns, instruction.column)[0],
+                                          instruction.value, &top[0]);
+                }
+            } else if (instruction.op == SEL_NOT) {
+                std::vector<unsigned char>& top = stack[depth - 1];
+                for (size_t i = 0; i < n; ++i) top[i] = !top[i];
+            } else {
+                std::vector<unsigned char>& right = stack[--depth];
+                std::vector<unsigned char>& left = stack[depth - 1];
+                if (instruction.op == SEL_AND) {
+                    for (size_t i = 0; i < n; ++i) left[i] &= right[i];
+                } else {
+                    for (size_t i = 0; i < n; ++i) left[i] |= right[i];
+                }
+            }
+        }
+        mask.swap(stack[0]);
+    }
+
+    // Select particles like HepMC::FindParticles with FIND_ALL (mode 0),
+    // FIND_FIRST (1) or FIND_LAST (2)
+    void select(const std::vector<HepMC::SmartPointer<HepMC::GenParticle> >& particles, int mode,
+                std::vector<HepMC::SmartPointer<HepMC::GenParticle> >& results) const {
+        SelectionColumns columns;
+        std::vector<unsigned char> mask;
+        fill_columns(particles, columns);
+        evaluate(columns, mask);
+        results.clear();
+        for (size_t i = 0; i < particles.size(); ++i) {
+            size_t j = mode == 2 ? particles.size() - 1 - i : i;
+            if (mask[j]) {
+                results.push_back(particles[j]);
+                if (mode != 0) return;
+            }
+        }
+    }
+
+  private:
+    static const std::vector<int>& int_column(const SelectionColumns& columns, int column) {
+        return column == SEL_STATUS ? columns.status : columns.pdg_id;
+    }
+
+    static const std::vector<unsigned char>& bool_column(const SelectionColumns& columns, int column) {
+        switch (column) {
+            case SEL_HAS_END_VERTEX: return columns.has_end_vertex;
+            case SEL_HAS_PRODUCTION_VERTEX: return columns.has_production_vertex;
+            default: return columns.has_same_pdg_id_daughter;
+        }
+    }
+
+    std::vector<SelectionInstruction> code;
+};
+
+#endif // NUMPYTHIA_SELECTION_H
@@ -0,0 +1,239 @@
+#ifndef NUMPYTHIA_SHARED_RING_H
+#define NUMPYTHIA_SHARED_RING_H
+
+#include <atomic>
+#include <new>
+#include <string>
+#include <cstring>
+#include <stdint.h>
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+
+// Status codes of the shared memory ring buffer. As for event generation,
+// errors are returned instead of thrown so that the ring can be driven
+// without the GIL.
+enum RingStatus {
+    RING_OK = 0,
+    RING_EMPTY,
+    RING_FULL,
+    RING_TOO_LARGE,
+    RING_SYSTEM_ERROR,
+    RING_BAD_FORMAT
+};
+
+
+// Message kinds. RING_PADDING only fills the end of the buffer when a
+// message does not fit before wrapping around and is never returned.
+enum RingKind {
+    RING_PADDING = 0,
+    RING_BATCH,
+    RING_DONE,
+    RING_ERROR
+};
+
+
+// Lock-free single-producer/single-consumer ring buffer of variable sized
+// messages in POSIX shared memory. Head and tail are byte counters that only
+// grow; the producer owns head and the consumer owns tail. Each message is a
+// RingMessage header followed by its payload, padded to RING_ALIGN bytes so
+// that every header and payload is aligned for double fields.
+class SharedRing {
+  public:
+    static const uint64_t RING_MAGIC = 0x676e6972796e756eULL;
+    static const size_t RING_ALIGN = 16;
+
+    struct RingMessage {
+        uint64_t size;  // payload bytes
+        uint32_t kind;
+        uint32_t reserved;
+    };
+
+    SharedRing(): header(NULL), data(NULL), mapped(0), fd(-1), pending(0) {}
+
+    ~SharedRing() {
+        close();
+    }
+
+    // Create and map a new shared memory object of capacity data bytes
+    int create(const std::string& name, size_t capacity) {
+        capacity = align(capacity);
+        if (capacity == 0) {
+            return RING_TOO_LARGE;
+        }
+        fd = shm_open(name.c_str(), O_RDWR | O_CREAT | O_EXCL, 0600);
+        if (fd < 0) {
+            return RING_SYSTEM_ERROR;
+        }
+        if (ftruncate(fd, sizeof(RingHeader) + capacity) != 0 || map(sizeof(RingHeader) + capacity) != RING_OK) {
+            close();
+            shm_unlink(name.c_str());
+            return RING_SYSTEM_ERROR;
+        }
+        new (header) RingHeader();
+        header->capacity = capacity;
+        header->head.store(0, std::memory_order_relaxed);
+        header->tail.store(0, std::memory_order_relaxed);
+        header->magic.store(RING_MAGIC, std::memory_order_release);
+        return RING_OK;
+    }
+
+    // Map an existing shared memory object created by another process
+    int open(const std::string& name) {
+        struct stat info;
+        fd = shm_open(name.c_str(), O_RDWR, 0600);
+        if (fd < 0) {
+            return RING_SYSTEM_ERROR;
+        }
+        if (fstat(fd, &info) != 0 || (size_t) info.st_size < sizeof(RingHeader)) {
+            close();
+            return RING_SYSTEM_ERROR;
+        }
+        if (map(info.st_size) != RING_OK) {
+            close();
+            return RING_SYSTEM_ERROR;
+        }
+        if (header->magic.load(std::memory_order_acquire) != RING_MAGIC ||
+            sizeof(RingHeader) + header->capacity != (size_t) info.st_size) {
+            close();
+            return RING_BAD_FORMAT;
+        }
+        return RING_OK;
+    }
+
+    void close() {
+        if (header != NULL) {
+            munmap(header, mapped);
+        }
+        if (fd >= 0) {
+            ::close(fd);
+        }
+        header = NULL;
+        data = NULL;
+        mapped = 0;
+        fd = -1;
+    }
+
+    static int unlink(const std::string& name) {
+        return shm_unlink(name.c_str()) == 0 ? RING_OK : RING_SYSTEM_ERROR;
+    }
+
+    bool is_open() const { return header != NULL; }
+
+    size_t capacity() const { return header->capacity; }
+
+    char* buffer() const { return data; }
+
+    // Producer: reserve space for a payload of size bytes. On success payload
+    // points to the space to fill before calling commit().
+    int reserve(size_t size, uint32_t kind, char*& payload) {
+        size_t total = sizeof(RingMessage) + align(size);
+        size_t capacity = header->capacity;
+        if (total > capacity) {
+            return RING_TOO_LARGE;
+        }
+        uint64_t head = header->head.load(std::memory_order_relaxed);
+        uint64_t tail = header->tail.load(std::memory_order_acquire);
+        size_t position = head % capacity;
+        size_t available = capacity - (head - tail);
+        if (total > capacity - position) {
+            // Messages are contiguous: skip the end of the buffer. The padding
+            // is published on its own so that an empty ring always has room
+            // once the consumer has stepped over it in peek().
+            size_t padding = capacity - position;
+            if (padding > available) {
+                return RING_FULL;
+            }
+            message_at(position)->size = padding - sizeof(RingMessage);
+            message_at(position)->kind = RING_PADDING;
+            header->head.store(head + padding, std::memory_order_release);
+            available -= padding;
+            position = 0;
+        }
+        if (total > available) {
+            return RING_FULL;
+        }
+        RingMessage* message = message_at(position);
+        message->size = size;
+        message->kind = kind;
+        payload = data + position + sizeof(RingMessage);
+        pending = total;
+        return RING_OK;
+    }
+
+    // Producer: publish the message prepared by the last reserve()
+    void commit() {
+        header->head.fetch_add(pending, std::memory_order_release);
+        pending = 0;
+    }
+
+    // Consumer: the oldest message, which stays valid until release()
+    int peek(uint32_t& kind, char*& payload, size_t& size) {
+        size_t capacity = header->capacity;
+        uint64_t tail = header->tail.load(std::memory_order_relaxed);
+        uint64_t head = header->head.load(std::memory_order_acquire);
+        if (tail != head && message_at(tail % capacity)->kind == RING_PADDING) {
+            tail += capacity - tail % capacity;
+            header->tail.store(tail, std::memory_order_release);
+        }
+        if (tail == head) {
+            return RING_EMPTY;
+        }
+        RingMessage* message = message_at(tail % capacity);
+        kind = message->kind;
+        size = message->size;
+        payload = (char*) message + sizeof(RingMessage);
+        return RING_OK;
+    }
+
+    // Consumer: drop the message returned by the last peek()
+    void release() {
+        uint64_t tail = header->tail.load(std::memory_order_relaxed);
+        RingMessage* message = message_at(tail % header->capacity);
+        tail += sizeof(RingMessage) + align(message->size);
+        header->tail.store(tail, std::memory_order_release);
+    }
+
+  private:
+    // Head and tail are kept on separate cache lines to avoid false sharing
+    // between the producer and the consumer.
+    struct RingHeader {
+        std::atomic<uint64_t> magic;
+        uint64_t capacity;
+        char pad0[64 - sizeof(std::atomic<uint64_t>) - sizeof(uint64_t)];
+        std::atomic<uint64_t> head;
+        char pad1[64 - sizeof(std::atomic<uint64_t>)];
+        std::atomic<uint64_t> tail;
+        char pad2[64 - sizeof(std::atomic<uint64_t>)];
+    };
+
+    static size_t align(size_t size) {
+        return (size + RING_ALIGN - 1) / RING_ALIGN * RING_ALIGN;
+    }
+
+    int map(size_t size) {
+        void* address = mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+        if (address == MAP_FAILED) {
+            return RING_SYSTEM_ERROR;
+        }
+        header = (RingHeader*) address;
+        data = (char*) address + sizeof(RingHeader);
+        mapped = size;
+        return RING_OK;
+    }
+
+    RingMessage* message_at(size_t position) const {
+        return (RingMessage*) (data + position);
+    }
+
+    RingHeader* header;
+    char* data;
+    size_t mapped;
+    int fd;
+    size_t pending;
+};
+
+#endif // NUMPYTHIA_SHARED_RING_H
@@ -3,6 +3,8 @@
 import sys
 import os
 import fnmatch
+import shutil
+import tempfile
 import numpy # Either pre-existing or required by PEP 517/518 style build (pyproject.toml, pip 10+)
 
 from setuptools import setup, Extension, find_packages
@@ -43,8 +45,25 @@ libnumpythia = Extension(
     define_macros=[
         ('XMLDIR', '""'),
     ],
+    # shm_open for the shared memory ring buffer
+    libraries=['rt'] if sys.platform.startswith('linux') else [],
 )
 
+def has_library(compiler, header, library, call, include_dirs=None):
+    tmpdir = tempfile.mkdtemp()
+    try:
+        source = os.path.join(tmpdir, 'check.c')
+        with open(source, 'w') as check:
+            check.write('#include <{0}>\nint main(void) {{ {1}; return 0; }}\n'.format(header, call))
+        objects = compiler.compile([source], output_dir=tmpdir, include_dirs=include_dirs)
+        compiler.link_executable(objects, os.path.join(tmpdir, 'check'), libraries=[library])
+    except Exception:
+        return False
+    finally:
+        shutil.rmtree(tmpdir)
+    return True
+
+
 class build_ext(_build_ext):
     user_options = _build_ext.user_options + [
         ('external-fastjet', None, None),
@@ -60,6 +79,21 @@ class build_ext(_build_ext):
         libnumpythia.include_dirs.append(numpy.get_include())
 
     def build_extensions(self):
+        # compressed HepMC files if zlib or zstd are available
+        for macro, header, library, call in [
+                ('NUMPYTHIA_ZLIB', 'zlib.h', 'z', 'zlibVersion()'),
+                ('NUMPYTHIA_ZSTD', 'zstd.h', 'zstd', 'ZSTD_versionNumber()')]:
+            if has_library(self.compiler, header, library, call):
+                libnumpythia.define_macros.append((macro, None))
+                libnumpythia.libraries.append(library)
+        # native HDF5 writer, also in the layout of Debian's serial package
+        for library, include_dirs in [('hdf5', []),
+                                      ('hdf5_serial', ['/usr/include/hdf5/serial'])]:
+            if has_library(self.compiler, 'hdf5.h', library, 'H5open()', include_dirs):
+                libnumpythia.define_macros.append(('NUMPYTHIA_HDF5', None))
+                libnumpythia.libraries.append(library)
+                libnumpythia.include_dirs.extend(include_dirs)
+                break
         _build_ext.build_extensions(self)
 
 
@@ -79,7 +113,8 @@ class install(_install):
         _install.finalize_options(self)
 
 
-extras_require = {"dev": ["pytest"], "test": ["pytest"]}
+test_requires = ["pytest", "pyarrow; python_version>='3.7'"]
+extras_require = {"dev": test_requires, "test": test_requires, "arrow": ["pyarrow"]}
 
 setup(
     name='numpythia',
@@ -0,0 +1,97 @@
+from numpythia import Pythia, STATUS, HAS_END_VERTEX, hepmc_read
+from numpythia.testcmnd import get_cmnd
+from numpy.testing import assert_array_equal
+import numpy as np
+import pytest
+
+
+def test_fields():
+    selection = (STATUS == 1) & ~HAS_END_VERTEX
+    pythia = Pythia(get_cmnd('w'), random_state=1, verbosity=0)
+    for event in pythia(events=2):
+        array = event.all(selection)
+        for fields in (['E', 'px', 'py', 'pz', 'pdgid'], ['status', 'eta', 'prodz'], 'phi'):
+            reduced = event.all(selection, fields=fields)
+            assert reduced.dtype.names == ((fields,) if isinstance(fields, str) else tuple(fields))
+            for name in reduced.dtype.names:
+                assert_array_equal(reduced[name], array[name])
+        with pytest.raises(ValueError):
+            event.all(fields=['E', 'energy'])
+
+
+def test_soa_layout():
+    pythia = Pythia(get_cmnd('w'), random_state=1, verbosity=0)
+    for event in pythia(events=2):
+        array = event.all()
+        for fields in (None, ['theta', 'eta', 'pdgid'], ['mass', 'prodt']):
+            columns = event.all(fields=fields, layout='soa')
+            assert list(columns) == list(fields or array.dtype.names)
+            for name, column in columns.items():
+                assert column.flags['C_CONTIGUOUS']
+                assert_array_equal(column, array[name])
+
+
+def test_without_vertices():
+    pythia = Pythia(get_cmnd('w'), random_state=1, verbosity=0)
+    for event in pythia(events=1):
+        array = event.all()
+        reduced = event.all(vertices=False)
+        for name in array.dtype.names:
+            if name.startswith('prod'):
+                assert (reduced[name] == 0).all()
+            else:
+                assert_array_equal(reduced[name], array[name])
+        # the production vertex is neither looked up for fields nor columns
+        fields = ['E', 'prodx', 'prodt']
+        reduced = event.all(fields=fields, vertices=False)
+        columns = event.all(fields=fields, layout='soa', vertices=False)
+        for name in fields:
+            expected = 0 if name.startswith('prod') else array[name]
+            assert_array_equal(reduced[name], expected)
+            assert_array_equal(columns[name], expected)
+
+
+# beams without a production vertex and no vertex positions
+BEAM_EVENT = """HepMC::Version 3.0.0
+HepMC::IO_GenEvent-START_EVENT_LISTING
+E 0 1 4
+U GEV MM
+P 1 0 2212 0e+00 0e+00 6.5e+03 6.5e+03 9.3827e-01 4
+P 2 0 2212 0e+00 0e+00 -6.5e+03 6.5e+03 9.3827e-01 4
+V -1 0 [1,2]
+P 3 -1 211 1e+00 0e+00 0e+00 1.5e+00 1.3957e-01 1
+P 4 -1 -211 -1e+00 0e+00 0e+00 1.5e+00 1.3957e-01 1
+HepMC::IO_GenEvent-END_EVENT_LISTING
+"""
+
+
+def test_beams_without_vertices(tmpdir):
+    filename = str(tmpdir.join('beams.hepmc'))
+    with open(filename, 'w') as f:
+        f.write(BEAM_EVENT)
+    for mmap in (False, True):
+        events = list(hepmc_read(filename, mmap=mmap, index=None))
+        assert len(events) == 1
+        for vertices in (True, False):
+            array = events[0].all(vertices=vertices)
+            assert_array_equal(array['pdgid'], [2212, 2212, 211, -211])
+            assert_array_equal(array['pz'], [6500, -6500, 0, 0])
+            for name in ('prodx', 'prody', 'prodz', 'prodt'):
+                assert_array_equal(array[name], np.zeros(4))
+            columns = events[0].all(fields=['E', 'prodz'], layout='soa', vertices=vertices)
+            assert_array_equal(columns['prodz'], np.zeros(4))
+
+
+def test_hepmc_options():
+    pythia = Pythia(get_cmnd('w'), random_state=1, verbosity=0)
+    for event in pythia(events=1):
+        # first and last return GenParticle unless return_hepmc=False
+        for kwargs in (dict(fields=['E']), dict(layout='soa'), dict(vertices=False)):
+            with pytest.raises(ValueError):
+                event.first(**kwargs)
+            with pytest.raises(ValueError):
+                event.all(return_hepmc=True, **kwargs)
+        array = event.first(fields=['E', 'pdgid'], return_hepmc=False)
+        assert array.dtype.names == ('E', 'pdgid')
+        with pytest.raises(ValueError):
+            event.first().children(fields=['E'], return_hepmc=True)
@@ -0,0 +1,439 @@
+from numpythia import Pythia, ReaderAscii, WriterAscii, ParallelReaderAscii, hepmc_write, hepmc_read
+from numpythia import ReaderBinary, WriterBinary, ArrowWriter, arrow_write
+from numpythia import WriterHDF5, hdf5_supported, hdf5_write
+from numpythia import STATUS, HAS_END_VERTEX, HAS_PRODUCTION_VERTEX, HAS_SAME_PDG_ID_DAUGHTER
+from numpythia import compression_supported
+from numpythia.testcmnd import get_cmnd
+from numpy.testing import assert_array_equal, assert_allclose
+import numpy as np
+import pytest
+import gzip
+import locale
+import os
+import shutil
+
+
+def test_mmap_reader(tmpdir):
+    filename = str(tmpdir.join('events.hepmc'))
+    pythia = Pythia(get_cmnd('w'), random_state=1, verbosity=0)
+    for event in hepmc_write(filename, pythia(events=3)):
+        pass
+    events = list(hepmc_read(filename))
+    mapped_events = list(hepmc_read(filename, mmap=True))
+    assert len(events) == len(mapped_events) == 3
+    for event, mapped_event in zip(events, mapped_events):
+        assert event.all().tobytes() == mapped_event.all().tobytes()
+        assert_array_equal(event.weights, mapped_event.weights)
+        particles = event.all(return_hepmc=True)
+        mapped_particles = mapped_event.all(return_hepmc=True)
+        for particle, mapped_particle in zip(particles[::20], mapped_particles[::20]):
+            assert particle.ancestors().tobytes() == mapped_particle.ancestors().tobytes()
+
+    # a truncated event is reported instead of silently ending the iteration
+    with open(filename) as infile:
+        lines = infile.readlines()
+    with open(filename, 'w') as outfile:
+        outfile.writelines(lines[:len(lines) // 2])
+    with pytest.raises(IOError):
+        list(hepmc_read(filename, mmap=True))
+    with pytest.raises(IOError):
+        hepmc_read(str(tmpdir.join('missing.hepmc')), mmap=True).send(None)
+
+
+# numbers below the integer fast path of the memory mapped parser
+SMALL_EVENT = """HepMC::Version 3.0.0
+HepMC::IO_GenEvent-START_EVENT_LISTING
+E 0 1 2
+U GEV MM
+P 1 0 2212 0e+00 0e+00 6.5e+03 6.5e+03 9.3827e-01 4
+V -1 0 [1] @ 1.2345678901234567e-05 -9.876543210987654e-21 3.3e-310 1.5e+300
+P 2 -1 211 1.2345678901234567e-05 -2.2250738585072014e-308 1e+00 1.5e+00 1.3957e-01 1
+HepMC::IO_GenEvent-END_EVENT_LISTING
+"""
+
+
+def test_mmap_reader_locale(tmpdir):
+    filename = str(tmpdir.join('small.hepmc'))
+    with open(filename, 'w') as f:
+        f.write(SMALL_EVENT)
+    previous = locale.setlocale(locale.LC_NUMERIC)
+    for name in ('de_DE.UTF-8', 'de_DE.utf8', 'de_DE', 'fr_FR.UTF-8'):
+        try:
+            locale.setlocale(locale.LC_NUMERIC, name)
+            break
+        except locale.Error:
+            pass
+    else:
+        pytest.skip("no locale with a decimal comma")
+    try:
+        events = list(hepmc_read(filename, mmap=True, index=None))
+    finally:
+        locale.setlocale(locale.LC_NUMERIC, previous)
+    particle = events[0].all()[1]
+    assert particle['px'] == 1.2345678901234567e-05
+    assert particle['py'] == -2.2250738585072014e-308
+    assert particle['pz'] == 1
+    assert_array_equal([particle['prodx'], particle['prody'], particle['prodz'], particle['prodt']],
+                       [1.2345678901234567e-05, -9.876543210987654e-21, 3.3e-310, 1.5e+300])
+
+
+def test_recycled_events(tmpdir):
+    filename = str(tmpdir.join('events.hepmc'))
+    pythia = Pythia(get_cmnd('w'), random_state=1, verbosity=0)
+    for event in hepmc_write(filename, pythia(events=5)):
+        pass
+    expected = [event.all().tobytes() for event in hepmc_read(filename, index=None)]
+    for mmap in (False, True):
+        particles = []
+        for i, event in enumerate(ReaderAscii(filename, mmap=mmap, index=None, recycle=True)):
+            assert event.all().tobytes() == expected[i]
+            # a particle of a dropped event does not belong to the later
+            # event that reuses its storage
+            for particle in particles:
+                with pytest.raises(ValueError):
+                    event.ancestors([particle])
+            particles.append(event.first())
+        assert i == 4
+    # the attributes of recycled events are written back unchanged
+    rewritten = str(tmpdir.join('rewritten.hepmc'))
+    for event in hepmc_write(rewritten, ReaderAscii(filename, index=None, recycle=True)):
+        pass
+    with open(filename) as infile, open(rewritten) as rewritten_file:
+        assert rewritten_file.read() == infile.read()
+
+
+def test_parallel_reader(tmpdir):
+    filename = str(tmpdir.join('events.hepmc'))
+    selection = (STATUS == 1) & ~HAS_END_VERTEX
+    pythia = Pythia(get_cmnd('w'), random_state=1, verbosity=0)
+    for event in hepmc_write(filename, pythia(events=5)):
+        pass
+    events = list(hepmc_read(filename))
+    reader = ParallelReaderAscii(filename, n_threads=3, batch_size=2)
+    assert len(reader) == 5
+    parallel_events = list(reader)
+    assert len(parallel_events) == 5
+    for event, parallel_event in zip(events, parallel_events):
+        assert event.all().tobytes() == parallel_event.all().tobytes()
+        assert_array_equal(event.weights, parallel_event.weights)
+    batches = list(reader.arrays(selection))
+    assert [len(offsets) - 1 for particles, offsets in batches] == [2, 2, 1]
+    particles = np.concatenate([particles for particles, offsets in batches])
+    assert particles.tobytes() == np.concatenate([event.all(selection) for event in events]).tobytes()
+
+    with open(filename) as infile:
+        lines = infile.readlines()
+    with open(filename, 'w') as outfile:
+        outfile.writelines(lines[:len(lines) // 2])
+    with pytest.raises(IOError):
+        list(ParallelReaderAscii(filename, n_threads=2))
+
+
+# particles without mother, an implicit vertex of a mother without end
+# vertex that is then taken over by a vertex line, a repeated incoming
+# particle and vertices without position
+LINKED_EVENTS = """HepMC::Version 3.0.0
+HepMC::IO_GenEvent-START
+W weight
+E 0 4 8 @ 0.1 0.2 0.3 0.4
+U GEV MM
+W 1.5
+P 1 0 2212 0 0 100 100 0.938 4
+P 2 0 2212 0 0 -100 100 0.938 4
+V -1 0 [1,2]
+P 3 -1 21 1 2 3 10 0 2
+P 4 3 21 1 2 3 10 0 1
+V -3 0 [3] @ 1 1 1 1
+P 5 -3 11 1 0 0 1 0 2
+P 6 -3 21 1 0 0 1 0 1
+V -4 0 [5,5]
+P 7 -4 11 1 0 0 1 0 1
+P 8 99 22 0 1 0 1 0 1
+E 1 1 3
+W 2.5
+P 1 0 2212 0 0 100 100 0.938 4
+P 2 1 21 0 1 2 3 0 1
+P 3 1 21 0 1 2 3 0 1
+HepMC::IO_GenEvent-END
+"""
+
+
+def test_array_reader(tmpdir):
+    filename = str(tmpdir.join('events.hepmc'))
+    pythia = Pythia(get_cmnd('w'), random_state=1, verbosity=0)
+    for event in hepmc_write(filename, pythia(events=5)):
+        pass
+    linked_filename = str(tmpdir.join('linked.hepmc'))
+    with open(linked_filename, 'w') as outfile:
+        outfile.write(LINKED_EVENTS)
+    for path in (filename, linked_filename):
+        events = list(hepmc_read(path))
+        for selection in (None, (STATUS == 1) & ~HAS_END_VERTEX, HAS_SAME_PDG_ID_DAUGHTER,
+                          HAS_PRODUCTION_VERTEX):
+            expected = np.concatenate([event.all(selection) for event in events])
+            for reader in (ReaderAscii(path), ParallelReaderAscii(path, n_threads=2, batch_size=2)):
+                batches = list(reader.arrays(selection))
+                particles = np.concatenate([particles for particles, offsets in batches])
+                assert particles.tobytes() == expected.tobytes()
+        batches = list(ReaderAscii(path).arrays(batch_size=2))
+        assert sum(len(offsets) - 1 for particles, offsets in batches) == len(events)
+        assert_array_equal(batches[0][1], [0, len(events[0].all()), len(events[0].all()) + len(events[1].all())])
+
+    with open(filename) as infile:
+        lines = infile.readlines()
+    with open(filename, 'w') as outfile:
+        outfile.writelines(lines[:len(lines) // 2])
+    with pytest.raises(IOError):
+        list(ReaderAscii(filename, index=None).arrays())
+
+
+def test_event_index(tmpdir):
+    filename = str(tmpdir.join('events.hepmc'))
+    pythia = Pythia(get_cmnd('w'), random_state=1, verbosity=0)
+    for event in hepmc_write(filename, pythia(events=5)):
+        pass
+    events = list(hepmc_read(filename))
+    assert not tmpdir.join('events.hepmc.idx').exists()
+
+    # the index is saved by a complete pass and reused
+    assert len(list(hepmc_read(filename, mmap=True))) == 5
+    assert tmpdir.join('events.hepmc.idx').exists()
+    reader = ReaderAscii(filename)
+    assert len(reader) == 5
+    assert reader[3].all().tobytes() == events[3].all().tobytes()
+    assert reader[-1].all().tobytes() == events[4].all().tobytes()
+    assert_array_equal(reader[0].weights, events[0].weights)
+    assert [event.all().tobytes() for event in reader[1::2]] == [event.all().tobytes() for event in events[1::2]]
+    with pytest.raises(IndexError):
+        reader[5]
+    shards = [list(reader.shard(i, 3)) for i in range(3)]
+    assert [len(shard) for shard in shards] == [1, 2, 2]
+    assert shards[2][0].all().tobytes() == events[3].all().tobytes()
+    assert len(ParallelReaderAscii(filename, n_threads=2)) == 5
+
+    # a stale index is rebuilt after the file changes
+    for event in hepmc_write(filename, pythia(events=2)):
+        pass
+    reader = ReaderAscii(filename, mmap=True)
+    assert len(reader) == 2
+    assert len(list(reader)) == 2
+
+    # without a sidecar file
+    other = str(tmpdir.join('other.hepmc'))
+    for event in hepmc_write(other, pythia(events=2)):
+        pass
+    assert len(ReaderAscii(other, index=None)) == 2
+    assert len(list(hepmc_read(other, mmap=True, index=False))) == 2
+    assert not tmpdir.join('other.hepmc.idx').exists()
+
+
+def test_writer_precision(tmpdir):
+    filename = str(tmpdir.join('events.hepmc'))
+    pythia = Pythia(get_cmnd('w'), random_state=1, verbosity=0)
+    events = list(hepmc_write(filename, pythia(events=2)))
+    # the shortest representation reads back exactly
+    for event, read_event in zip(events, hepmc_read(filename, mmap=True, index=None)):
+        assert event.all().tobytes() == read_event.all().tobytes()
+    rounded = str(tmpdir.join('rounded.hepmc'))
+    for event in hepmc_write(rounded, events, precision=4):
+        pass
+    with open(rounded) as infile:
+        line = [line for line in infile if line.startswith('P ')][2]
+    assert all(len(field.split('e')[0].lstrip('-')) == 6 for field in line.split()[4:9])
+    for event, read_event in zip(events, hepmc_read(rounded, index=None)):
+        assert_allclose(event.all()['E'], read_event.all()['E'], rtol=1e-4)
+    with pytest.raises(ValueError):
+        hepmc_write(rounded, events, precision=40).send(None)
+
+
+def test_background_writer(tmpdir):
+    filename = str(tmpdir.join('events.hepmc'))
+    pythia = Pythia(get_cmnd('w'), random_state=1, verbosity=0)
+    events = list(hepmc_write(filename, pythia(events=5), queue_size=2))
+    read_events = list(hepmc_read(filename, index=None))
+    assert len(read_events) == 5
+    for event, read_event in zip(events, read_events):
+        assert event.all().tobytes() == read_event.all().tobytes()
+
+    # flush makes the queued events readable before closing
+    writer = WriterAscii(str(tmpdir.join('flushed.hepmc')), queue_size=1)
+    for event in events:
+        writer.write(event)
+    writer.flush()
+    assert len(list(hepmc_read(str(tmpdir.join('flushed.hepmc')), mmap=True, index=None))) == 5
+    writer.close()
+    with pytest.raises(ValueError):
+        writer.write(events[0])
+    with pytest.raises(IOError):
+        WriterAscii(str(tmpdir.join('missing', 'events.hepmc')), queue_size=1)
+
+
+def test_compressed_files(tmpdir):
+    filename = str(tmpdir.join('events.hepmc'))
+    pythia = Pythia(get_cmnd('w'), random_state=1, verbosity=0)
+    events = list(hepmc_write(filename, pythia(events=3)))
+    with open(filename, 'rb') as infile:
+        content = infile.read()
+    for extension, compression in (('.gz', 'gzip'), ('.zst', 'zstd')):
+        if not compression_supported(compression):
+            continue
+        for threads in (1, 3):
+            compressed = filename + extension
+            for event in hepmc_write(compressed, events, compression_threads=threads):
+                pass
+            assert os.path.getsize(compressed) < len(content) // 2
+            read_events = list(hepmc_read(compressed, index=None))
+            assert len(read_events) == 3
+            for event, read_event in zip(events, read_events):
+                assert event.all().tobytes() == read_event.all().tobytes()
+        assert len(list(ReaderAscii(compressed, index=None))) == 3
+        with pytest.raises(ValueError):
+            hepmc_read(compressed, mmap=True).send(None)
+        # several blocks in flight on the workers
+        for event in hepmc_write(compressed, events * 4, compression_threads=3, compression_level=1):
+            pass
+        read_events = list(hepmc_read(compressed, index=None))
+        assert len(read_events) == 12
+        for event, read_event in zip(events * 4, read_events):
+            assert event.all().tobytes() == read_event.all().tobytes()
+        for level in (-1, 100):
+            with pytest.raises(ValueError):
+                WriterAscii(compressed, compression_level=level)
+    # levels only apply to compressed files
+    with pytest.raises(ValueError):
+        WriterAscii(str(tmpdir.join('plain.hepmc')), compression_level=1)
+    with pytest.raises(ValueError):
+        WriterAscii(str(tmpdir.join('plain.hepmc.gz')), compression='none', compression_level=1)
+    if compression_supported('gzip'):
+        # files from other tools, and the compression selected explicitly
+        with gzip.open(str(tmpdir.join('python.hepmc')), 'wb') as outfile:
+            outfile.write(content)
+        assert len(list(hepmc_read(str(tmpdir.join('python.hepmc')), index=None))) == 3
+        for event in hepmc_write(str(tmpdir.join('explicit.hepmc')), events, compression='gzip', queue_size=2):
+            pass
+        with gzip.open(str(tmpdir.join('explicit.hepmc')), 'rb') as infile:
+            assert infile.read().count(b'\nE ') == 3
+        # truncated files are reported
+        with open(str(tmpdir.join('explicit.hepmc')), 'rb') as infile:
+            truncated = infile.read()
+        with open(str(tmpdir.join('truncated.hepmc')), 'wb') as outfile:
+            outfile.write(truncated[:len(truncated) // 2])
+        with pytest.raises(IOError):
+            list(hepmc_read(str(tmpdir.join('truncated.hepmc')), index=None))
+
+
+def test_binary_format(tmpdir):
+    filename = str(tmpdir.join('events.npyhepmc'))
+    pythia = Pythia(get_cmnd('w'), random_state=1, verbosity=0)
+    events = list(pythia(events=5))
+    writer = WriterBinary(filename, block_size=2)
+    for event in events:
+        writer.write(event)
+    writer.close()
+    reader = ReaderBinary(filename)
+    assert len(reader) == 5
+    assert reader.num_blocks == 3
+    read_events = list(reader)
+    for event, read_event in zip(events, read_events):
+        assert event.all().tobytes() == read_event.all().tobytes()
+        assert_array_equal(event.weights, read_event.weights)
+        assert len(event.all(return_hepmc=True)[10].ancestors()) == len(read_event.all(return_hepmc=True)[10].ancestors())
+    assert reader[-2].all().tobytes() == events[3].all().tobytes()
+    assert len(reader[1:4]) == 3
+
+    # the columns of a block are the particles of its events
+    block = reader.block(1)
+    assert block['first_event'] == 2
+    assert_array_equal(block['particle_offsets'], [0, len(events[2].all()), len(events[2].all()) + len(events[3].all())])
+    assert_array_equal(block['momentum'][:, 3], np.concatenate([events[2].all()['E'], events[3].all()['E']]))
+    assert_array_equal(block['pid'], np.concatenate([events[2].all()['pdgid'], events[3].all()['pdgid']]))
+    assert_array_equal(block['attribute_offsets'][[0, -1]], [0, len(block['attribute_id'])])
+    names = block['attribute_names'].tobytes().decode()
+    name_offsets = block['attribute_name_offsets']
+    assert 'GenCrossSection' in [names[name_offsets[i]:name_offsets[i + 1]]
+                                 for i in range(len(block['attribute_id']))]
+    assert block['attribute_string_offsets'][-1] == len(block['attribute_strings'])
+
+    with open(filename, 'r+b') as outfile:
+        outfile.truncate(os.path.getsize(filename) - 10)
+    with pytest.raises(IOError):
+        ReaderBinary(filename)
+
+
+@pytest.mark.parametrize('extension', ['arrow', 'parquet'])
+def test_arrow_export(tmpdir, extension):
+    pa = pytest.importorskip('pyarrow')
+    import pyarrow.parquet as pq
+    filename = str(tmpdir.join('events.' + extension))
+    selection = (STATUS == 1) & ~HAS_END_VERTEX
+    pythia = Pythia(get_cmnd('w'), random_state=1, verbosity=0)
+    events = list(arrow_write(filename, pythia(events=5), selection, batch_size=2))
+    if extension == 'parquet':
+        table = pq.read_table(filename)
+    else:
+        table = pa.ipc.open_stream(filename).read_all()
+    assert table.num_rows == 5
+    for ievent, event in enumerate(events):
+        array = event.all(selection)
+        particles = table.column('particles')[ievent].values
+        for name in ('E', 'px', 'pdgid', 'status'):
+            assert_array_equal(particles.field(name).to_numpy(), array[name])
+        assert table.column('weights')[ievent].as_py() == list(event.weights)
+
+    particles, offsets = pythia.generate_batch(3, selection)
+    with ArrowWriter(filename) as writer:
+        writer.write_batch(particles, offsets)
+    if extension == 'parquet':
+        table = pq.read_table(filename)
+    else:
+        table = pa.ipc.open_stream(filename).read_all()
+    assert [len(row) for row in table.column('particles').to_pylist()] == list(np.diff(offsets))
+
+
+@pytest.mark.skipif(not hdf5_supported(), reason="built without HDF5")
+def test_hdf5_writer(tmpdir):
+    h5py = pytest.importorskip('h5py')
+    filename = str(tmpdir.join('events.h5'))
+    selection = (STATUS == 1) & ~HAS_END_VERTEX
+    pythia = Pythia(get_cmnd('w'), random_state=1, verbosity=0)
+    events = list(hdf5_write(filename, pythia(events=5), selection, chunk_size=100))
+    with h5py.File(filename, 'r') as hdf5_file:
+        offsets = hdf5_file['offsets'][:]
+        assert len(offsets) == 6
+        for ievent, event in enumerate(events):
+            particles = hdf5_file['particles'][offsets[ievent]:offsets[ievent + 1]]
+            assert particles.tobytes() == event.all(selection).tobytes()
+            assert_array_equal(hdf5_file['weights'][ievent], event.weights)
+
+    particles, offsets = pythia.generate_batch(4, selection)
+    writer = WriterHDF5(filename, chunk_size=100)
+    writer.write_batch(particles, offsets)
+    writer.write_batch(particles, offsets[2:])
+    assert len(writer) == 6
+    # the file on disk is complete after flush
+    writer.flush()
+    shutil.copy(filename, str(tmpdir.join('flushed.h5')))
+    with h5py.File(str(tmpdir.join('flushed.h5')), 'r') as hdf5_file:
+        assert_array_equal(hdf5_file['offsets'][:], np.concatenate([offsets, offsets[3:] - offsets[2] + len(particles)]))
+    with pytest.raises(ValueError):
+        writer.write(events[0])
+    writer.close()
+    with h5py.File(filename, 'r') as hdf5_file:
+        assert hdf5_file['weights'].shape == (6, 0)
+        assert hdf5_file['particles'][:].tobytes() == np.concatenate([particles, particles[offsets[2]:]]).tobytes()
+        assert_array_equal(hdf5_file['offsets'][5:], offsets[3:] - offsets[2] + len(particles))
+
+
+def test_hdf5_layout(tmpdir, monkeypatch):
+    if not hdf5_supported():
+        pytest.skip("numpythia was built without HDF5 support")
+    from numpythia import _libnumpythia
+    # the rows written by the C++ writer must be DTYPE_PARTICLE rows
+    dtype = _libnumpythia.DTYPE_PARTICLE
+    monkeypatch.setattr(_libnumpythia, 'DTYPE_PARTICLE',
+                        np.dtype(dtype.descr[:-2] + [('status', np.int32), ('pdgid', np.int32)]))
+    with pytest.raises(RuntimeError):
+        WriterHDF5(str(tmpdir.join('events.h5')))
+    monkeypatch.setattr(_libnumpythia, 'DTYPE_PARTICLE', np.dtype(dtype.descr + [('charge', np.int32)]))
+    with pytest.raises(RuntimeError):
+        WriterHDF5(str(tmpdir.join('events.h5')))
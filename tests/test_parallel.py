@@ -0,0 +1,92 @@
+from threading import Thread
+import pickle
+import time
+
+from numpythia import Pythia, ParallelPythia, SharedRingBuffer, STATUS, HAS_END_VERTEX, ABS_PDG_ID
+from numpythia._libnumpythia import DTYPE_PARTICLE
+from numpythia.testcmnd import get_cmnd
+from numpy.testing import assert_array_equal
+import numpy as np
+import pytest
+
+selection = (STATUS == 1) & ~HAS_END_VERTEX
+
+
+def generate(events):
+    with ParallelPythia(get_cmnd('w'), n_workers=2, random_state=1,
+                        batch_size=2, selection=selection) as pool:
+        return pool.seeds, list(pool(events=events))
+
+
+def test_parallel_reproducible():
+    seeds, events = generate(5)
+    assert len(events) == 5
+    assert len(set(seeds)) == 2
+    seeds_again, events_again = generate(5)
+    assert seeds_again == seeds
+    for array1, array2 in zip(events, events_again):
+        assert_array_equal(array1, array2)
+
+    # the first batch comes from the first worker
+    pythia = Pythia(get_cmnd('w'), random_state=seeds[0], verbosity=0)
+    for array, event in zip(events[:2], pythia(events=2, hepmc=False)):
+        assert_array_equal(array, event.array(selection))
+
+
+def test_parallel_spawn():
+    # selections are pickled for start methods other than fork
+    for selection_filter in (selection, STATUS, ABS_PDG_ID, HAS_END_VERTEX, ABS_PDG_ID == 11):
+        assert pickle.dumps(pickle.loads(pickle.dumps(selection_filter))) == pickle.dumps(selection_filter)
+    with pytest.raises(TypeError):
+        pickle.loads(pickle.dumps(ABS_PDG_ID)) & HAS_END_VERTEX
+    with ParallelPythia(get_cmnd('w'), n_workers=1, random_state=1, batch_size=2,
+                        selection=selection, context='spawn') as pool:
+        seeds, events = pool.seeds, list(pool(events=2))
+    pythia = Pythia(get_cmnd('w'), random_state=seeds[0], verbosity=0)
+    for array, event in zip(events, pythia(events=2, hepmc=False)):
+        assert_array_equal(array, event.array(selection))
+
+
+def test_parallel_error():
+    # errors of the workers are raised with their message
+    with ParallelPythia(get_cmnd('w'), n_workers=1, batch_size=2, selection=STATUS) as pool:
+        with pytest.raises(RuntimeError) as error:
+            list(pool(events=2))
+    assert str(error.value) == "worker 0 failed: {0!r}".format(
+        TypeError("find must be a boolean expression of Filters"))
+
+
+def test_shared_ring_buffer():
+    ring = SharedRingBuffer(capacity=4096)
+    sizes = range(1, 30)
+
+    def produce():
+        producer = SharedRingBuffer(ring.name, create=False)
+        for size in sizes:
+            particles = np.zeros(size, dtype=DTYPE_PARTICLE)
+            particles['E'] = np.arange(size)
+            producer.put_batch(particles, np.array([0, size], dtype=np.int64))
+        producer.put_message(SharedRingBuffer.DONE)
+
+    thread = Thread(target=produce)
+    thread.start()
+    for size in sizes:
+        kind, particles, offsets = ring.get()
+        assert kind == SharedRingBuffer.BATCH
+        assert_array_equal(particles['E'], np.arange(size))
+        assert_array_equal(offsets, [0, size])
+    assert ring.get()[0] == SharedRingBuffer.DONE
+    thread.join()
+    assert ring.get(timeout=0) is None
+
+
+def test_shared_ring_buffer_timeout():
+    ring = SharedRingBuffer(capacity=4096)
+    start = time.time()
+    assert ring.get(timeout=0.05) is None
+    assert 0.05 <= time.time() - start < 1
+    ring.put_message(SharedRingBuffer.DONE, b'x' * 3000)
+    start = time.time()
+    with pytest.raises(RuntimeError):
+        ring.put_message(SharedRingBuffer.DONE, b'x' * 3000, timeout=0.05)
+    assert 0.05 <= time.time() - start < 1
@@ -0,0 +1,121 @@
+from numpythia import Pythia, WriterAscii, STATUS, HAS_END_VERTEX, ABS_PDG_ID
+from numpythia.testcmnd import get_cmnd
+from numpy.testing import assert_array_equal
+import numpy as np
+
+
+def test_array_matches_hepmc():
+    selections = [None,
+                  (STATUS == 1) & ~HAS_END_VERTEX,
+                  ABS_PDG_ID == 24]
+    kwargs = dict(random_state=1, verbosity=0)
+    hepmc_events = Pythia(get_cmnd('w'), **kwargs)(events=5)
+    pythia_events = Pythia(get_cmnd('w'), **kwargs)(events=5, hepmc=False)
+    for hepmc_event, pythia_event in zip(hepmc_events, pythia_events):
+        for selection in selections:
+            expected = np.sort(hepmc_event.all(selection), order=['E', 'pdgid', 'status'])
+            array = np.sort(pythia_event.array(selection), order=['E', 'pdgid', 'status'])
+            for field in expected.dtype.names:
+                assert_array_equal(array[field], expected[field])
+
+
+def test_generate_batch():
+    selection = (STATUS == 1) & ~HAS_END_VERTEX
+    kwargs = dict(random_state=1, verbosity=0)
+    particles, offsets = Pythia(get_cmnd('w'), **kwargs).generate_batch(5, selection)
+    assert offsets.dtype == np.int64
+    assert len(offsets) == 6 and offsets[0] == 0 and offsets[-1] == len(particles)
+    events = Pythia(get_cmnd('w'), **kwargs)(events=5, hepmc=False)
+    for i, event in enumerate(events):
+        assert_array_equal(particles[offsets[i]:offsets[i + 1]], event.array(selection))
+
+
+def assert_particles_equal(array, expected):
+    for field in expected.dtype.names:
+        assert_array_equal(array[field], expected[field])
+
+
+def test_arena_events():
+    kwargs = dict(random_state=1, verbosity=0)
+    expected = [event.all() for event in Pythia(get_cmnd('w'), **kwargs)(events=5)]
+    # keep some events alive while later events reuse the other arenas
+    kept = []
+    for i, event in enumerate(Pythia(get_cmnd('w'), arena=True, **kwargs)(events=5)):
+        assert_particles_equal(event.all(), expected[i])
+        if i % 2 == 0:
+            kept.append((i, event))
+    for i, event in kept:
+        assert_particles_equal(event.all(), expected[i])
+
+
+def test_recycled_events():
+    kwargs = dict(random_state=1, verbosity=0)
+    expected = [event.all() for event in Pythia(get_cmnd('w'), **kwargs)(events=5)]
+    events = Pythia(get_cmnd('w'), recycle=True, arena=True, **kwargs)(events=5)
+    for i, event in enumerate(events):
+        assert_particles_equal(event.all(), expected[i])
+
+
+def test_lazy_events(tmpdir):
+    selections = [None, (STATUS == 1) & ~HAS_END_VERTEX, ABS_PDG_ID == 24]
+    kwargs = dict(random_state=1, verbosity=0)
+    events = Pythia(get_cmnd('w'), **kwargs)(events=3)
+    lazy_events = Pythia(get_cmnd('w'), lazy=True, **kwargs)(events=3)
+    filenames = [str(tmpdir.join('events.hepmc')), str(tmpdir.join('lazy.hepmc'))]
+    writers = [WriterAscii(filename) for filename in filenames]
+    for event, lazy_event in zip(events, lazy_events):
+        assert_array_equal(lazy_event.weights, event.weights)
+        # arrays from the PYTHIA record in the order of the HepMC event
+        for selection in selections:
+            assert_particles_equal(lazy_event.all(selection), event.all(selection))
+            assert_particles_equal(lazy_event.all(selection, vertices=False),
+                                   event.all(selection, vertices=False))
+            assert_particles_equal(lazy_event.all(selection, fields=['pT', 'prodz', 'pdgid']),
+                                   event.all(selection, fields=['pT', 'prodz', 'pdgid']))
+            columns = lazy_event.all(selection, layout='soa')
+            for name, column in event.all(selection, layout='soa').items():
+                assert_array_equal(columns[name], column)
+            assert_particles_equal(lazy_event.last(selection, return_hepmc=False),
+                                   event.last(selection, return_hepmc=False))
+        # the HepMC event is built on first use of the graph
+        assert repr(lazy_event.first(ABS_PDG_ID == 24)) == repr(event.first(ABS_PDG_ID == 24))
+        lazy_particles, lazy_offsets = lazy_event.ancestors([10, 20])
+        particles, offsets = event.ancestors([10, 20])
+        assert_array_equal(lazy_offsets, offsets)
+        assert_particles_equal(lazy_particles, particles)
+        writers[0].write(event)
+        writers[1].write(lazy_event)
+    for writer in writers:
+        writer.close()
+    with open(filenames[0]) as expected, open(filenames[1]) as lazy:
+        assert lazy.read() == expected.read()
+
+
+def test_beam_subtrees():
+    # the outgoing proton of an elastic event is only attached to the second
+    # beam, which the HepMC event must not drop
+    selection = STATUS == 1
+    kwargs = dict(random_state=1, verbosity=0,
+                  params={'SoftQCD:elastic': 'on', 'Beams:eCM': 13000})
+    hepmc_events = Pythia(**kwargs)(events=5)
+    pythia_events = Pythia(**kwargs)(events=5, hepmc=False)
+    for hepmc_event, pythia_event in zip(hepmc_events, pythia_events):
+        particles = hepmc_event.all(selection)
+        assert len(particles) == 2
+        assert_array_equal(np.sort(particles['E']), np.sort(pythia_event.array(selection)['E']))
+
+
+def test_hepmc_conversion():
+    # the conversion on record indices must give the same events as the
+    # upstream conversion that links every particle before sorting the event
+    configs = [dict(config=get_cmnd('w')),
+               dict(config=get_cmnd('qcd')),
+               dict(params={'SoftQCD:elastic': 'on', 'Beams:eCM': 13000}),
+               dict(params={'Beams:idA': 11, 'Beams:idB': -11, 'Beams:eCM': 91.188,
+                            'WeakSingleBoson:ffbar2gmZ': 'on'})]
+    for kwargs in configs:
+        pythia = Pythia(random_state=1, verbosity=0, **kwargs)
+        for event in pythia(events=10, hepmc=False):
+            converted, reference = pythia._hepmc_reference()
+            assert converted.count('\nP ') > 2
+            assert converted == reference
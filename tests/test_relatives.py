@@ -0,0 +1,26 @@
+from numpythia import Pythia, STATUS, HAS_END_VERTEX
+from numpythia.testcmnd import get_cmnd
+from numpy.testing import assert_array_equal
+import pytest
+
+
+def test_batched_relatives():
+    selection = (STATUS == 1) & ~HAS_END_VERTEX
+    pythia = Pythia(get_cmnd('w'), random_state=1, verbosity=0)
+    for event in pythia(events=2):
+        particles = event.all(return_hepmc=True)
+        ancestors, offsets = event.ancestors(range(len(particles)), fields=['E', 'pdgid'])
+        descendants, doffsets = event.descendants(particles, selection, fields=['E', 'pdgid'])
+        assert len(offsets) == len(doffsets) == len(particles) + 1
+        for i, particle in enumerate(particles):
+            assert_array_equal(ancestors[offsets[i]:offsets[i + 1]],
+                               particle.ancestors(fields=['E', 'pdgid']))
+            assert_array_equal(descendants[doffsets[i]:doffsets[i + 1]],
+                               particle.descendants(selection, fields=['E', 'pdgid']))
+        nested = event.ancestors(particles[-2:], return_hepmc=True)
+        assert [len(relatives) for relatives in nested] == [
+            len(particle.ancestors()) for particle in particles[-2:]]
+        with pytest.raises(IndexError):
+            event.ancestors([len(particles)])
+    with pytest.raises(ValueError):
+        event.ancestors(next(pythia(events=1)).all(return_hepmc=True)[:1])
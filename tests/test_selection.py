@@ -0,0 +1,26 @@
+from numpythia import Pythia, STATUS, PDG_ID, ABS_PDG_ID, HAS_END_VERTEX
+from numpythia.testcmnd import get_cmnd
+from numpy.testing import assert_array_equal
+import numpy as np
+import pytest
+
+
+def test_selection():
+    pythia = Pythia(get_cmnd('w'), random_state=1, verbosity=0)
+    for event in pythia(events=2):
+        array = event.all(fields=['E', 'status', 'pdgid'])
+        for selection, mask in (
+                ((ABS_PDG_ID == 11) | (ABS_PDG_ID == 13),
+                 (np.abs(array['pdgid']) == 11) | (np.abs(array['pdgid']) == 13)),
+                ((STATUS == 1) | (ABS_PDG_ID == 24),
+                 (array['status'] == 1) | (np.abs(array['pdgid']) == 24)),
+                (~((STATUS == 1) & (PDG_ID > 0)),
+                 ~((array['status'] == 1) & (array['pdgid'] > 0)))):
+            assert_array_equal(event.all(selection, fields=['E', 'status', 'pdgid']),
+                               array[mask])
+        w = event.last((ABS_PDG_ID == 24) & HAS_END_VERTEX)
+        assert abs(w.pid) == 24
+        with pytest.raises(TypeError):
+            event.all(STATUS)
+        with pytest.raises(TypeError):
+            STATUS | HAS_END_VERTEX
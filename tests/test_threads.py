@@ -0,0 +1,70 @@
+from threading import Thread
+
+from numpythia import Pythia, ReaderBinary, WriterBinary, STATUS, HAS_END_VERTEX
+from numpythia.testcmnd import get_cmnd
+from numpy.testing import assert_array_equal
+
+selection = (STATUS == 1) & ~HAS_END_VERTEX
+
+
+def generate(random_state, results):
+    pythia = Pythia(get_cmnd('w'), random_state=random_state, verbosity=0)
+    for event in pythia(events=5):
+        results.append(event.all(selection))
+
+
+def test_threaded_generation():
+    expected = {}
+    for seed in (1, 2):
+        expected[seed] = []
+        generate(seed, expected[seed])
+
+    results = {1: [], 2: []}
+    threads = [Thread(target=generate, args=(seed, results[seed]))
+               for seed in results]
+    for thread in threads:
+        thread.start()
+    for thread in threads:
+        thread.join()
+
+    for seed in results:
+        assert len(results[seed]) == len(expected[seed])
+        for array1, array2 in zip(results[seed], expected[seed]):
+            assert_array_equal(array1, array2)
+
+
+def read_binary(reader, indices, results):
+    for index in indices:
+        results[index] = reader[index].all().tobytes()
+
+
+def write_binary(writer, events):
+    for event in events:
+        writer.write(event)
+
+
+def test_threaded_binary_io(tmpdir):
+    filename = str(tmpdir.join('events.npyhepmc'))
+    pythia = Pythia(get_cmnd('w'), random_state=1, verbosity=0)
+    events = list(pythia(events=12))
+    writer = WriterBinary(filename, block_size=5)
+    threads = [Thread(target=write_binary, args=(writer, events[i::3]))
+               for i in range(3)]
+    for thread in threads:
+        thread.start()
+    for thread in threads:
+        thread.join()
+    writer.close()
+
+    reader = ReaderBinary(filename)
+    assert len(reader) == 12
+    expected = [event.all().tobytes() for event in reader]
+    assert sorted(expected) == sorted(event.all().tobytes() for event in events)
+    results = {}
+    threads = [Thread(target=read_binary, args=(reader, list(range(12)) * 5, results))
+               for i in range(4)]
+    for thread in threads:
+        thread.start()
+    for thread in threads:
+        thread.join()
+    assert [results[i] for i in range(12)] == expected